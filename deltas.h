@@ -8,6 +8,81 @@
 //#define MaxBeachLength  (8*Ymax)/**< maximum length of arrays that contain beach data at each time step */
 #define TimeStep     (0.2)  /**< days - reflects rate of sediment transport per
                              time step */
+#define REFRACT_TABLE_LEN (1024) /**< steps in deep-water angle of the wave breaking table */
+#define SHORE_DIRTY_MAX (512) /**< flipped cells remembered between shoreline traces */
+#define SHORE_REJOIN_WINDOW (8) /**< how far past the flips to look for the old shoreline */
+#define RIVER_TABLE_MIN (8) /**< rivers the river table starts out with room for */
+#define BORDERS_PER_TASK (256) /**< fewest beach borders handed to a thread at once */
+#define OVERWASH_LOG_MIN (256) /**< cell writes the overwash log starts out with room for */
+#define HALO_MARGIN (4) /**< cells a thin halo keeps past the longest shoreface or overwash line */
+
+#define GRID_ALIGN (64) /**< grid layers start on a cache line */
+
+/** Offset of cell (x, y) from the start of a grid layer */
+#define CELL_INDEX(s, x, y) ((x) * (s)->ny_grid + (y))
+
+/** Is cell (x, y) entirely beach?  The AllBeach flag, as a bit of
+BeachBits (see SetAllBeach) */
+#define IS_BEACH(s, x, y) \
+  ((int) ((s)->BeachBits[CELL_INDEX (s, x, y) / 64] \
+          >> (CELL_INDEX (s, x, y) % 64)) & 1)
+
+/** Does the grid keep a thin halo (deltas_set_halo_width) rather than wrap
+regions half the domain wide? */
+#define HAS_HALO(s) ((s)->halo_width > 0)
+
+/** Column of the grid that lines across it measure y from (see Ray) - ny / 2
+before the first column of the domain, which is column 0 by default and
+off the grid with a halo */
+#define LINE_YLO(s) ((s)->ny_lo - (s)->ny / 2)
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "deltas_archive.h"
+#include "deltas_output.h"
+#include "deltas_profile.h"
+#include "deltas_rng.h"
+#include "deltas_shoreline.h"
+#include "deltas_text.h"
+#include "deltas_threads.h"
+
+/** What FindOverwash made of one beach cell */
+typedef struct
+{
+  int found;  /**< Should sediment be washed over? */
+  int xto;  /**< Cell to wash it to, and where the line crosses into it */
+  int yto;
+  double xint;
+  double yint;  /**< From LINE_YLO, as a Ray's y */
+  double width;  /**< Width of the barrier washed over (m) */
+  int xlo;  /**< Every cell looked at lies in [xlo, xhi] x [ylo, yhi] */
+  int xhi;
+  int ylo;
+  int yhi;
+}
+Overwash;
+
+/** A line stepped across the grid a cell at a time (see RayStart)
+
+Shadows are looked for offshore, along the wave angle; overwash and the
+shoreface are looked for back toward land, along the shoreline angle.
+
+Along the coast the line is measured from LINE_YLO, ny / 2 columns before
+the domain, so that it rounds the same with a halo as with the default
+wrap regions.  The cells it steps into are columns of the grid.
+*/
+typedef struct
+{
+  double x, y;  /**< Where the line has reached, in cells - y from ylo */
+  int ylo;  /**< Column of the grid y is measured from (LINE_YLO) */
+  double slope;  /**< Cells alongshore per cell cross-shore */
+  int xsign;  /**< 1 steps offshore (up), -1 toward land (down) */
+  int ysign;  /**< 1 steps to greater y, -1 to smaller */
+  int float_distances;  /**< Compare distances through Raise (see RayStep) */
+  int xtest, ytest;  /**< Cell the last step went into */
+}
+Ray;
 
 typedef struct
 {
@@ -21,12 +96,26 @@ typedef struct
   double shoreface_slope;  /**< Gradient of the shoreface. */
   double shelf_slope;  /**< Gradient of the shelf. */
   double shoreface_depth;  /**< Water depth of the shoreface in meters. */
+  int exact_refraction;  /**< Refract waves for every border, not from the table */
+  int exact_overwash;  /**< Step every overwash check to its end, not stopping at wide land */
+  int track_age;  /**< Keep the Age layer? */
+  int init_barrier;  /**< Start from a barrier island, not a sandy beach? */
 
   int nx;  /**< Number of cells in x (cross-shore) direction */
   int ny;  /**< Number of cells in y (long-shore) direction */
+  int ny_lo;  /**< Column the domain starts at.  The columns before it, and
+                 those from ny_lo + ny on, wrap around (see
+                 PeriodicBoundaryCopy) */
+  int ny_grid;  /**< Number of columns kept - the domain and both wrap
+                   regions */
+  int halo_width;  /**< Width of the halo (deltas_set_halo_width), or 0
+                      for wrap regions half the domain wide */
   int max_beach_len;  /**< Max number of cells that can make up the coastline */
+  int shore_cap;  /**< Cells the shoreline arrays have room for */
+  int ShoreTraced;  /**< Shoreline entries written since the last reset */
 
   int n_rivers;
+  int river_cap;  /**< Rivers the river table has room for */
   double *river_flux;
   int *river_x_ind;
   int *river_y_ind;
@@ -40,17 +129,39 @@ typedef struct
    /** Input/output file names. */
   char *savefilename;  /**< Name of save file. */
   char *readfilename;  /**< Namve of file to read input from. */
+  char *archivename;  /**< Archive to save grids to instead of files of
+                         their own, or NULL */
+  cem_archive *archive;  /**< Open on archivename once something is saved */
+  char *shorelinename;  /**< Stream to add the shoreline to every time
+                           step, or NULL */
+  int shoreline_polyline;  /**< Keep the shoreline as traced, not by column */
+  cem_shoreline *shoreline;  /**< Open once a shoreline is saved */
+  int shoreline_failed;  /**< The shoreline stream couldn't be opened, so
+                            no more shorelines are saved to it */
+  int member;  /**< Member of deltas_run_ensemble this is, or -1; members
+                  add ".member<n>" to the names of their output files */
 
    /** Overall Shoreface Configuration Arrays - Data file information
-       This grids will be of size (nx, ny).
+       This grids will be of size (nx, ny).  Each is a layer of GridBlock;
+       its rows point into the layer ny_grid apart, so layer[x][y] is
+       layer[0][CELL_INDEX (s, x, y)].
     */
 
-  char **AllBeach;  /**< Flag indicating of cell is entirely beach */
   double **PercentFull;  /**< Fractional amount of shore cell full of
                                        sediment */
-  int **Age;  /**< Age since cell was deposited */
+  int **Age;  /**< Time step each full cell was last empty (see CellAge),
+                  NULL unless track_age */
   double **CellDepth;  /**< Depth array (m) (ADA 6/3) */
   double **InitDepth;  /**< Save initial depths (m) (EWHH 2010/8/11) */
+  uint64_t *BeachBits;  /**< Flag indicating of cell is entirely beach,
+                            one bit per cell by CELL_INDEX (IS_BEACH) */
+  int *BeachRowCount;  /**< Cells of each row that are all beach */
+  int BeachRowMax;  /**< Highest row with any all beach cell, -1 if none */
+  int *BarrierWidth;  /**< All beach cells from each cell down (toward
+                          land) to the first that isn't, by CELL_INDEX */
+  char *GridBlock;  /**< The one aligned block that holds every grid layer */
+  size_t GridBytes;  /**< Size of GridBlock */
+  int GridMapped;  /**< Is GridBlock mapped (see deltas_fork_state)? */
 
    /** Computational Arrays (determined for each time step) */
   int *X;  /**< X Position of ith beach element */
@@ -64,6 +175,13 @@ typedef struct
                                    calculate sediment transport */
   double *VolumeIn;   /**< Sediment volume into ith beach element */
   double *VolumeOut;  /**< Sediment volume out of ith beach element */
+  int *BorderFrom;  /**< Cell sediment leaves across border i, -1 if none */
+  int *BorderTo;  /**< Cell sediment enters across border i */
+  double *BorderFlux;  /**< Sediment volume across border i */
+  Overwash *Overwashes;  /**< What FindOverwash made of beach cell i, when
+                            the cells are looked at on the pool */
+  int *OldX;  /**< Shoreline of the previous trace, kept while retracing */
+  int *OldY;
 
    /** Miscellaneous State Variables */
   int CurrentTimeStep;  /**< Time step of current calculation */
@@ -77,12 +195,52 @@ typedef struct
   int external_waves;
   double WaveAngle;  /**< wave angle for current time step */
 
+  int n_threads;  /**< Threads used for sediment transport and overwash */
+  cem_pool *pool;  /**< Workers for the parallel phases, NULL if serial */
+  cem_writer *writer;  /**< Writes output files in the background, NULL
+                          until something is saved */
+
+  int profiling;  /**< Time the phases of the time loop? */
+  Deltas_profile Profile;
+  int trace;  /**< DELTAS_TRACE_ categories to print */
+
   int FindStart;  /**< Used to tell FindBeach at what Y value to start looking */
 
   char FellOffArray;  /**< Flag used to determine if accidentally went off array */
 
+  char ShorelineValid;  /**< Can the last shoreline found be retraced? */
+  int NumShoreDirty;  /**< Number of cells flipped since the last trace */
+  int ShoreDirtyX[SHORE_DIRTY_MAX];  /**< Cells whose AllBeach flag flipped */
+  int ShoreDirtyY[SHORE_DIRTY_MAX];
+
+  int FixAll;  /**< Must the next FixBeach look at every cell? */
+  int FixScannedXMax;  /**< Rows below this have been looked at by FixBeach */
+  int *FixList;  /**< Cells changed since the last FixBeach, by CELL_INDEX */
+  int NumFix;
+  int FixListCap;
+  uint64_t *FixBits;  /**< Which cells are on FixList */
+  int *FixQueue;  /**< Heap of cells FixBeach still has to look at */
+  int NumFixQueued;
+  int FixQueueCap;
+  uint64_t *FixQueued;  /**< Which cells are in FixQueue */
+
+  int *OverwashLog;  /**< Cells written (by CELL_INDEX, once each) since
+                        the sweep's overwashes were looked for, if
+                        NumOverwashLog >= 0 */
+  int NumOverwashLog;  /**< -1 when writes aren't being logged */
+  int OverwashLogCap;
+  uint64_t *OverwashBits;  /**< Which cells are on OverwashLog */
+
   double MassInitial;  /**< For conservation of mass calcs */
-  double MassCurrent;
+  double MassCurrent;  /**< Running sum of PercentFull (see AddMass) */
+  double MassError;  /**< Low order part of MassCurrent */
+
+  double RefractHeight;  /**< Wave height and period of the breaking table */
+  double RefractPeriod;
+  double BreakAngle[REFRACT_TABLE_LEN + 1];  /**< Angle of breaking waves by deep-water angle */
+  double BreakHeight[REFRACT_TABLE_LEN + 1];  /**< Height of breaking waves by deep-water angle */
+  double BreakAngleMaxT;  /**< Breaking angle and height for maximum transport */
+  double BreakHeightMaxT;
 
   int NumWaveBins;     /**< For Input Wave - number of bins */
   double WaveMax[36];   /**< Max Angle for specific bin */
@@ -95,7 +253,8 @@ typedef struct
   int yplotoff;
 
   //char state[256];
-  char *state;
+  uint64_t seed;  /**< Seed for rng, used when the model is initialized */
+  cem_rng rng;  /**< Random numbers for this instance (see RandZeroToOne) */
 }
 State;
 
@@ -109,4 +268,77 @@ void deltas_init_state (State * s);
 
 void deltas_free_state (State * s);
 
+int deltas_grow_array (void *p, size_t size);
+
+int deltas_reserve_shoreline (State * s, int len);
+
+int deltas_halo_min_width (double cell_width, double shoreface_slope,
+                           double shoreface_depth);
+
+int deltas_reserve_rivers (State * s, int n);
+
+int deltas_alloc_age (State * s);
+
+int deltas_cell_age (State * s, int x, int y);
+
+void deltas_count_beach (State * s);
+
+State *deltas_fork_state (const State * base, int fd);
+
+int deltas_write_grid (const State * s, int fd);
+
+/* Steps of the time loop that test_deltas checks against the slower ones */
+/* they stand in for                                                       */
+
+void PeriodicBoundaryCopy (State * _s);
+
+int FindShoreline (State * _s);
+
+int RetraceShoreline (State * _s);
+
+void FindNextCell (State * _s, int x, int y, int z);
+
+void FindNextCellRules (State * _s, int x, int y, int z);
+
+void SetAllBeach (State * _s, int x, int y, char flag);
+
+void BuildBreakingTable (State * _s);
+
+void LookUpBreaking (State * _s, double AngleDeep, double *BreakAngle,
+                     double *BreakHeight);
+
+void RefractWave (State * _s, double AngleDeep, double *BreakAngle,
+                  double *BreakHeight);
+
+void FixBeach (State * _s);
+
+void MarkFixCell (State * _s, int x, int y);
+
+void AddPercentFull (State * _s, int x, int y, double amount);
+
+int XMaxBeach (State * _s, int Max);
+
+void ZeroVars (State * _s);
+
+void ShadowSweep (State * _s);
+
+void ShadowStartPoint (State * _s, int icheck, double *xin, double *yin);
+
+void DetermineAngles (State * _s);
+
+void CheckOverwashSweep (State * _s);
+
+int CanOverwash (State * _s, int i);
+
+int FindOverwash (State * _s, int icheck, Overwash * ow);
+
+int ReadSandFromFile (State * _s);
+
+double Raise (double b, double e);
+
+void RayStart (Ray * r, double x, double y, int ylo, double angle, int xsign,
+               int ysign, int float_distances);
+
+void RayStep (Ray * r);
+
 #endif
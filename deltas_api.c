@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "deltas.h"
 #include "deltas_api.h"
@@ -52,6 +54,7 @@ BMI_CEM_Initialize (const char *config_file, BMI_Model **handle)
     double shoreface_slope;
     double shoreface_depth;
     double shelf_slope;
+    int halo_width = 0;
 
     if (config_file) {
       FILE *fp = fopen (config_file, "r");
@@ -69,6 +72,10 @@ BMI_CEM_Initialize (const char *config_file, BMI_Model **handle)
       scan_next_non_comment_line (buffer, 2048, fp);
       sscanf (buffer, "%lf, %lf, %lf", &shoreface_slope, &shoreface_depth, &shelf_slope);
 
+      /* An optional third line gives the width of the wrap regions */
+      if (scan_next_non_comment_line (buffer, 2048, fp))
+        sscanf (buffer, "%d", &halo_width);
+
       fprintf (stderr, "CEM: number of rows, columns: %d, %d\n", n_rows, n_cols);
 
       //fscanf (fp, "%d, %d, %lf, %d\n", &n_rows, &n_cols, &dx, &sed_flux_flag);
@@ -92,8 +99,24 @@ BMI_CEM_Initialize (const char *config_file, BMI_Model **handle)
     if (!s)
       return BMI_FAILURE + 4;
 
-    deltas_init_grid_shape (s, shape);
+    /* The shoreface is only set once the grid is built (so the initial */
+    /* depths come from the default one), but the halo has to be wide    */
+    /* enough for it                                                      */
+    if (halo_width > 0)
+    {
+      const int min_width =
+        deltas_halo_min_width (dx, shoreface_slope, shoreface_depth);
+
+      if (halo_width < min_width)
+        halo_width = min_width;
+    }
+    deltas_set_halo_width (s, halo_width);
     deltas_init_cell_width (s, dx);
+    if (!deltas_init_grid_shape (s, shape))
+    {
+      deltas_destroy (s);
+      return BMI_FAILURE + 5;
+    }
 
     deltas_init (s);
 
@@ -130,6 +153,7 @@ deltas_destroy (Deltas_state * s)
   if (s)
   {
 
+    deltas_destroy_grid (s);
     deltas_free_state ((State *) s);
     free (s);
   }
@@ -230,6 +254,38 @@ deltas_set_save_file (Deltas_state * s, const char *name)
   return s;
 }
 
+/** Saves grids to one archive at name rather than a file per save
+
+Setting an archive turns grid saves on, every SAVE_SPACING time steps
+from START_SAVING_AT, even if SAVE_FILE is off.  The archive is added to
+if it is already there.  See deltas_archive.h for reading it back.
+*/
+Deltas_state *
+deltas_set_archive_file (Deltas_state * s, const char *name)
+{
+  State *p = (State *) s;
+
+  free (p->archivename);
+  p->archivename = name ? strdup (name) : NULL;
+  return s;
+}
+
+/** Adds the shoreline to the stream at name every time step
+
+The stream is added to if it is already there.  See deltas_shoreline.h
+for its layout.
+*/
+Deltas_state *
+deltas_set_shoreline_file (Deltas_state * s, const char *name)
+{
+  State *p = (State *) s;
+
+  free (p->shorelinename);
+  p->shorelinename = name ? strdup (name) : NULL;
+  p->shoreline_failed = FALSE;
+  return s;
+}
+
 Deltas_state *
 deltas_set_read_file (Deltas_state * s, char *name)
 {
@@ -239,6 +295,112 @@ deltas_set_read_file (Deltas_state * s, char *name)
   return s;
 }
 
+/* Make room for n rivers in the river table
+
+Returns FALSE, with p->river_cap as it was, if there isn't room.  Arrays
+that did grow keep their new size, which does no harm.
+*/
+int
+deltas_reserve_rivers (State * p, int n)
+{
+  if (n > p->river_cap)
+  {
+    int cap = (p->river_cap > 0) ? p->river_cap : RIVER_TABLE_MIN;
+
+    while (cap < n)
+      cap *= 2;
+
+    if (!deltas_grow_array (&p->river_flux, sizeof (double) * cap)
+        || !deltas_grow_array (&p->river_x_ind, sizeof (int) * cap)
+        || !deltas_grow_array (&p->river_y_ind, sizeof (int) * cap)
+        || !deltas_grow_array (&p->river_x, sizeof (double) * cap)
+        || !deltas_grow_array (&p->river_y, sizeof (double) * cap))
+    {
+      fprintf (stderr, "*** Unable to make room for %d rivers\n", cap);
+      return FALSE;
+    }
+    p->river_cap = cap;
+  }
+  return TRUE;
+}
+
+/* Round a grid layer up to a whole number of cache lines */
+static size_t
+grid_layer_bytes (size_t bytes)
+{
+  return (bytes + GRID_ALIGN - 1) / GRID_ALIGN * GRID_ALIGN;
+}
+
+/* Allocates the Age layer, which most runs do without (see deltas_use_age)
+*/
+int
+deltas_alloc_age (State * p)
+{
+  const int stride = p->ny_grid;
+  int i;
+
+  p->Age = (int **)malloc (sizeof (int *) * p->nx);
+  if (p->Age)
+    p->Age[0] = (int *)calloc ((size_t) p->nx * stride, sizeof (int));
+  if (!p->Age || !p->Age[0])
+  {
+    fprintf (stderr, "*** Unable to allocate age of (%d,%d)\n", p->nx,
+             stride);
+    free (p->Age);
+    p->Age = NULL;
+    return FALSE;
+  }
+
+  for (i = 1; i < p->nx; i++)
+    p->Age[i] = p->Age[i - 1] + stride;
+
+  return TRUE;
+}
+
+/** Keep wrap regions only width cells wide, rather than half the domain
+
+The grids are then nx by ny + 2 * width, rather than nx by 2ny, and
+PeriodicBoundaryCopy copies 2 * width columns of each row.  The width is
+raised to deltas_halo_min_width for the cell width and shoreface the grid
+is shaped with.  A width of 0 keeps the default wrap regions.
+
+A halo changes results slightly (see PeriodicBoundaryCopy), so it is not
+the default.
+
+Has to be set before the grid is shaped (deltas_init_grid_shape); returns
+NULL if it is too late.  deltas_init_grid_shape fails if the halo would
+not be narrower than half the domain.
+*/
+Deltas_state *
+deltas_set_halo_width (Deltas_state * s, int width)
+{
+  State *p = (State *) s;
+
+  if (p->GridBlock)
+  {
+    fprintf (stderr, "*** Set the halo width before the grid is shaped\n");
+    return NULL;
+  }
+
+  p->halo_width = width;
+  return s;
+}
+
+/** Warns if a change to the shoreface or cell width has left the halo
+narrower than deltas_halo_min_width
+*/
+static void
+check_halo_width (State * p)
+{
+  if (p->GridBlock && HAS_HALO (p)
+      && p->ny_lo < deltas_halo_min_width (p->cell_width, p->shoreface_slope,
+                                           p->shoreface_depth))
+    fprintf (stderr, "*** Wrap regions of %d cells are too narrow; "
+             "this shoreface needs %d\n", p->ny_lo,
+             deltas_halo_min_width (p->cell_width, p->shoreface_slope,
+                                    p->shoreface_depth));
+}
+
 Deltas_state *
 deltas_init_grid_shape (Deltas_state * s, int dimen[2])
 {
@@ -250,52 +412,124 @@ deltas_init_grid_shape (Deltas_state * s, int dimen[2])
   {
     int i;
 
-    //const int len = dimen[0] * (dimen[1] * 2);
-    const int len = dimen[0] * dimen[1];
+    int len;
 
-    //const int stride = dimen[1] * 2;
-    const int stride = dimen[1];
+    int stride;
 
     p->nx = dimen[0];
     p->ny = dimen[1]/2;
+
+    /* The wrap regions are half the domain wide, unless a thinner halo */
+    /* was asked for (deltas_set_halo_width)                            */
+    p->ny_lo = p->ny / 2;
+    p->ny_grid = 2 * p->ny;
+    if (p->halo_width > 0)
+    {
+      int width = deltas_halo_min_width (p->cell_width, p->shoreface_slope,
+                                         p->shoreface_depth);
+
+      if (p->halo_width > width)
+        width = p->halo_width;
+      if (width >= p->ny / 2)
+      {
+        fprintf (stderr, "*** A halo of %d cells is too wide for a domain "
+                 "of %d\n", width, p->ny);
+        p->nx = 0;
+        p->ny = 0;
+        p->ny_lo = 0;
+        p->ny_grid = 0;
+        return NULL;
+      }
+      p->halo_width = width;
+      p->ny_lo = width;
+      p->ny_grid = p->ny + 2 * width;
+      fprintf (stderr, "*** Wrap regions are %d cells wide\n", p->ny_lo);
+    }
+
+    len = p->nx * p->ny_grid;
+    stride = p->ny_grid;
     p->max_beach_len = len;
 
-    p->AllBeach = (char **)malloc (sizeof (char *) * p->nx);
     p->PercentFull = (double **)malloc (sizeof (double *) * p->nx);
-    p->Age = (int **)malloc (sizeof (int *) * p->nx);
     p->CellDepth = (double **)malloc (sizeof (double *) * p->nx);
     p->InitDepth = (double **)malloc (sizeof (double *) * p->nx);
 
-    p->AllBeach[0] = (char *)malloc (sizeof (char) * len);
-    p->PercentFull[0] = (double *)malloc (sizeof (double) * len);
-    p->Age[0] = (int *)malloc (sizeof (int) * len);
-    p->CellDepth[0] = (double *)malloc (sizeof (double) * len);
-    p->InitDepth[0] = (double *)malloc (sizeof (double) * len);
+    /* Every layer goes in one block, each starting on a cache line.  The */
+    /* AllBeach flags are the BeachBits bitset, read by IS_BEACH          */
+    {
+      const size_t n_words = (len + 63) / 64;
+      const size_t double_bytes = grid_layer_bytes (sizeof (double) * len);
+      const size_t bit_bytes = grid_layer_bytes (sizeof (uint64_t) * n_words);
+      char *block = NULL;
+
+      if (!p->PercentFull || !p->CellDepth || !p->InitDepth
+          || posix_memalign ((void **)&block, GRID_ALIGN,
+                             3 * double_bytes + 3 * bit_bytes) != 0)
+      {
+        fprintf (stderr, "*** Unable to allocate grid of (%d,%d)\n",
+                 dimen[0], dimen[1]);
+        free (p->PercentFull);
+        free (p->CellDepth);
+        free (p->InitDepth);
+        p->PercentFull = NULL;
+        p->CellDepth = NULL;
+        p->InitDepth = NULL;
+        p->nx = 0;
+        p->ny = 0;
+        p->ny_lo = 0;
+        p->ny_grid = 0;
+        p->max_beach_len = 0;
+        return NULL;
+      }
+      memset (block, 0, 3 * double_bytes + 3 * bit_bytes);
+
+      p->GridBlock = block;
+      p->GridBytes = 3 * double_bytes + 3 * bit_bytes;
+      p->GridMapped = FALSE;
+      p->PercentFull[0] = (double *)block;
+      block += double_bytes;
+      p->CellDepth[0] = (double *)block;
+      block += double_bytes;
+      p->InitDepth[0] = (double *)block;
+      block += double_bytes;
+      p->BeachBits = (uint64_t *)block;
+      block += bit_bytes;
+      p->FixBits = (uint64_t *)block;
+      block += bit_bytes;
+      p->FixQueued = (uint64_t *)block;
+    }
+    p->BeachRowCount = (int *)calloc (p->nx, sizeof (int));
+    p->BeachRowMax = -1;
+    p->BarrierWidth = (int *)calloc (len, sizeof (int));
+    if (!p->BeachRowCount || !p->BarrierWidth)
+    {
+      fprintf (stderr, "*** Unable to allocate grid of (%d,%d)\n",
+               dimen[0], dimen[1]);
+      deltas_destroy_grid (s);
+      return NULL;
+    }
 
     for (i = 1; i < p->nx; i++)
     {
-      p->AllBeach[i] = p->AllBeach[i - 1] + stride;
       p->PercentFull[i] = p->PercentFull[i - 1] + stride;
-      p->Age[i] = p->Age[i - 1] + stride;
       p->CellDepth[i] = p->CellDepth[i - 1] + stride;
       p->InitDepth[i] = p->InitDepth[i - 1] + stride;
     }
 
-    p->river_flux = (double *)malloc (sizeof (double) * len);
-    p->river_x_ind = (int *)malloc (sizeof (int) * len);
-    p->river_y_ind = (int *)malloc (sizeof (int) * len);
-    p->river_x = (double *)malloc (sizeof (double) * len);
-    p->river_y = (double *)malloc (sizeof (double) * len);
+    if (p->track_age)
+      deltas_alloc_age (p);
+
     p->n_rivers = 1;
 
-    p->X = (int *)malloc (sizeof (int) * len);
-    p->Y = (int *)malloc (sizeof (int) * len);
-    p->InShadow = (char *)malloc (sizeof (char) * len);
-    p->ShorelineAngle = (double *)malloc (sizeof (double) * len);
-    p->SurroundingAngle = (double *)malloc (sizeof (double) * len);
-    p->UpWind = (char *)malloc (sizeof (char) * len);
-    p->VolumeIn = (double *)malloc (sizeof (double) * len);
-    p->VolumeOut = (double *)malloc (sizeof (double) * len);
+    /* A straight coast crosses the grid in ny_grid cells - start with   */
+    /* room for twice that and let the trace grow the arrays if it needs */
+    /* more                                                              */
+    if (!deltas_reserve_rivers (p, p->n_rivers)
+        || !deltas_reserve_shoreline (p, 2 * p->ny_grid))
+    {
+      deltas_destroy_grid (s);
+      return NULL;
+    }
   }
   fprintf (stderr, "*** New grid size is (%d,%d)\n",
            deltas_get_nx (s), deltas_get_ny (s));
@@ -324,7 +558,7 @@ deltas_init_grid (Deltas_state * s, double *z)
   {
     int i;
 
-    const int len = p->nx * p->ny * 2;
+    const int len = p->nx * p->ny_grid;
 
     for (i = 0; i < len; i++)
       p->InitDepth[0][i] = z[i];
@@ -342,26 +576,281 @@ deltas_destroy_grid (Deltas_state * s)
   {
     p->nx = 0;
     p->ny = 0;
+    p->ny_lo = 0;
+    p->ny_grid = 0;
 
-    free (p->AllBeach[0]);
-    free (p->AllBeach);
-
-    free (p->Age[0]);
+    if (p->GridMapped)
+      munmap (p->GridBlock, p->GridBytes);
+    else
+      free (p->GridBlock);
+    p->GridBlock = NULL;
+    p->GridBytes = 0;
+    p->BeachBits = NULL;
+    p->FixBits = NULL;
+    p->FixQueued = NULL;
+    p->NumFix = 0;
+    free (p->BeachRowCount);
+    p->BeachRowCount = NULL;
+    free (p->BarrierWidth);
+    p->BarrierWidth = NULL;
+    p->BeachRowMax = -1;
+
+    if (p->Age)
+      free (p->Age[0]);
     free (p->Age);
+    p->Age = NULL;
 
-    free (p->PercentFull[0]);
     free (p->PercentFull);
-
-    free (p->CellDepth[0]);
     free (p->CellDepth);
-
-    free (p->InitDepth[0]);
     free (p->InitDepth);
+    p->PercentFull = NULL;
+    p->CellDepth = NULL;
+    p->InitDepth = NULL;
   }
 
   return s;
 }
 
+/* Gives up on a State that deltas_fork_state couldn't finish */
+static State *
+fork_failed (State * p)
+{
+  fprintf (stderr, "*** Unable to allocate a copy of the model\n");
+  deltas_destroy ((Deltas_state *) p);
+  return NULL;
+}
+
+/* Points the rows of a grid layer into block, at the same offset that
+base's rows are from base's block
+*/
+static void *
+rebase_rows (void **rows, void **base_rows, const State * base, char *block,
+             size_t size)
+{
+  const size_t offset = (char *)base_rows[0] - base->GridBlock;
+  const size_t stride = base->ny_grid * size;
+  int i;
+
+  for (i = 0; i < base->nx; i++)
+    rows[i] = block + offset + i * stride;
+
+  return rows;
+}
+
+/** A new State that carries on exactly from where base is
+
+If fd is a file descriptor, the grid block is mapped privately from it.
+It must hold an image of base's grid block (see deltas_write_grid).
+Pages of the mapping are shared, with base's image and with every other
+State mapped from it, until they are written to.  InitDepth, and the
+land and deep water well away from the shore, are never written so are
+never copied.  If fd is -1 the grid block is copied.
+*/
+State *
+deltas_fork_state (const State * base, int fd)
+{
+  State *p = (State *) malloc (sizeof (State));
+  char *block = NULL;
+
+  if (!p)
+    return NULL;
+
+  if (fd >= 0)
+  {
+    block = (char *)mmap (NULL, base->GridBytes, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE, fd, 0);
+    if (block == (char *)MAP_FAILED)
+      block = NULL;
+  }
+  else if (posix_memalign ((void **)&block, GRID_ALIGN, base->GridBytes)
+           == 0)
+    memcpy (block, base->GridBlock, base->GridBytes);
+  else
+    block = NULL;
+
+  if (!block)
+  {
+    free (p);
+    return NULL;
+  }
+
+  /* Parameters, tables, time, random numbers and the record of cells */
+  /* flipped since the last shoreline trace carry over as they are */
+  memcpy (p, base, sizeof (State));
+
+  p->savefilename = base->savefilename ? strdup (base->savefilename) : NULL;
+  p->readfilename = base->readfilename ? strdup (base->readfilename) : NULL;
+  p->archivename = base->archivename ? strdup (base->archivename) : NULL;
+  p->archive = NULL;
+  p->shorelinename = base->shorelinename ? strdup (base->shorelinename) : NULL;
+  p->shoreline = NULL;
+  p->shoreline_failed = FALSE;  /* a member's stream has a name of its own */
+
+  p->river_flux = NULL;
+  p->river_x = NULL;
+  p->river_y = NULL;
+  p->river_x_ind = NULL;
+  p->river_y_ind = NULL;
+  p->river_cap = 0;
+
+  /* Everything else is allocated below, so nothing of base's can be */
+  /* freed if we have to give up part way */
+  p->GridBlock = block;
+  p->GridMapped = (fd >= 0);
+  p->PercentFull = NULL;
+  p->CellDepth = NULL;
+  p->InitDepth = NULL;
+  p->BeachRowCount = NULL;
+  p->BarrierWidth = NULL;
+  p->Age = NULL;
+  p->X = NULL;
+  p->Y = NULL;
+  p->OldX = NULL;
+  p->OldY = NULL;
+  p->InShadow = NULL;
+  p->ShorelineAngle = NULL;
+  p->SurroundingAngle = NULL;
+  p->UpWind = NULL;
+  p->VolumeIn = NULL;
+  p->VolumeOut = NULL;
+  p->BorderFrom = NULL;
+  p->BorderTo = NULL;
+  p->BorderFlux = NULL;
+  p->Overwashes = NULL;
+  p->shore_cap = 0;
+  p->FixList = NULL;
+  p->FixListCap = 0;
+  p->FixQueue = NULL;
+  p->FixQueueCap = 0;
+  p->OverwashLog = NULL;
+  p->NumOverwashLog = -1;
+  p->OverwashLogCap = 0;
+  p->OverwashBits = NULL;
+  p->pool = NULL;
+  p->n_threads = 1;
+  p->writer = NULL;
+
+  if (!deltas_reserve_rivers (p, base->n_rivers))
+    return fork_failed (p);
+  memcpy (p->river_flux, base->river_flux, sizeof (double) * base->n_rivers);
+  memcpy (p->river_x, base->river_x, sizeof (double) * base->n_rivers);
+  memcpy (p->river_y, base->river_y, sizeof (double) * base->n_rivers);
+  memcpy (p->river_x_ind, base->river_x_ind, sizeof (int) * base->n_rivers);
+  memcpy (p->river_y_ind, base->river_y_ind, sizeof (int) * base->n_rivers);
+
+  p->PercentFull = (double **)malloc (sizeof (double *) * p->nx);
+  p->CellDepth = (double **)malloc (sizeof (double *) * p->nx);
+  p->InitDepth = (double **)malloc (sizeof (double *) * p->nx);
+  if (!p->PercentFull || !p->CellDepth || !p->InitDepth)
+    return fork_failed (p);
+  rebase_rows ((void **)p->PercentFull, (void **)base->PercentFull, base,
+               block, sizeof (double));
+  rebase_rows ((void **)p->CellDepth, (void **)base->CellDepth, base, block,
+               sizeof (double));
+  rebase_rows ((void **)p->InitDepth, (void **)base->InitDepth, base, block,
+               sizeof (double));
+  p->BeachBits = (uint64_t *)(block +
+                              ((char *)base->BeachBits - base->GridBlock));
+  p->FixBits = (uint64_t *)(block + ((char *)base->FixBits - base->GridBlock));
+  p->FixQueued = (uint64_t *)(block +
+                              ((char *)base->FixQueued - base->GridBlock));
+  p->BeachRowCount = (int *)malloc (sizeof (int) * p->nx);
+  p->BarrierWidth = (int *)malloc (sizeof (int) * p->nx * p->ny_grid);
+  if (!p->BeachRowCount || !p->BarrierWidth)
+    return fork_failed (p);
+  memcpy (p->BeachRowCount, base->BeachRowCount, sizeof (int) * p->nx);
+  memcpy (p->BarrierWidth, base->BarrierWidth,
+          sizeof (int) * p->nx * p->ny_grid);
+
+  if (base->Age)
+  {
+    if (!deltas_alloc_age (p))
+      return fork_failed (p);
+    memcpy (p->Age[0], base->Age[0], sizeof (int) * p->nx * p->ny_grid);
+  }
+
+  if (!deltas_reserve_shoreline (p, base->shore_cap))
+    return fork_failed (p);
+  {
+    const size_t n = base->shore_cap;
+
+    memcpy (p->X, base->X, sizeof (int) * n);
+    memcpy (p->Y, base->Y, sizeof (int) * n);
+    memcpy (p->OldX, base->OldX, sizeof (int) * n);
+    memcpy (p->OldY, base->OldY, sizeof (int) * n);
+    memcpy (p->InShadow, base->InShadow, sizeof (char) * n);
+    memcpy (p->ShorelineAngle, base->ShorelineAngle, sizeof (double) * n);
+    memcpy (p->SurroundingAngle, base->SurroundingAngle, sizeof (double) * n);
+    memcpy (p->UpWind, base->UpWind, sizeof (char) * n);
+    memcpy (p->VolumeIn, base->VolumeIn, sizeof (double) * n);
+    memcpy (p->VolumeOut, base->VolumeOut, sizeof (double) * n);
+  }
+
+  if (base->NumFix > 0)
+  {
+    p->FixList = (int *)malloc (sizeof (int) * base->FixListCap);
+    if (!p->FixList)
+      return fork_failed (p);
+    p->FixListCap = base->FixListCap;
+    memcpy (p->FixList, base->FixList, sizeof (int) * base->NumFix);
+  }
+  if (base->NumFixQueued > 0)
+  {
+    p->FixQueue = (int *)malloc (sizeof (int) * base->FixQueueCap);
+    if (!p->FixQueue)
+      return fork_failed (p);
+    p->FixQueueCap = base->FixQueueCap;
+    memcpy (p->FixQueue, base->FixQueue, sizeof (int) * base->NumFixQueued);
+  }
+
+  deltas_set_n_threads ((Deltas_state *) p, base->n_threads);
+
+  return p;
+}
+
+/** A deep copy of s, that carries on exactly as s would
+
+The copy has its own grids, shoreline, river table, random number
+generator and threads, so the two can be run on (from different threads
+if need be) without affecting each other - except that the copy keeps the
+names of s's output files, so give it names of its own before both write
+output.  To branch one State into many
+scenarios, deltas_run_ensemble shares the grid between the branches
+copy-on-write instead.
+*/
+Deltas_state *
+deltas_clone (Deltas_state * s)
+{
+  if (!s)
+    return NULL;
+
+  return (Deltas_state *) deltas_fork_state ((const State *) s, -1);
+}
+
+/** Writes an image of the grid block of s to fd, for deltas_fork_state
+*/
+int
+deltas_write_grid (const State * s, int fd)
+{
+  const char *block = s->GridBlock;
+  size_t left = s->GridBytes;
+
+  if (ftruncate (fd, 0) != 0)
+    return FALSE;
+
+  while (left > 0)
+  {
+    const ssize_t n = write (fd, block, left);
+
+    if (n <= 0)
+      return FALSE;
+    block += n;
+    left -= n;
+  }
+
+  return TRUE;
+}
+
 double
 deltas_get_sed_rate (Deltas_state * s)
 {
@@ -382,11 +871,13 @@ deltas_find_river_mouth (Deltas_state * s, int n)
   //y = p->stream_spot;
   y = deltas_get_ny (s) / 2;
 
-  while (p->AllBeach[x][y] == 'y')
+  while (IS_BEACH (p, x, y))
   {
     x += 1;
   }
 
+  if (!deltas_reserve_rivers (p, n + 1))
+    return NULL;
   p->river_x_ind[n] = x;
   p->river_y_ind[n] = y;
   p->river_x[n] = x*deltas_get_dx (s);
@@ -414,19 +905,22 @@ deltas_avulsion (Deltas_state * s, double *qs, double river_flux)
 
   int len;
 
-  deltas_find_river_mouth (s, 0);
+  if (!deltas_find_river_mouth (s, 0))
+    return;
 
   x = p->river_x_ind[0];
   y = p->river_y_ind[0];
 
-  len = deltas_get_nx (s) * deltas_get_ny (s) / 2;
+  len = deltas_get_nx (s) * p->ny;
   for (i = 0; i < len; i++)
     qs[i] = 0;
 
   qs_x = x;
   //qs_y = y % deltas_get_ny (s) - deltas_get_ny (s) / 4;
-  qs_y = y;
-  qs_i = qs_x * deltas_get_ny (s) / 2 + qs_y;
+  /* Counted as if the wrap regions were half a domain wide, whatever */
+  /* their width (see deltas_set_halo_width) */
+  qs_y = y - p->ny_lo + p->ny / 2;
+  qs_i = qs_x * p->ny + qs_y;
 
   qs[qs_i] = river_flux;
 
@@ -460,6 +954,8 @@ deltas_set_river_sed_flux (Deltas_state * s, double flux, int n)
 {
   State *p = (State *) s;
 
+  if (!deltas_reserve_rivers (p, n + 1))
+    return NULL;
   p->river_flux[n] = flux;
   return s;
 }
@@ -471,6 +967,8 @@ deltas_set_river_position (Deltas_state * s, int x, int y, int n)
 {
   State *p = (State *) s;
 
+  if (!deltas_reserve_rivers (p, n + 1))
+    return NULL;
   p->river_x_ind[n] = x;
   p->river_y_ind[n] = y;
   p->river_x[n] = x*deltas_get_dx (s);
@@ -488,8 +986,8 @@ deltas_set_sediment_flux_grid_old (Deltas_state * s, double *qs)
   int n;
 
   int len;
-  const int lower[2] = { deltas_get_ny (s) / 4, 0 };
-  const int stride[2] = { 1, deltas_get_ny (s) / 2 };
+  const int lower[2] = { p->ny_lo, 0 };
+  const int stride[2] = { 1, p->ny };
   int dimen[3];
 /*
   fprintf (stderr, "Set flux grid\n");
@@ -504,6 +1002,11 @@ deltas_set_sediment_flux_grid_old (Deltas_state * s, double *qs)
   {
     if (qs[i] > 0)
     {
+      if (!deltas_reserve_rivers (p, n + 1))
+      {
+        p->n_rivers = n;
+        return NULL;
+      }
       p->river_flux[n] = qs[i];
       p->river_x_ind[n] = i / stride[1];
       p->river_y_ind[n] = i % stride[1] + lower[0];
@@ -544,13 +1047,10 @@ deltas_set_sediment_flux_grid (Deltas_state * s, double *qs)
   int len;
   const int lower[2] = { 0, 0 };
   const int stride[2] = { 1, deltas_get_ny (s) };
-  int dimen[3];
-  const int qs_stride[2] = {deltas_get_ny (s)/2, 1};
-  const int qs_lower[2] = {deltas_get_ny (s)/4, 0};
+  const int qs_stride[2] = {p->ny, 1};
+  const int qs_lower[2] = {p->ny_lo, 0};
 
-  deltas_get_value_dimen (s, NULL, dimen);
-
-  len = dimen[0] * dimen[1] * dimen[2] / 2;
+  len = p->nx * p->ny;
 
   fprintf (stderr, "Setting sediment flux grid\n");
 
@@ -560,6 +1060,11 @@ deltas_set_sediment_flux_grid (Deltas_state * s, double *qs)
     {
       fprintf (stderr, "Found non-zero flux at %d\n", i);
 
+      if (!deltas_reserve_rivers (p, n + 1))
+      {
+        p->n_rivers = n;
+        return NULL;
+      }
       p->river_flux[n] = qs[i];
 
       p->river_x_ind[n] = i / qs_stride[0];
@@ -588,6 +1093,8 @@ deltas_set_rivers (Deltas_state * s, const double * x, const double * y,
   const double dx = deltas_get_dx (s);
   const double dy = deltas_get_dy (s);
 //fprintf (stderr, "DEBUG: n_rivers=%d\n", len);
+  if (!deltas_reserve_rivers (p, len))
+    return NULL;
   p->n_rivers = len;
   for (i=0; i<len; i++)
   {
@@ -638,6 +1145,7 @@ deltas_set_depth (Deltas_state * s, double *depth)
   State *p = (State *) s;
 
   memcpy (p->CellDepth[0], depth, sizeof (p->CellDepth));
+  p->FixAll = TRUE;
   return s;
 }
 
@@ -665,6 +1173,7 @@ deltas_set_shoreface_slope (Deltas_state * s, double shoreface_slope)
   State *p = (State *) s;
 
   p->shoreface_slope = shoreface_slope;
+  check_halo_width (p);
   return s;
 }
 
@@ -683,6 +1192,8 @@ deltas_set_shoreface_depth (Deltas_state * s, double shoreface_depth)
   State *p = (State *) s;
 
   p->shoreface_depth = shoreface_depth;
+  p->FixAll = TRUE;
+  check_halo_width (p);
   return s;
 }
 
@@ -692,6 +1203,7 @@ deltas_set_cell_width (Deltas_state * s, double cell_width)
   State *p = (State *) s;
 
   p->cell_width = cell_width;
+  check_halo_width (p);
   return s;
 }
 
@@ -799,7 +1311,7 @@ BMI_CEM_Get_var_stride (Deltas_state *s, const char *name, int *stride)
     if (strcmp (name, "surface_bed_load_sediment__mass_flow_rate") == 0 ||
         strcmp (name, "sea_water_to_sediment__depth_ratio") == 0 ||
         strcmp (name, "sea_water__depth") == 0) {
-      stride[0] = p->ny * 2;
+      stride[0] = p->ny_grid;
       stride[1] = 1;
     fprintf (stderr, "stride is %d, %d\n", stride[0], stride[1]);
 
@@ -920,8 +1432,8 @@ BMI_CEM_Get_double (Deltas_state *s, const char *value, double *dest)
         int i, j;
         const int n_rows = p->nx;
         const int n_cols = p->ny;
-        const int stride = p->ny * 2;
-        double * src_row = src + p->ny / 2;
+        const int stride = p->ny_grid;
+        double * src_row = src + p->ny_lo;
         double * dest_row = dest;
 
         if (strcmp (value, "surface__elevation") == 0) {
@@ -973,7 +1485,7 @@ BMI_CEM_Get_double_ptr (Deltas_state *s, const char *value, double **dest)
 
     if (src) { /* Get a pointer to the start of the data */
       State *p = (State *) s;
-      *dest = src + p->ny / 2;
+      *dest = src + p->ny_lo;
       rtn = BMI_SUCCESS;
 
       fprintf (stderr, "dest = %d\n", *dest);
@@ -1003,7 +1515,8 @@ BMI_CEM_Set_double (Deltas_state *s, const char * value, double *src)
 
   if (src) {
     if (strcmp (value, "surface_bed_load_sediment__mass_flow_rate") == 0) {
-      deltas_set_sediment_flux_grid (s, src);
+      if (!deltas_set_sediment_flux_grid (s, src))
+        return BMI_FAILURE;
     }
     else if (strcmp (value, "channel_outflow_end_bed_load_sediment__mass_flow_rate") == 0 ||
         strcmp (value, "channel_outflow_end_suspended_load__mass_flow_rate") == 0) {
@@ -1032,6 +1545,7 @@ double *
 deltas_get_value_data_dup (Deltas_state * s, const char *value, int lower[2],
                        int upper[2], int stride[2])
 {
+  State *p = (State *) s;
   double *data = NULL;
 
 /*
@@ -1044,10 +1558,10 @@ deltas_get_value_data_dup (Deltas_state * s, const char *value, int lower[2],
 */
   lower[0] = 0;
   lower[1] = 0;
-  upper[0] = deltas_get_ny (s) / 2 - 1;
+  upper[0] = p->ny - 1;
   upper[1] = deltas_get_nx (s) - 1;
   stride[0] = 1;
-  stride[1] = deltas_get_ny (s) / 2;
+  stride[1] = p->ny;
 
   if (strcasecmp (value, "sea_water__depth") == 0)
     data = deltas_get_depth_dup (s);
@@ -1064,7 +1578,7 @@ deltas_get_value_data_dup (Deltas_state * s, const char *value, int lower[2],
 int *
 deltas_get_value_dimen_old (Deltas_state * s, const char *value, int shape[3])
 {
-  shape[0] = deltas_get_ny (s) / 2;
+  shape[0] = ((State *) s)->ny;
   //shape[0] = deltas_get_ny (s);
   shape[1] = deltas_get_nx (s);
   shape[2] = 1;
@@ -1125,8 +1639,9 @@ dup_subgrid (Deltas_state * s, double **src)
   double *dest = NULL;
 
   {
-    int lower[2] = { deltas_get_ny (s) / 4, 0 };
-    int upper[2] = { 3 * deltas_get_ny (s) / 4 - 1, deltas_get_nx (s) - 1 };
+    const State *p = (const State *) s;
+    int lower[2] = { p->ny_lo, 0 };
+    int upper[2] = { p->ny_lo + p->ny - 1, deltas_get_nx (s) - 1 };
     int stride[2] = { 1, deltas_get_ny (s) };
     const int len = (upper[0] - lower[0] + 1) * (upper[1] - lower[1] + 1);
 
@@ -1190,7 +1705,7 @@ deltas_get_elevation_dup (Deltas_state * s)
   double *val = NULL;
 
   {
-    const int len = deltas_get_nx (s) * deltas_get_ny (s) / 2;
+    const int len = deltas_get_nx (s) * p->ny;
 
     int i;
 
@@ -1546,7 +2061,7 @@ deltas_get_ny (Deltas_state * s)
 {
   State *p = (State *) s;
 
-  return p->ny * 2;
+  return p->ny_grid;
   //return 2*Ymax;
 }
 
@@ -1556,7 +2071,7 @@ deltas_get_stride_old (Deltas_state * s, int dimen)
   if (dimen == 0)
     return 1;
   else if (dimen == 1)
-    return deltas_get_ny (s) / 2;
+    return ((State *) s)->ny;
   else
     return 0;
 }
@@ -1620,3 +2135,208 @@ deltas_use_sed_flux (Deltas_state * s)
   //fprintf (stderr, "*** Ignoring request for sediment flux\n");
   //p->use_sed_flux = FALSE;
 }
+
+Deltas_state *
+deltas_set_n_threads (Deltas_state * s, int n_threads)
+{
+  State *p = (State *) s;
+
+  if (n_threads < 1)
+    n_threads = 1;
+
+  if (n_threads != p->n_threads)
+  {
+    cem_pool_free (p->pool);
+    p->pool = NULL;
+    if (n_threads > 1)
+    {
+      p->pool = cem_pool_new (n_threads);
+      if (!p->pool)
+      {
+        fprintf (stderr, "*** Unable to start %d threads; running serially\n",
+                 n_threads);
+        n_threads = 1;
+      }
+    }
+    p->n_threads = n_threads;
+  }
+
+  return s;
+}
+
+int
+deltas_get_n_threads (Deltas_state * s)
+{
+  State *p = (State *) s;
+
+  return p->n_threads;
+}
+
+/** Sets the seed of the random numbers, which takes effect when the model
+is initialized
+*/
+Deltas_state *
+deltas_set_seed (Deltas_state * s, uint64_t seed)
+{
+  State *p = (State *) s;
+
+  p->seed = seed;
+  cem_rng_seed (&p->rng, seed);
+  return s;
+}
+
+/** Copies out the state of the random number generator, so that a run
+can be carried on later with deltas_set_rng_state
+*/
+void
+deltas_get_rng_state (Deltas_state * s, uint64_t state[4])
+{
+  State *p = (State *) s;
+
+  memcpy (state, p->rng.s, sizeof (p->rng.s));
+}
+
+void
+deltas_set_rng_state (Deltas_state * s, const uint64_t state[4])
+{
+  State *p = (State *) s;
+
+  memcpy (p->rng.s, state, sizeof (p->rng.s));
+}
+
+/** Total PercentFull over the domain, kept up to date as cells change
+*/
+double
+deltas_get_mass (Deltas_state * s)
+{
+  State *p = (State *) s;
+
+  return p->MassCurrent + p->MassError;
+}
+
+/** Total PercentFull over the domain once it was initialized
+*/
+double
+deltas_get_initial_mass (Deltas_state * s)
+{
+  State *p = (State *) s;
+
+  return p->MassInitial;
+}
+
+void
+deltas_use_exact_refraction (Deltas_state * s)
+{
+  State *p = (State *) s;
+
+  p->exact_refraction = TRUE;
+}
+
+/** Steps every overwash check back across the barrier as far as it can
+go, rather than stopping where the land below it is too wide to wash
+over (see RayInBeach); the results are the same, only slower
+*/
+void
+deltas_use_exact_overwash (Deltas_state * s)
+{
+  State *p = (State *) s;
+
+  p->exact_overwash = TRUE;
+}
+
+/** Keep the shoreline as a polyline of the traced beach cells rather
+than a position for each column (see deltas_set_shoreline_file) */
+void
+deltas_use_shoreline_polyline (Deltas_state * s)
+{
+  State *p = (State *) s;
+
+  p->shoreline_polyline = TRUE;
+}
+
+/** Starts from a barrier island backed by a lagoon rather than from a
+beach backed by sandy land
+
+Has to be set before the model is initialized (deltas_init).
+*/
+void
+deltas_use_barrier (Deltas_state * s)
+{
+  State *p = (State *) s;
+
+  p->init_barrier = TRUE;
+}
+
+/** Keeps track of the age of cells
+
+Without this there is no Age layer.  Cells that fill before it is called
+are given an age of 0.
+*/
+void
+deltas_use_age (Deltas_state * s)
+{
+  State *p = (State *) s;
+
+  p->track_age = TRUE;
+  if (p->nx > 0 && !p->Age)
+    deltas_alloc_age (p);
+}
+
+/** The time step cell (x, y) was last empty, or -1 if age isn't tracked
+*/
+int
+deltas_get_age (Deltas_state * s, int x, int y)
+{
+  State *p = (State *) s;
+
+  if (!p->Age)
+    return -1;
+
+  return deltas_cell_age (p, x, y + p->ny_lo);
+}
+
+/** Times each phase of the time loop and counts events from here on
+
+When this is off, which it is to start with, the cost is a test of a flag
+in each phase.  See deltas_profile.h for what is kept.
+*/
+void
+deltas_use_profile (Deltas_state * s)
+{
+  State *p = (State *) s;
+
+  p->profiling = TRUE;
+}
+
+/** Time spent and events counted since profiling was turned on, or
+last reset
+*/
+const Deltas_profile *
+deltas_get_profile (Deltas_state * s)
+{
+  State *p = (State *) s;
+
+  return &p->Profile;
+}
+
+void
+deltas_reset_profile (Deltas_state * s)
+{
+  State *p = (State *) s;
+
+  memset (&p->Profile, 0, sizeof (Deltas_profile));
+}
+
+/** Prints the trace categories in mask (DELTAS_TRACE_ flags) to stderr
+
+Only categories built as TRACE_RUNTIME can be turned on this way.
+*/
+Deltas_state *
+deltas_set_trace (Deltas_state * s, int mask)
+{
+  State *p = (State *) s;
+
+  p->trace = mask;
+
+  return s;
+}
@@ -1,6 +1,10 @@
 #if !defined( DELTAS_API_H )
 #define DELTAS_API_H
 
+#include <stdint.h>
+
+#include "deltas_profile.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -106,12 +110,26 @@ Deltas_state *deltas_set_save_file (Deltas_state *, const char *);
 
 Deltas_state *deltas_set_read_file (Deltas_state *, char *);
 
+Deltas_state *deltas_set_archive_file (Deltas_state *, const char *);
+
+Deltas_state *deltas_set_shoreline_file (Deltas_state *, const char *);
+
+Deltas_state *deltas_set_halo_width (Deltas_state * s, int width);
+
 Deltas_state *deltas_init_grid_shape (Deltas_state * s, int dimen[2]);
 
 Deltas_state *deltas_init_cell_width (Deltas_state * s, double dx);
 
 Deltas_state *deltas_init_grid (Deltas_state * s, double *z);
 
+Deltas_state *deltas_destroy_grid (Deltas_state * s);
+
+Deltas_state *deltas_clone (Deltas_state * s);
+
+int deltas_save_checkpoint (Deltas_state * s, const char *path);
+
+Deltas_state *deltas_load_checkpoint (const char *path);
+
 Deltas_state *deltas_set_grid (Deltas_state *, double *, int[2]);
 
 Deltas_state *deltas_set_depth (Deltas_state *, double *);
@@ -151,6 +169,28 @@ Deltas_state *deltas_set_shelf_slope (Deltas_state * s, double shelf_slope);
 Deltas_state *deltas_set_shoreface_depth (Deltas_state * s,
                                           double shoreface_depth);
 
+Deltas_state *deltas_set_n_threads (Deltas_state * s, int n_threads);
+
+int deltas_get_n_threads (Deltas_state * s);
+
+Deltas_state *deltas_set_seed (Deltas_state * s, uint64_t seed);
+
+void deltas_get_rng_state (Deltas_state * s, uint64_t state[4]);
+
+void deltas_set_rng_state (Deltas_state * s, const uint64_t state[4]);
+
+/** Called for each member of an ensemble (see deltas_run_ensemble) */
+typedef void (*Deltas_member_func) (Deltas_state * member, int member_id,
+                                    void *data);
+
+int deltas_run_ensemble (Deltas_state * base, int n_members,
+                         double time_in_days, int n_threads,
+                         Deltas_member_func setup, Deltas_member_func done,
+                         void *data);
+
+double deltas_get_mass (Deltas_state * s);
+double deltas_get_initial_mass (Deltas_state * s);
+
 const char **deltas_get_exchange_items (void);
 
 const double *deltas_get_value_grid (Deltas_state * s, const char *value);
@@ -213,6 +253,26 @@ void deltas_use_external_waves (Deltas_state * s);
 
 void deltas_use_sed_flux (Deltas_state * s);
 
+void deltas_use_exact_refraction (Deltas_state * s);
+
+void deltas_use_exact_overwash (Deltas_state * s);
+
+void deltas_use_shoreline_polyline (Deltas_state * s);
+
+void deltas_use_barrier (Deltas_state * s);
+
+void deltas_use_age (Deltas_state * s);
+
+int deltas_get_age (Deltas_state * s, int x, int y);
+
+void deltas_use_profile (Deltas_state * s);
+
+const Deltas_profile *deltas_get_profile (Deltas_state * s);
+
+void deltas_reset_profile (Deltas_state * s);
+
+Deltas_state *deltas_set_trace (Deltas_state * s, int mask);
+
 #ifdef __cplusplus
 }
 #endif
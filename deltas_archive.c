@@ -0,0 +1,661 @@
+/** \file
+
+\brief An appendable, compressed archive of grid saves.
+
+The file is a header, the frames one after another, then an index of
+where each frame starts and a footer that says where the index starts.
+Each append writes its frame over the old index and then writes the index
+out again, so the file is complete after every save.  If a run dies part
+way through a save, the index is lost but the frames before it can still
+be found by walking the frame headers, and opening the archive does that.
+
+A frame is stored as its 64-bit words XORed with those of the frame before
+(unchanged cells become zero), run-length encoded.  PercentFull is mostly
+exactly 0 or 1 and only a band near the shore changes between saves, so
+almost all of a frame collapses into a few runs.  Key frames are encoded
+against zero.  Numbers are in the byte order of the machine that wrote
+them.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <unistd.h>
+#if defined (HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
+#include "deltas_api.h"
+#include "deltas_archive.h"
+
+#define ARCHIVE_MAGIC "CEMARCH"
+#define ARCHIVE_INDEX_MAGIC "CEMINDX"
+#define ARCHIVE_VERSION (1)
+#define ARCHIVE_BYTE_ORDER (0x01020304)
+#define ARCHIVE_FRAME_MAGIC (0x454d5246)
+
+#define FRAME_KEY (1)  /**< Encoded against zero, not the frame before */
+#define FRAME_ZLIB (2)  /**< Encoded bytes are zlib compressed */
+
+#define RUN_BIT (0x80000000u)  /**< Token is a run, not literals */
+#define RUN_MAX (0x7fffffffu)
+
+typedef struct
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;  /**< ARCHIVE_BYTE_ORDER as written */
+  uint32_t header_bytes;
+  int32_t nx;
+  int32_t ny;
+  int32_t n_layers;
+}
+Archive_header;
+
+typedef struct
+{
+  uint32_t magic;
+  int32_t time_step;
+  uint32_t flags;
+  uint32_t pad;
+  uint64_t encoded_bytes;  /**< Run-length encoded size */
+  uint64_t stored_bytes;  /**< Size on disk, after compression */
+}
+Archive_frame;
+
+typedef struct
+{
+  uint64_t offset;
+  int32_t time_step;
+  uint32_t flags;
+}
+Archive_entry;
+
+typedef struct
+{
+  uint64_t index_offset;
+  uint64_t n_frames;
+  char magic[8];
+}
+Archive_footer;
+
+struct _cem_archive
+{
+  FILE *fp;
+  int writable;
+
+  int nx;
+  int ny;
+  int n_layers;
+  size_t n_words;  /**< Words in a frame */
+
+  Archive_entry *index;
+  int n_frames;
+  int n_alloc;
+  uint64_t end;  /**< Where the next frame goes, and the index starts */
+  int last_key;  /**< Most recent key frame written, -1 if none yet */
+
+  uint64_t *last;  /**< Frame last appended, or last read */
+  int last_frame;  /**< Which frame is in last, -1 if none */
+  uint64_t *words;  /**< Scratch for a frame's differences */
+  unsigned char *encoded;
+  unsigned char *stored;
+  size_t stored_alloc;
+};
+
+/* Run-length encoding of n words into out, which must have room for
+   n words and n + 1 tokens.  Returns the encoded size in bytes. */
+static size_t
+encode_runs (const uint64_t * w, size_t n, unsigned char *out)
+{
+  unsigned char *p = out;
+  size_t i = 0;
+
+  while (i < n)
+  {
+    uint32_t token;
+    size_t j = i + 1;
+
+    while (j < n && w[j] == w[i] && j - i < RUN_MAX)
+      j++;
+
+    if (j - i > 1)
+    {
+      token = RUN_BIT | (uint32_t) (j - i);
+      memcpy (p, &token, sizeof (token));
+      memcpy (p + sizeof (token), w + i, sizeof (uint64_t));
+      p += sizeof (token) + sizeof (uint64_t);
+    }
+    else
+    {
+      while (j < n && w[j] != w[j - 1] && j - i < RUN_MAX)
+        j++;
+      if (j < n && w[j] == w[j - 1])
+        j--;
+
+      token = (uint32_t) (j - i);
+      memcpy (p, &token, sizeof (token));
+      memcpy (p + sizeof (token), w + i, sizeof (uint64_t) * (j - i));
+      p += sizeof (token) + sizeof (uint64_t) * (j - i);
+    }
+    i = j;
+  }
+
+  return p - out;
+}
+
+/* Undoes encode_runs.  Returns FALSE unless in decodes to exactly n
+   words. */
+static int
+decode_runs (const unsigned char *in, size_t len, uint64_t * w, size_t n)
+{
+  const unsigned char *end = in + len;
+  size_t i = 0;
+
+  while (in + sizeof (uint32_t) <= end)
+  {
+    uint32_t token;
+    size_t count;
+
+    memcpy (&token, in, sizeof (token));
+    in += sizeof (token);
+    count = token & RUN_MAX;
+    if (count > n - i)
+      return FALSE;
+
+    if (token & RUN_BIT)
+    {
+      uint64_t value;
+      size_t k;
+
+      if (in + sizeof (value) > end)
+        return FALSE;
+      memcpy (&value, in, sizeof (value));
+      in += sizeof (value);
+      for (k = 0; k < count; k++)
+        w[i + k] = value;
+    }
+    else
+    {
+      if (in + sizeof (uint64_t) * count > end)
+        return FALSE;
+      memcpy (w + i, in, sizeof (uint64_t) * count);
+      in += sizeof (uint64_t) * count;
+    }
+    i += count;
+  }
+
+  return in == end && i == n;
+}
+
+/* Writes the index and footer after the last frame.  Anything left past
+   them from a save that didn't finish is cut off. */
+static int
+write_index (cem_archive * a)
+{
+  Archive_footer f;
+  const off_t size = a->end + sizeof (Archive_entry) * a->n_frames
+    + sizeof (f);
+
+  memset (&f, 0, sizeof (f));
+  f.index_offset = a->end;
+  f.n_frames = a->n_frames;
+  memcpy (f.magic, ARCHIVE_INDEX_MAGIC, sizeof (ARCHIVE_INDEX_MAGIC));
+
+  return fseeko (a->fp, a->end, SEEK_SET) == 0
+    && fwrite (a->index, sizeof (Archive_entry), a->n_frames, a->fp)
+    == (size_t) a->n_frames
+    && fwrite (&f, sizeof (f), 1, a->fp) == 1 && fflush (a->fp) == 0
+    && ftruncate (fileno (a->fp), size) == 0;
+}
+
+/* Returns FALSE, leaving the index as it was, if it can't grow */
+static int
+add_entry (cem_archive * a, uint64_t offset, int time_step, uint32_t flags)
+{
+  if (a->n_frames == a->n_alloc)
+  {
+    const int n_alloc = a->n_alloc > 0 ? 2 * a->n_alloc : 64;
+    Archive_entry *index = (Archive_entry *) realloc (a->index,
+                                                      sizeof (Archive_entry)
+                                                      * n_alloc);
+
+    if (!index)
+      return FALSE;
+    a->index = index;
+    a->n_alloc = n_alloc;
+  }
+  a->index[a->n_frames].offset = offset;
+  a->index[a->n_frames].time_step = time_step;
+  a->index[a->n_frames].flags = flags;
+  a->n_frames++;
+
+  return TRUE;
+}
+
+/* Reads the index through the footer or, if there isn't a good one,
+   by walking the frames.  Sets a->end to just past the last frame.
+   Returns FALSE if there isn't memory for the index. */
+static int
+load_index (cem_archive * a, const char *path)
+{
+  Archive_footer f;
+  off_t size;
+  uint64_t offset;
+
+  fseeko (a->fp, 0, SEEK_END);
+  size = ftello (a->fp);
+
+  if (size >= (off_t) (sizeof (Archive_header) + sizeof (f))
+      && fseeko (a->fp, size - sizeof (f), SEEK_SET) == 0
+      && fread (&f, sizeof (f), 1, a->fp) == 1
+      && memcmp (f.magic, ARCHIVE_INDEX_MAGIC,
+                 sizeof (ARCHIVE_INDEX_MAGIC)) == 0
+      && f.index_offset + sizeof (Archive_entry) * f.n_frames + sizeof (f)
+      == (uint64_t) size)
+  {
+    a->n_alloc = f.n_frames > 0 ? f.n_frames : 64;
+    a->index = (Archive_entry *) malloc (sizeof (Archive_entry) *
+                                         a->n_alloc);
+    if (!a->index)
+    {
+      a->n_alloc = 0;
+      return FALSE;
+    }
+    if (fseeko (a->fp, f.index_offset, SEEK_SET) == 0
+        && fread (a->index, sizeof (Archive_entry), f.n_frames, a->fp)
+        == f.n_frames)
+    {
+      a->n_frames = f.n_frames;
+      a->end = f.index_offset;
+      return TRUE;
+    }
+  }
+
+  offset = sizeof (Archive_header);
+  for (;;)
+  {
+    Archive_frame h;
+
+    if (fseeko (a->fp, offset, SEEK_SET) != 0
+        || fread (&h, sizeof (h), 1, a->fp) != 1
+        || h.magic != ARCHIVE_FRAME_MAGIC
+        || offset + sizeof (h) + h.stored_bytes > (uint64_t) size)
+      break;
+    if (!add_entry (a, offset, h.time_step, h.flags))
+      return FALSE;
+    offset += sizeof (h) + h.stored_bytes;
+  }
+  a->end = offset;
+
+  fprintf (stderr, "*** %s has no index; found %d frames\n", path,
+           a->n_frames);
+
+  return TRUE;
+}
+
+static void
+free_archive (cem_archive * a)
+{
+  free (a->index);
+  free (a->last);
+  free (a->words);
+  free (a->encoded);
+  free (a->stored);
+  free (a);
+}
+
+/* Returns NULL if there isn't memory for the frame buffers; fp is left
+   open for the caller to close. */
+static cem_archive *
+new_archive (FILE * fp, int nx, int ny, int n_layers)
+{
+  cem_archive *a = (cem_archive *) calloc (1, sizeof (cem_archive));
+
+  if (!a)
+    return NULL;
+
+  a->fp = fp;
+  a->nx = nx;
+  a->ny = ny;
+  a->n_layers = n_layers;
+  a->n_words = (size_t) nx * ny * n_layers;
+  a->last_key = -1;
+  a->last_frame = -1;
+  a->end = sizeof (Archive_header);
+
+  a->last = (uint64_t *) malloc (sizeof (uint64_t) * a->n_words);
+  a->words = (uint64_t *) malloc (sizeof (uint64_t) * a->n_words);
+  a->encoded = (unsigned char *)malloc (sizeof (uint64_t) * a->n_words
+                                        + sizeof (uint32_t) *
+                                        (a->n_words + 1));
+  if (!a->last || !a->words || !a->encoded)
+  {
+    free_archive (a);
+    return NULL;
+  }
+
+  return a;
+}
+
+static int
+read_header (FILE * fp, Archive_header * h)
+{
+  return fread (h, sizeof (*h), 1, fp) == 1
+    && memcmp (h->magic, ARCHIVE_MAGIC, sizeof (ARCHIVE_MAGIC)) == 0
+    && h->byte_order == ARCHIVE_BYTE_ORDER
+    && h->version == ARCHIVE_VERSION
+    && h->header_bytes == sizeof (Archive_header)
+    && h->nx > 0 && h->ny > 0 && h->n_layers > 0;
+}
+
+/** Opens the archive at path to add frames of n_layers nx by ny layers
+
+If there is no file at path, a new archive is started.  If there is, new
+frames go after the ones already there; it must hold frames of the same
+shape.
+
+Returns NULL if path can't be opened or holds something else.
+*/
+cem_archive *
+cem_archive_open (const char *path, int nx, int ny, int n_layers)
+{
+  cem_archive *a;
+  Archive_header h;
+  FILE *fp = fopen (path, "r+b");
+
+  if (fp)
+  {
+    if (!read_header (fp, &h)
+        || h.nx != nx || h.ny != ny || h.n_layers != n_layers)
+    {
+      fprintf (stderr, "*** %s is not an archive of %d x %d x %d frames\n",
+               path, n_layers, nx, ny);
+      fclose (fp);
+      return NULL;
+    }
+    a = new_archive (fp, nx, ny, n_layers);
+    if (!a || !load_index (a, path))
+    {
+      fprintf (stderr, "*** Unable to allocate archive %s\n", path);
+      if (a)
+        free_archive (a);
+      fclose (fp);
+      return NULL;
+    }
+  }
+  else
+  {
+    fp = fopen (path, "w+b");
+    if (!fp)
+    {
+      fprintf (stderr, "*** Unable to open archive %s\n", path);
+      return NULL;
+    }
+
+    memset (&h, 0, sizeof (h));
+    memcpy (h.magic, ARCHIVE_MAGIC, sizeof (ARCHIVE_MAGIC));
+    h.version = ARCHIVE_VERSION;
+    h.byte_order = ARCHIVE_BYTE_ORDER;
+    h.header_bytes = sizeof (Archive_header);
+    h.nx = nx;
+    h.ny = ny;
+    h.n_layers = n_layers;
+
+    a = new_archive (fp, nx, ny, n_layers);
+    if (!a)
+    {
+      fprintf (stderr, "*** Unable to allocate archive %s\n", path);
+      fclose (fp);
+      return NULL;
+    }
+    if (fwrite (&h, sizeof (h), 1, fp) != 1 || !write_index (a))
+    {
+      fprintf (stderr, "*** Unable to write archive %s\n", path);
+      cem_archive_close (a);
+      return NULL;
+    }
+  }
+  a->writable = TRUE;
+
+  return a;
+}
+
+/** Opens the archive at path to read frames from
+
+Returns NULL if path isn't an archive.
+*/
+cem_archive *
+cem_archive_open_read (const char *path)
+{
+  cem_archive *a;
+  Archive_header h;
+  FILE *fp = fopen (path, "rb");
+
+  if (!fp)
+  {
+    fprintf (stderr, "*** Unable to open archive %s\n", path);
+    return NULL;
+  }
+  if (!read_header (fp, &h))
+  {
+    fprintf (stderr, "*** %s is not an archive of version %d\n", path,
+             ARCHIVE_VERSION);
+    fclose (fp);
+    return NULL;
+  }
+
+  a = new_archive (fp, h.nx, h.ny, h.n_layers);
+  if (!a || !load_index (a, path))
+  {
+    fprintf (stderr, "*** Unable to allocate archive %s\n", path);
+    if (a)
+      free_archive (a);
+    fclose (fp);
+    return NULL;
+  }
+
+  return a;
+}
+
+/** Adds frame, the grids saved at time_step, to the end of a
+
+Returns TRUE if the frame, and the index after it, were written.
+*/
+int
+cem_archive_append (cem_archive * a, int time_step, const double *frame)
+{
+  Archive_frame h;
+  const unsigned char *data;
+  const int key = a->last_frame < 0
+    || a->n_frames - a->last_key >= ARCHIVE_KEY_SPACING;
+  size_t i;
+
+  if (!a->writable)
+    return FALSE;
+
+  for (i = 0; i < a->n_words; i++)
+  {
+    uint64_t w;
+
+    memcpy (&w, frame + i, sizeof (w));
+    a->words[i] = key ? w : w ^ a->last[i];
+    a->last[i] = w;
+  }
+
+  memset (&h, 0, sizeof (h));
+  h.magic = ARCHIVE_FRAME_MAGIC;
+  h.time_step = time_step;
+  h.flags = key ? FRAME_KEY : 0;
+  h.encoded_bytes = encode_runs (a->words, a->n_words, a->encoded);
+  h.stored_bytes = h.encoded_bytes;
+  data = a->encoded;
+
+#if defined (HAVE_ZLIB)
+  {
+    uLongf len = compressBound (h.encoded_bytes);
+
+    if (a->stored_alloc < len)
+    {
+      free (a->stored);
+      a->stored = (unsigned char *)malloc (len);
+      a->stored_alloc = a->stored ? len : 0;
+    }
+    if (a->stored
+        && compress2 (a->stored, &len, a->encoded, h.encoded_bytes,
+                   Z_DEFAULT_COMPRESSION) == Z_OK
+        && len < h.encoded_bytes)
+    {
+      h.flags |= FRAME_ZLIB;
+      h.stored_bytes = len;
+      data = a->stored;
+    }
+  }
+#endif
+
+  if (fseeko (a->fp, a->end, SEEK_SET) != 0
+      || fwrite (&h, sizeof (h), 1, a->fp) != 1
+      || fwrite (data, 1, h.stored_bytes, a->fp) != h.stored_bytes
+      || !add_entry (a, a->end, time_step, h.flags))
+  {
+    /* Whatever follows starts over from a key frame */
+    a->last_frame = -1;
+    return FALSE;
+  }
+
+  a->end += sizeof (h) + h.stored_bytes;
+  a->last_frame = a->n_frames - 1;
+  if (key)
+    a->last_key = a->last_frame;
+
+  return write_index (a);
+}
+
+int
+cem_archive_n_frames (const cem_archive * a)
+{
+  return a->n_frames;
+}
+
+/** The time step frame i was saved at */
+int
+cem_archive_time_step (const cem_archive * a, int i)
+{
+  return a->index[i].time_step;
+}
+
+void
+cem_archive_shape (const cem_archive * a, int *nx, int *ny, int *n_layers)
+{
+  *nx = a->nx;
+  *ny = a->ny;
+  *n_layers = a->n_layers;
+}
+
+/* Decodes frame i into a->words */
+static int
+read_frame (cem_archive * a, int i)
+{
+  Archive_frame h;
+  const unsigned char *data;
+
+  if (fseeko (a->fp, a->index[i].offset, SEEK_SET) != 0
+      || fread (&h, sizeof (h), 1, a->fp) != 1
+      || h.magic != ARCHIVE_FRAME_MAGIC
+      || h.encoded_bytes > sizeof (uint64_t) * a->n_words
+      + sizeof (uint32_t) * (a->n_words + 1))
+    return FALSE;
+
+  if (a->stored_alloc < h.stored_bytes)
+  {
+    free (a->stored);
+    a->stored = (unsigned char *)malloc (h.stored_bytes);
+    a->stored_alloc = a->stored ? h.stored_bytes : 0;
+  }
+  if (!a->stored
+      || fread (a->stored, 1, h.stored_bytes, a->fp) != h.stored_bytes)
+    return FALSE;
+  data = a->stored;
+
+  if (h.flags & FRAME_ZLIB)
+  {
+#if defined (HAVE_ZLIB)
+    uLongf len = h.encoded_bytes;
+
+    if (uncompress (a->encoded, &len, a->stored, h.stored_bytes) != Z_OK
+        || len != h.encoded_bytes)
+      return FALSE;
+    data = a->encoded;
+#else
+    fprintf (stderr, "*** Frame %d is compressed, but zlib isn't built in\n",
+             i);
+    return FALSE;
+#endif
+  }
+
+  return decode_runs (data, h.encoded_bytes, a->words, a->n_words);
+}
+
+/** Reads frame i of a into frame, which has room for a frame
+
+Frames are rebuilt from the key frame before them, or from the frame
+last read if that is nearer, so reading frames in order is cheap.
+
+Returns TRUE on success.
+*/
+int
+cem_archive_read (cem_archive * a, int i, double *frame)
+{
+  int start;
+  int j;
+
+  if (a->writable || i < 0 || i >= a->n_frames)
+    return FALSE;
+
+  for (start = i; start > 0 && !(a->index[start].flags & FRAME_KEY);
+       start--);
+  if (a->last_frame >= start && a->last_frame <= i)
+    start = a->last_frame + 1;
+
+  for (j = start; j <= i; j++)
+  {
+    size_t k;
+
+    if (!read_frame (a, j))
+    {
+      fprintf (stderr, "*** Unable to read frame %d of the archive\n", j);
+      a->last_frame = -1;
+      return FALSE;
+    }
+    if (a->index[j].flags & FRAME_KEY)
+      memcpy (a->last, a->words, sizeof (uint64_t) * a->n_words);
+    else
+      for (k = 0; k < a->n_words; k++)
+        a->last[k] ^= a->words[k];
+    a->last_frame = j;
+  }
+
+  memcpy (frame, a->last, sizeof (double) * a->n_words);
+
+  return TRUE;
+}
+
+/** Closes a and frees it
+
+Returns FALSE if the file couldn't be closed cleanly.
+*/
+int
+cem_archive_close (cem_archive * a)
+{
+  int ok;
+
+  if (!a)
+    return TRUE;
+
+  ok = (fclose (a->fp) == 0);
+  free_archive (a);
+
+  return ok;
+}
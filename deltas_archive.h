@@ -0,0 +1,35 @@
+#if !defined( DELTAS_ARCHIVE_H )
+#define DELTAS_ARCHIVE_H
+
+/** A single file that holds a run's grid saves, one frame per save.
+
+A frame is n_layers layers of nx by ny doubles, layer after layer, each
+stored row by row (x outer, y inner).  Frames are kept as the difference
+from the frame before, run-length encoded and, where zlib is available,
+compressed.  Every ARCHIVE_KEY_SPACING'th frame stands on its own so any
+frame can be read back without decoding the whole run.
+*/
+typedef struct _cem_archive cem_archive;
+
+#define ARCHIVE_KEY_SPACING (32)
+
+cem_archive *cem_archive_open (const char *path, int nx, int ny,
+                               int n_layers);
+
+cem_archive *cem_archive_open_read (const char *path);
+
+int cem_archive_append (cem_archive * a, int time_step,
+                        const double *frame);
+
+int cem_archive_n_frames (const cem_archive * a);
+
+int cem_archive_time_step (const cem_archive * a, int i);
+
+void cem_archive_shape (const cem_archive * a, int *nx, int *ny,
+                        int *n_layers);
+
+int cem_archive_read (cem_archive * a, int i, double *frame);
+
+int cem_archive_close (cem_archive * a);
+
+#endif
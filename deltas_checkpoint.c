@@ -0,0 +1,506 @@
+/** \file
+
+\brief Binary checkpoints that restart a run exactly where it left off.
+
+A checkpoint is a header, the river table and then, starting on a page
+boundary, the grid block as it is in memory.  The Age layer, if there is
+one, follows the grid block.  Numbers are in the byte order of the
+machine that wrote them; a checkpoint from a machine of the other order
+is refused rather than read wrongly.
+*/
+
+#include <stdio.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "deltas.h"
+#include "deltas_api.h"
+
+#define CHECKPOINT_MAGIC "CEMCKPT"
+#define CHECKPOINT_VERSION (3)
+#define CHECKPOINT_BYTE_ORDER (0x01020304)
+#define CHECKPOINT_ALIGN (4096) /**< Grid block offset, so it can be mapped */
+
+typedef struct
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;  /**< CHECKPOINT_BYTE_ORDER as written */
+  uint32_t header_bytes;
+  uint32_t pad0;
+
+  int32_t nx;
+  int32_t ny;
+  int32_t ny_lo;  /**< Width of the wrap region before the domain */
+  int32_t ny_grid;  /**< Columns kept, with both wrap regions */
+  double cell_width;
+  int32_t current_time_step;
+  double wave_angle;
+  uint64_t seed;
+  uint64_t rng[CEM_RNG_STATE_LEN];
+
+  int32_t use_sed_flux;
+  int32_t exact_refraction;
+  int32_t external_waves;
+  int32_t track_age;
+  double sed_flux;
+  double sed_rate;
+  double angle_highness;
+  double angle_asymmetry;
+  double wave_height;
+  double wave_period;
+  double shoreface_slope;
+  double shelf_slope;
+  double shoreface_depth;
+
+  int32_t shadow_x_max;  /**< Where ShadowSweep next looks for the beach */
+  int32_t find_start;
+  double mass_initial;
+  double mass_current;
+  double mass_error;
+
+  int32_t n_rivers;
+  int32_t pad2;
+
+  /* Offsets of the grid block in the file, and of the layers in it */
+  uint64_t grid_offset;
+  uint64_t grid_bytes;
+  uint64_t percent_full;
+  uint64_t cell_depth;
+  uint64_t init_depth;
+  uint64_t beach_bits;
+  uint64_t fix_bits;
+  uint64_t fix_queued;
+  uint64_t age_offset;  /**< 0 if there is no Age layer */
+}
+Checkpoint_header;
+
+/* A river as it is stored, after the header */
+typedef struct
+{
+  double flux;
+  double x;
+  double y;
+  int32_t x_ind;
+  int32_t y_ind;
+}
+Checkpoint_river;
+
+static int
+write_all (int fd, const void *buffer, size_t bytes)
+{
+  const char *p = (const char *)buffer;
+
+  while (bytes > 0)
+  {
+    const ssize_t n = write (fd, p, bytes);
+
+    if (n <= 0)
+      return FALSE;
+    p += n;
+    bytes -= n;
+  }
+  return TRUE;
+}
+
+static int
+read_all (int fd, void *buffer, size_t bytes)
+{
+  char *p = (char *)buffer;
+
+  while (bytes > 0)
+  {
+    const ssize_t n = read (fd, p, bytes);
+
+    if (n <= 0)
+      return FALSE;
+    p += n;
+    bytes -= n;
+  }
+  return TRUE;
+}
+
+static uint64_t
+layer_offset (const State * p, const void *layer)
+{
+  return (const char *)layer - p->GridBlock;
+}
+
+/** Saves s to a checkpoint at path
+
+The checkpoint is written to a temporary file next to path, synced and
+then renamed over path.  A crash part way through leaves the last good
+checkpoint as it was.
+
+Returns TRUE on success.
+*/
+int
+deltas_save_checkpoint (Deltas_state * s, const char *path)
+{
+  State *p = (State *) s;
+  Checkpoint_header h;
+  Checkpoint_river *rivers = NULL;
+  char *tmp_path;
+  int fd;
+  int ok;
+  int i;
+
+  if (!p || !p->GridBlock)
+    return FALSE;
+
+  memset (&h, 0, sizeof (h));
+  memcpy (h.magic, CHECKPOINT_MAGIC, sizeof (CHECKPOINT_MAGIC));
+  h.version = CHECKPOINT_VERSION;
+  h.byte_order = CHECKPOINT_BYTE_ORDER;
+  h.header_bytes = sizeof (Checkpoint_header);
+
+  h.nx = p->nx;
+  h.ny = p->ny;
+  h.ny_lo = p->ny_lo;
+  h.ny_grid = p->ny_grid;
+  h.cell_width = p->cell_width;
+  h.current_time_step = p->CurrentTimeStep;
+  h.wave_angle = p->WaveAngle;
+  h.seed = p->seed;
+  memcpy (h.rng, p->rng.s, sizeof (h.rng));
+
+  h.use_sed_flux = p->use_sed_flux;
+  h.exact_refraction = p->exact_refraction;
+  h.external_waves = p->external_waves;
+  h.track_age = p->track_age;
+  h.sed_flux = p->SedFlux;
+  h.sed_rate = p->SedRate;
+  h.angle_highness = p->angle_highness;
+  h.angle_asymmetry = p->angle_asymmetry;
+  h.wave_height = p->wave_height;
+  h.wave_period = p->wave_period;
+  h.shoreface_slope = p->shoreface_slope;
+  h.shelf_slope = p->shelf_slope;
+  h.shoreface_depth = p->shoreface_depth;
+
+  h.shadow_x_max = p->ShadowXMax;
+  h.find_start = p->FindStart;
+  h.mass_initial = p->MassInitial;
+  h.mass_current = p->MassCurrent;
+  h.mass_error = p->MassError;
+
+  h.n_rivers = p->n_rivers;
+
+  h.grid_offset = (sizeof (h) + sizeof (Checkpoint_river) * p->n_rivers +
+                   CHECKPOINT_ALIGN - 1) / CHECKPOINT_ALIGN * CHECKPOINT_ALIGN;
+  h.grid_bytes = p->GridBytes;
+  h.percent_full = layer_offset (p, p->PercentFull[0]);
+  h.cell_depth = layer_offset (p, p->CellDepth[0]);
+  h.init_depth = layer_offset (p, p->InitDepth[0]);
+  h.beach_bits = layer_offset (p, p->BeachBits);
+  h.fix_bits = layer_offset (p, p->FixBits);
+  h.fix_queued = layer_offset (p, p->FixQueued);
+  h.age_offset = p->Age ? h.grid_offset + h.grid_bytes : 0;
+
+  if (p->n_rivers > 0)
+  {
+    rivers = (Checkpoint_river *) calloc (p->n_rivers,
+                                          sizeof (Checkpoint_river));
+    if (!rivers)
+    {
+      fprintf (stderr, "*** Unable to save checkpoint file %s\n", path);
+      return FALSE;
+    }
+    for (i = 0; i < p->n_rivers; i++)
+    {
+      rivers[i].flux = p->river_flux[i];
+      rivers[i].x = p->river_x[i];
+      rivers[i].y = p->river_y[i];
+      rivers[i].x_ind = p->river_x_ind[i];
+      rivers[i].y_ind = p->river_y_ind[i];
+    }
+  }
+
+  tmp_path = (char *)malloc (strlen (path) + sizeof (".XXXXXX"));
+  if (!tmp_path)
+  {
+    fprintf (stderr, "*** Unable to save checkpoint file %s\n", path);
+    free (rivers);
+    return FALSE;
+  }
+  sprintf (tmp_path, "%s.XXXXXX", path);
+
+  fd = mkstemp (tmp_path);
+  if (fd < 0)
+  {
+    fprintf (stderr, "*** Unable to open checkpoint file %s\n", tmp_path);
+    free (tmp_path);
+    free (rivers);
+    return FALSE;
+  }
+
+  ok = write_all (fd, &h, sizeof (h))
+    && write_all (fd, rivers, sizeof (Checkpoint_river) * p->n_rivers)
+    && lseek (fd, h.grid_offset, SEEK_SET) == (off_t) h.grid_offset
+    && write_all (fd, p->GridBlock, p->GridBytes)
+    && (!p->Age
+        || write_all (fd, p->Age[0], sizeof (int) * p->nx * p->ny_grid))
+    && fsync (fd) == 0;
+  ok = (close (fd) == 0) && ok;
+  ok = ok && rename (tmp_path, path) == 0;
+
+  if (!ok)
+  {
+    fprintf (stderr, "*** Unable to write checkpoint file %s\n", path);
+    unlink (tmp_path);
+  }
+
+  free (tmp_path);
+  free (rivers);
+
+  return ok;
+}
+
+/* Points the nx rows of a grid layer at successive rows of layer, or
+   returns NULL if there's no memory for the row pointers */
+static void **
+point_rows (int nx, char *layer, size_t row_bytes)
+{
+  void **rows = (void **)malloc (sizeof (void *) * nx);
+  int i;
+
+  if (!rows)
+    return NULL;
+
+  for (i = 0; i < nx; i++)
+    rows[i] = layer + i * row_bytes;
+
+  return rows;
+}
+
+/* Does a layer of bytes, at offset in the grid block, lie within it (and
+   is it aligned to size)? */
+static int
+layer_fits (const Checkpoint_header * h, uint64_t offset, uint64_t bytes,
+            uint64_t size)
+{
+  return offset % size == 0 && offset <= h->grid_bytes
+    && bytes <= h->grid_bytes - offset;
+}
+
+/* Is everything h says is in the file, of file_bytes, really there?  A
+   grid block cut short would fault once mapped, so this is checked before
+   anything is read. */
+static int
+header_fits (const Checkpoint_header * h, uint64_t file_bytes)
+{
+  const uint64_t n = (uint64_t) h->nx * h->ny_grid;
+  const uint64_t bit_bytes = (n + 63) / 64 * sizeof (uint64_t);
+
+  if (h->nx <= 0 || h->ny <= 0 || h->ny_lo <= 0 || h->ny_lo > h->ny / 2
+      || h->ny_grid < h->ny + 2 * h->ny_lo || h->ny_grid > 2 * h->ny
+      || n > INT_MAX || h->n_rivers < 0
+      || h->grid_offset < sizeof (Checkpoint_header)
+      + sizeof (Checkpoint_river) * (uint64_t) h->n_rivers
+      || h->grid_offset > file_bytes
+      || h->grid_bytes > file_bytes - h->grid_offset)
+    return FALSE;
+
+  if (!layer_fits (h, h->percent_full, n * sizeof (double), sizeof (double))
+      || !layer_fits (h, h->cell_depth, n * sizeof (double), sizeof (double))
+      || !layer_fits (h, h->init_depth, n * sizeof (double), sizeof (double))
+      || !layer_fits (h, h->beach_bits, bit_bytes, sizeof (uint64_t))
+      || !layer_fits (h, h->fix_bits, bit_bytes, sizeof (uint64_t))
+      || !layer_fits (h, h->fix_queued, bit_bytes, sizeof (uint64_t))
+      || h->fix_queued < h->fix_bits + bit_bytes)
+    return FALSE;
+
+  if (h->track_age && h->age_offset > 0
+      && (h->age_offset > file_bytes
+          || n * sizeof (int) > file_bytes - h->age_offset))
+    return FALSE;
+
+  return TRUE;
+}
+
+/** A new model, restarted from the checkpoint at path
+
+The grid block is mapped privately from the file, so a restart costs
+next to nothing however big the grid - pages are read as they are first
+touched.  Where the file can't be mapped, the grid is read.  The run
+carries on exactly as the saved one would have.
+
+Returns NULL if path isn't a checkpoint this build can read.
+*/
+Deltas_state *
+deltas_load_checkpoint (const char *path)
+{
+  Checkpoint_header h;
+  struct stat st;
+  State *p;
+  char *block;
+  long page = sysconf (_SC_PAGESIZE);
+  int fd;
+  int i;
+
+  fd = open (path, O_RDONLY);
+  if (fd < 0)
+  {
+    fprintf (stderr, "*** Unable to open checkpoint file %s\n", path);
+    return NULL;
+  }
+
+  if (!read_all (fd, &h, sizeof (h))
+      || memcmp (h.magic, CHECKPOINT_MAGIC, sizeof (CHECKPOINT_MAGIC)) != 0
+      || h.byte_order != CHECKPOINT_BYTE_ORDER
+      || h.version != CHECKPOINT_VERSION
+      || h.header_bytes != sizeof (Checkpoint_header))
+  {
+    fprintf (stderr, "*** %s is not a checkpoint of version %d\n", path,
+             CHECKPOINT_VERSION);
+    close (fd);
+    return NULL;
+  }
+
+  if (fstat (fd, &st) != 0 || !header_fits (&h, st.st_size))
+  {
+    fprintf (stderr, "*** Checkpoint %s is damaged or cut short\n", path);
+    close (fd);
+    return NULL;
+  }
+
+  p = (State *) deltas_new ();
+
+  p->nx = h.nx;
+  p->ny = h.ny;
+  p->ny_lo = h.ny_lo;
+  p->ny_grid = h.ny_grid;
+  p->halo_width = (h.ny_grid < 2 * h.ny) ? h.ny_lo : 0;
+  p->max_beach_len = h.nx * h.ny_grid;
+  p->cell_width = h.cell_width;
+  p->CurrentTimeStep = h.current_time_step;
+  p->WaveAngle = h.wave_angle;
+  p->seed = h.seed;
+  memcpy (p->rng.s, h.rng, sizeof (h.rng));
+
+  p->use_sed_flux = h.use_sed_flux;
+  p->exact_refraction = h.exact_refraction;
+  p->external_waves = h.external_waves;
+  p->track_age = h.track_age;
+  p->SedFlux = h.sed_flux;
+  p->SedRate = h.sed_rate;
+  p->angle_highness = h.angle_highness;
+  p->angle_asymmetry = h.angle_asymmetry;
+  p->wave_height = h.wave_height;
+  p->wave_period = h.wave_period;
+  p->shoreface_slope = h.shoreface_slope;
+  p->shelf_slope = h.shelf_slope;
+  p->shoreface_depth = h.shoreface_depth;
+
+  p->ShadowXMax = h.shadow_x_max;
+  p->FindStart = h.find_start;
+  p->MassInitial = h.mass_initial;
+  p->MassCurrent = h.mass_current;
+  p->MassError = h.mass_error;
+
+  if (h.n_rivers > 0)
+  {
+    Checkpoint_river r;
+
+    if (!deltas_reserve_rivers (p, h.n_rivers))
+    {
+      close (fd);
+      p->nx = p->ny = p->ny_lo = p->ny_grid = 0;
+      deltas_destroy ((Deltas_state *) p);
+      return NULL;
+    }
+    for (i = 0; i < h.n_rivers; i++)
+    {
+      if (!read_all (fd, &r, sizeof (r)))
+        break;
+      p->river_flux[i] = r.flux;
+      p->river_x[i] = r.x;
+      p->river_y[i] = r.y;
+      p->river_x_ind[i] = r.x_ind;
+      p->river_y_ind[i] = r.y_ind;
+    }
+  }
+  p->n_rivers = h.n_rivers;
+
+  /* Map the grid block if the page size allows, otherwise read it */
+
+  block = NULL;
+  if (page > 0 && h.grid_offset % page == 0)
+  {
+    block = (char *)mmap (NULL, h.grid_bytes, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE, fd, h.grid_offset);
+    if (block == (char *)MAP_FAILED)
+      block = NULL;
+    p->GridMapped = (block != NULL);
+  }
+  if (!block)
+  {
+    if (posix_memalign ((void **)&block, GRID_ALIGN, h.grid_bytes) != 0
+        || lseek (fd, h.grid_offset, SEEK_SET) != (off_t) h.grid_offset
+        || !read_all (fd, block, h.grid_bytes))
+    {
+      fprintf (stderr, "*** Unable to read the grid from %s\n", path);
+      free (block);
+      close (fd);
+      p->nx = p->ny = p->ny_lo = p->ny_grid = 0;
+      deltas_destroy ((Deltas_state *) p);
+      return NULL;
+    }
+  }
+
+  p->GridBlock = block;
+  p->GridBytes = h.grid_bytes;
+  p->PercentFull = (double **)point_rows (p->nx, block + h.percent_full,
+                                          sizeof (double) * p->ny_grid);
+  p->CellDepth = (double **)point_rows (p->nx, block + h.cell_depth,
+                                        sizeof (double) * p->ny_grid);
+  p->InitDepth = (double **)point_rows (p->nx, block + h.init_depth,
+                                        sizeof (double) * p->ny_grid);
+  if (!p->PercentFull || !p->CellDepth || !p->InitDepth)
+  {
+    fprintf (stderr, "*** Unable to allocate the grid from %s\n", path);
+    close (fd);
+    deltas_destroy ((Deltas_state *) p);
+    return NULL;
+  }
+  p->BeachBits = (uint64_t *)(block + h.beach_bits);
+  p->FixBits = (uint64_t *)(block + h.fix_bits);
+  p->FixQueued = (uint64_t *)(block + h.fix_queued);
+
+  /* The FixBeach worklist wasn't saved - have it look at everything */
+  memset (p->FixBits, 0, h.fix_queued - h.fix_bits);
+  p->FixAll = TRUE;
+
+  p->BeachRowCount = (int *)calloc (p->nx, sizeof (int));
+  p->BarrierWidth = (int *)calloc (p->nx * p->ny_grid, sizeof (int));
+  if (!p->BeachRowCount || !p->BarrierWidth)
+  {
+    fprintf (stderr, "*** Unable to allocate the grid from %s\n", path);
+    close (fd);
+    deltas_destroy ((Deltas_state *) p);
+    return NULL;
+  }
+  deltas_count_beach (p);
+
+  if (p->track_age && deltas_alloc_age (p) && h.age_offset > 0)
+  {
+    if (lseek (fd, h.age_offset, SEEK_SET) != (off_t) h.age_offset
+        || !read_all (fd, p->Age[0], sizeof (int) * p->nx * p->ny_grid))
+      fprintf (stderr, "*** Unable to read cell ages from %s\n", path);
+  }
+
+  close (fd);
+
+  if (!deltas_reserve_shoreline (p, 2 * p->ny_grid))
+  {
+    deltas_destroy ((Deltas_state *) p);
+    return NULL;
+  }
+
+  return (Deltas_state *) p;
+}
@@ -0,0 +1,125 @@
+/** \file
+
+\brief Runs many realizations of one model on a pool of threads.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "deltas.h"
+#include "deltas_api.h"
+
+typedef struct
+{
+  const State *base;
+  int grid_fd;  /**< Image of the grid of base that members map */
+  double until;
+  Deltas_member_func setup;
+  Deltas_member_func done;
+  void *data;
+  int *failed;
+}
+Ensemble;
+
+/* Runs one member of the ensemble from start to finish */
+static void
+run_member (void *data, int member)
+{
+  Ensemble *e = (Ensemble *) data;
+  State *p = deltas_fork_state (e->base, e->grid_fd);
+
+  if (!p)
+  {
+    e->failed[member] = TRUE;
+    return;
+  }
+
+  /* Members run side by side, so each writes output files of its own */
+  p->member = member;
+
+  /* The pool already keeps every core busy */
+  deltas_set_n_threads ((Deltas_state *) p, 1);
+
+  if (e->setup)
+    e->setup ((Deltas_state *) p, member, e->data);
+
+  deltas_run_until ((Deltas_state *) p, e->until);
+  e->failed[member] = (p->CurrentTimeStep < (int)(e->until / TimeStep));
+
+  if (e->done)
+    e->done ((Deltas_state *) p, member, e->data);
+
+  deltas_destroy ((Deltas_state *) p);
+}
+
+/** Runs n_members realizations of base until time_in_days, n_threads at a
+time
+
+Each member starts as a copy of base, which must have been initialized
+(and may have been run for a while).  The members share base's grid
+copy-on-write, so a member only pays for the cells it changes.  setup is
+called for each member before it runs, to give it its own parameters
+(deltas_set_angle_highness, deltas_set_seed, ...), and done after it has
+run, to collect its results.  The member is destroyed once done returns.
+Both are called from the pool's threads, several at a time, and either
+may be NULL.
+
+Members write to base's output files (deltas_set_save_file,
+deltas_set_archive_file, deltas_set_shoreline_file) with ".member<n>"
+added to each name, so no two members share a file.  setup may set names
+of its own instead, which get the same ending.
+
+Returns the number of members that failed to run to the end.
+*/
+int
+deltas_run_ensemble (Deltas_state * base, int n_members, double time_in_days,
+                     int n_threads, Deltas_member_func setup,
+                     Deltas_member_func done, void *data)
+{
+  Ensemble e;
+  FILE *image = tmpfile ();
+  cem_pool *pool = NULL;
+  int n_failed = 0;
+  int i;
+
+  if (!image)
+    return n_members;
+
+  e.base = (const State *) base;
+  e.grid_fd = fileno (image);
+  e.until = time_in_days;
+  e.setup = setup;
+  e.done = done;
+  e.data = data;
+  e.failed = (int *)malloc (sizeof (int) * n_members);
+  if (!e.failed)
+  {
+    fclose (image);
+    return n_members;
+  }
+
+  if (!deltas_write_grid (e.base, e.grid_fd))
+  {
+    fclose (image);
+    free (e.failed);
+    return n_members;
+  }
+
+  if (n_threads > 1)
+    pool = cem_pool_new (n_threads);
+
+  if (pool)
+    cem_pool_run (pool, n_members, run_member, &e);
+  else
+    for (i = 0; i < n_members; i++)
+      run_member (&e, i);
+
+  for (i = 0; i < n_members; i++)
+    n_failed += e.failed[i];
+
+  cem_pool_free (pool);
+  fclose (image);
+  free (e.failed);
+
+  return n_failed;
+}
@@ -11,23 +11,31 @@ int
 main (int argc, char *argv[])
 {
   BMI_Model *self = NULL;
+  char *file = NULL;
+  int profile = 0;
+  int trace = 0;
   int err;
+  int arg;
 
-  if (argc > 1) {
-    if (strcmp (argv[1], "--version") == 0) {
+  for (arg = 1; arg < argc; arg++) {
+    if (strcmp (argv[arg], "--version") == 0) {
       fprintf (stdout, "The Coastal Evolution Model version 0.1\n");
       exit (0);
     }
-    else if (strcmp (argv[1], "--help") == 0) {
-      fprintf (stdout, "Usage: run_deltas [--help] [--version] [FILE]\n");
+    else if (strcmp (argv[arg], "--help") == 0) {
+      fprintf (stdout,
+               "Usage: run_deltas [--help] [--version] [--profile] [--trace] [FILE]\n");
       exit (0);
     }
+    else if (strcmp (argv[arg], "--profile") == 0)
+      profile = 1;
+    else if (strcmp (argv[arg], "--trace") == 0)
+      trace = DELTAS_TRACE_SETUP | DELTAS_TRACE_STEPS;
+    else
+      file = argv[arg];
   }
 
-  if (argc>1)
-    err = BMI_CEM_Initialize (argv[1], &self);
-  else
-    err = BMI_CEM_Initialize (NULL, &self);
+  err = BMI_CEM_Initialize (file, &self);
 
   if (err) {
     fprintf (stderr, "Error: %d: Unable to initialize\n", err);
@@ -57,6 +65,11 @@ main (int argc, char *argv[])
     z = (double *)malloc (sizeof (double) * len);
     fprintf (stderr, "len is %d\n", len);
 
+    if (profile)
+      deltas_use_profile (self);
+    if (trace)
+      deltas_set_trace (self, trace);
+
     BMI_CEM_Get_end_time (self, &stop_time);
     stop_time = 1000;
     for (i = 1; i <= stop_time; i++) {
@@ -81,6 +94,9 @@ main (int argc, char *argv[])
     free (z);
     free (shape);
 
+    if (profile)
+      deltas_print_profile (deltas_get_profile (self), stdout);
+
     {
       double time;
       int error;
@@ -160,7 +176,8 @@ main (int argc, char *argv[])
         //deltas_find_river_mouth (s, 0);
 
         deltas_avulsion (s, qs, river_flux);
-        deltas_set_sediment_flux_grid (s, qs);
+        if (!deltas_set_sediment_flux_grid (s, qs))
+          break;
 
         deltas_run_until (s, i);
       }
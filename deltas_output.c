@@ -0,0 +1,255 @@
+/** \file
+
+\brief A background thread that writes output files, so that the time loop
+doesn't wait on the disk.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "deltas_output.h"
+
+struct _cem_writer
+{
+  pthread_t thread;
+  int started;
+
+  pthread_mutex_t lock;
+  pthread_cond_t queued;  /**< Signaled when an output is submitted */
+  pthread_cond_t freed;  /**< Signaled when a buffer is free again */
+
+  cem_output *free_list;  /**< Buffers ready to be filled */
+  cem_output *head;  /**< Outputs waiting to be written, oldest first */
+  cem_output *tail;
+  int n_busy;  /**< Buffers handed out and not yet written */
+  int n_failed;  /**< Outputs that couldn't be written */
+  int quit;
+};
+
+static void
+write_output (cem_writer * w, cem_output * out)
+{
+  FILE *fp;
+
+  if (out->write)
+  {
+    if (out->write (out))
+      return;
+  }
+  else if ((fp = fopen (out->name, "w")) != NULL)
+  {
+    out->format (fp, out);
+    if (fclose (fp) == 0)
+      return;
+  }
+
+  fprintf (stderr, "*** Problem writing output file %s\n", out->name);
+  pthread_mutex_lock (&w->lock);
+  w->n_failed++;
+  pthread_mutex_unlock (&w->lock);
+}
+
+static void *
+writer_main (void *arg)
+{
+  cem_writer *w = (cem_writer *) arg;
+
+  pthread_mutex_lock (&w->lock);
+  for (;;)
+  {
+    cem_output *out;
+
+    while (!w->head && !w->quit)
+      pthread_cond_wait (&w->queued, &w->lock);
+    if (!w->head)
+      break;
+
+    out = w->head;
+    w->head = out->next;
+    if (!w->head)
+      w->tail = NULL;
+
+    pthread_mutex_unlock (&w->lock);
+    write_output (w, out);
+    pthread_mutex_lock (&w->lock);
+
+    out->next = w->free_list;
+    w->free_list = out;
+    w->n_busy--;
+    pthread_cond_broadcast (&w->freed);
+  }
+  pthread_mutex_unlock (&w->lock);
+
+  return NULL;
+}
+
+/** A new writer with n_buffers buffers, or NULL if there's no memory for
+it (or for any of its buffers)
+*/
+cem_writer *
+cem_writer_new (int n_buffers)
+{
+  cem_writer *w = (cem_writer *) malloc (sizeof (cem_writer));
+  int i;
+
+  if (!w)
+    return NULL;
+
+  w->free_list = NULL;
+  w->head = NULL;
+  w->tail = NULL;
+  w->n_busy = 0;
+  w->n_failed = 0;
+  w->quit = 0;
+
+  for (i = 0; i < n_buffers; i++)
+  {
+    cem_output *out = (cem_output *) calloc (1, sizeof (cem_output));
+
+    if (!out)
+      break;
+    out->next = w->free_list;
+    w->free_list = out;
+  }
+  if (!w->free_list)
+  {
+    free (w);
+    return NULL;
+  }
+
+  pthread_mutex_init (&w->lock, NULL);
+  pthread_cond_init (&w->queued, NULL);
+  pthread_cond_init (&w->freed, NULL);
+
+  w->started = (pthread_create (&w->thread, NULL, writer_main, w) == 0);
+
+  return w;
+}
+
+/** A free buffer with room for n_values doubles and n_ints ints
+
+Waits for the writer to finish with one if they are all in use.  Returns
+NULL if the buffer can't be made big enough.
+*/
+cem_output *
+cem_writer_get (cem_writer * w, size_t n_values, size_t n_ints)
+{
+  cem_output *out;
+
+  pthread_mutex_lock (&w->lock);
+  while (!w->free_list)
+    pthread_cond_wait (&w->freed, &w->lock);
+  out = w->free_list;
+  w->free_list = out->next;
+  w->n_busy++;
+  pthread_mutex_unlock (&w->lock);
+
+  if (out->n_values < n_values)
+  {
+    free (out->values);
+    out->values = (double *)malloc (sizeof (double) * n_values);
+    out->n_values = out->values ? n_values : 0;
+  }
+  if (out->n_ints < n_ints)
+  {
+    free (out->ints);
+    out->ints = (int *)malloc (sizeof (int) * n_ints);
+    out->n_ints = out->ints ? n_ints : 0;
+  }
+  if (out->n_values < n_values || out->n_ints < n_ints)
+  {
+    pthread_mutex_lock (&w->lock);
+    out->next = w->free_list;
+    w->free_list = out;
+    w->n_busy--;
+    pthread_cond_broadcast (&w->freed);
+    pthread_mutex_unlock (&w->lock);
+    return NULL;
+  }
+  out->format = NULL;
+  out->write = NULL;
+  out->data = NULL;
+  out->next = NULL;
+
+  return out;
+}
+
+/** Hands a filled buffer to the writer
+
+If the thread couldn't be started, the output is written there and then.
+*/
+void
+cem_writer_submit (cem_writer * w, cem_output * out)
+{
+  if (!w->started)
+  {
+    write_output (w, out);
+    pthread_mutex_lock (&w->lock);
+    out->next = w->free_list;
+    w->free_list = out;
+    w->n_busy--;
+    pthread_mutex_unlock (&w->lock);
+    return;
+  }
+
+  pthread_mutex_lock (&w->lock);
+  if (w->tail)
+    w->tail->next = out;
+  else
+    w->head = out;
+  w->tail = out;
+  pthread_cond_signal (&w->queued);
+  pthread_mutex_unlock (&w->lock);
+}
+
+/** Waits until everything submitted has been written
+
+Returns the number of outputs that have failed to be written so far.
+*/
+int
+cem_writer_flush (cem_writer * w)
+{
+  int n_failed;
+
+  pthread_mutex_lock (&w->lock);
+  while (w->n_busy > 0)
+    pthread_cond_wait (&w->freed, &w->lock);
+  n_failed = w->n_failed;
+  pthread_mutex_unlock (&w->lock);
+
+  return n_failed;
+}
+
+/** Writes whatever is still waiting and stops the writer */
+void
+cem_writer_free (cem_writer * w)
+{
+  if (!w)
+    return;
+
+  cem_writer_flush (w);
+
+  pthread_mutex_lock (&w->lock);
+  w->quit = 1;
+  pthread_cond_signal (&w->queued);
+  pthread_mutex_unlock (&w->lock);
+
+  if (w->started)
+    pthread_join (w->thread, NULL);
+
+  while (w->free_list)
+  {
+    cem_output *out = w->free_list;
+
+    w->free_list = out->next;
+    free (out->values);
+    free (out->ints);
+    free (out);
+  }
+
+  pthread_mutex_destroy (&w->lock);
+  pthread_cond_destroy (&w->queued);
+  pthread_cond_destroy (&w->freed);
+  free (w);
+}
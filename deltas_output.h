@@ -0,0 +1,56 @@
+#if !defined( DELTAS_OUTPUT_H )
+#define DELTAS_OUTPUT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define OUTPUT_NAME_MAX (1024)
+
+typedef struct _cem_output cem_output;
+
+/** Formats an output onto fp, from the writer's thread */
+typedef void (*cem_format_func) (FILE * fp, const cem_output * out);
+
+/** Writes an output somewhere other than a file of its own, from the
+writer's thread.  Returns TRUE on success. */
+typedef int (*cem_write_func) (const cem_output * out);
+
+/** A snapshot of something to write, and where to write it.
+
+Buffers are owned by the writer and reused, so the time loop only pays
+to copy its data into one.
+*/
+struct _cem_output
+{
+  char name[OUTPUT_NAME_MAX];  /**< File to write to */
+  cem_format_func format;
+  cem_write_func write;  /**< If set, used instead of name and format */
+  void *data;  /**< For write */
+  int time_step;  /**< When the output was taken */
+  int nx;  /**< Shape of the data, for format */
+  int ny;
+  double *values;
+  int *ints;
+  size_t n_values;  /**< Room in values */
+  size_t n_ints;  /**< Room in ints */
+  cem_output *next;
+};
+
+/** A thread that writes outputs in the background.
+
+At most n_buffers outputs are waiting or being written at once; asking for
+another blocks until one of them is done.
+*/
+typedef struct _cem_writer cem_writer;
+
+cem_writer *cem_writer_new (int n_buffers);
+
+cem_output *cem_writer_get (cem_writer * w, size_t n_values, size_t n_ints);
+
+void cem_writer_submit (cem_writer * w, cem_output * out);
+
+int cem_writer_flush (cem_writer * w);
+
+void cem_writer_free (cem_writer * w);
+
+#endif
@@ -0,0 +1,95 @@
+/** \file
+
+\brief Names and a report for the time loop's profile.
+*/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "deltas_profile.h"
+
+static const char *phase_names[DELTAS_N_PHASES] = {
+  "PeriodicBoundaryCopy",
+  "FindBeachCells",
+  "ShadowSweep",
+  "DetermineAngles",
+  "DetermineSedTransport",
+  "TransportSedimentSweep",
+  "FixBeach",
+  "CheckOverwashSweep",
+  "MassCount",
+  "DeliverSediment",
+  "Output"
+};
+
+static const char *event_names[DELTAS_N_EVENTS] = {
+  "OopsImFull",
+  "OopsImEmpty",
+  "Overwash",
+  "Refraction steps",
+  "Shadow ray steps"
+};
+
+const char *
+deltas_profile_phase_name (int phase)
+{
+  if (phase < 0 || phase >= DELTAS_N_PHASES)
+    return NULL;
+  return phase_names[phase];
+}
+
+const char *
+deltas_profile_event_name (int event)
+{
+  if (event < 0 || event >= DELTAS_N_EVENTS)
+    return NULL;
+  return event_names[event];
+}
+
+/** Prints a table of the phases, slowest first, then the event counts */
+void
+deltas_print_profile (const Deltas_profile * profile, FILE * fp)
+{
+  int order[DELTAS_N_PHASES];
+  double total = 0.;
+  int i,
+    j;
+
+  for (i = 0; i < DELTAS_N_PHASES; i++)
+  {
+    total += profile->seconds[i];
+
+    for (j = i; j > 0 && profile->seconds[order[j - 1]] < profile->seconds[i];
+         j--)
+      order[j] = order[j - 1];
+    order[j] = i;
+  }
+
+  fprintf (fp, "%-24s %12s %10s %6s %12s\n", "Phase", "Seconds", "Calls",
+           "%", "us/call");
+  for (i = 0; i < DELTAS_N_PHASES; i++)
+  {
+    const int k = order[i];
+
+    fprintf (fp, "%-24s %12.6f %10ld %6.1f %12.2f\n", phase_names[k],
+             profile->seconds[k], profile->calls[k],
+             total > 0. ? 100. * profile->seconds[k] / total : 0.,
+             profile->calls[k] > 0 ?
+             1e6 * profile->seconds[k] / profile->calls[k] : 0.);
+  }
+  fprintf (fp, "%-24s %12.6f\n\n", "Total", total);
+
+  fprintf (fp, "%-24s %12s\n", "Event", "Count");
+  for (i = 0; i < DELTAS_N_EVENTS; i++)
+    fprintf (fp, "%-24s %12ld\n", event_names[i], profile->events[i]);
+}
+
+/** Seconds on a clock that only goes forward */
+double
+cem_profile_clock (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + 1e-9 * now.tv_nsec;
+}
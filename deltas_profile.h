@@ -0,0 +1,69 @@
+#if !defined( DELTAS_PROFILE_H )
+#define DELTAS_PROFILE_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Phases of the time loop that are timed when profiling */
+enum
+{
+  DELTAS_PHASE_PERIODIC_COPY = 0,
+  DELTAS_PHASE_FIND_BEACH,  /**< Tracing the shoreline, whole or in part */
+  DELTAS_PHASE_SHADOW,
+  DELTAS_PHASE_ANGLES,
+  DELTAS_PHASE_SED_TRANSPORT,
+  DELTAS_PHASE_TRANSPORT_SWEEP,
+  DELTAS_PHASE_FIX_BEACH,
+  DELTAS_PHASE_OVERWASH,
+  DELTAS_PHASE_MASS_COUNT,
+  DELTAS_PHASE_RIVERS,  /**< Delivering sediment, from rivers or not */
+  DELTAS_PHASE_OUTPUT,  /**< Handing grids and shorelines to be saved */
+  DELTAS_N_PHASES
+};
+
+/** Things the model counts when profiling */
+enum
+{
+  DELTAS_EVENT_OOPS_FULL = 0,
+  DELTAS_EVENT_OOPS_EMPTY,
+  DELTAS_EVENT_OVERWASH,  /**< Sediment washed over a barrier */
+  DELTAS_EVENT_REFRACT_STEPS,  /**< Depth steps taken refracting waves */
+  DELTAS_EVENT_SHADOW_STEPS,  /**< Cells stepped through by shadow rays */
+  DELTAS_N_EVENTS
+};
+
+/** Trace categories that can be turned on while running (see
+deltas_set_trace).  Others are chosen when the library is built.
+*/
+enum
+{
+  DELTAS_TRACE_SETUP = 1 << 0,  /**< Initialization and each phase begun */
+  DELTAS_TRACE_STEPS = 1 << 1,  /**< Each phase finished, with its time step */
+  DELTAS_TRACE_OVERWASH = 1 << 2  /**< Each overwash move */
+};
+
+/** Where a run has spent its time, since profiling was turned on */
+typedef struct
+{
+  double seconds[DELTAS_N_PHASES];  /**< Wall time in each phase */
+  long calls[DELTAS_N_PHASES];
+  long events[DELTAS_N_EVENTS];
+}
+Deltas_profile;
+
+const char *deltas_profile_phase_name (int phase);
+
+const char *deltas_profile_event_name (int event);
+
+void deltas_print_profile (const Deltas_profile * profile, FILE * fp);
+
+double cem_profile_clock (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
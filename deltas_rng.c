@@ -0,0 +1,78 @@
+/** \file
+
+\brief The xoshiro256** generator of Blackman and Vigna.
+*/
+
+#include "deltas_rng.h"
+
+static uint64_t
+rotl (const uint64_t x, int k)
+{
+  return (x << k) | (x >> (64 - k));
+}
+
+/** Seeds the generator from a single number
+
+The four words of state are filled from splitmix64, so that similar seeds
+give unrelated streams and the state is never all zeros.
+*/
+void
+cem_rng_seed (cem_rng * rng, uint64_t seed)
+{
+  int i;
+
+  for (i = 0; i < CEM_RNG_STATE_LEN; i++)
+  {
+    uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    rng->s[i] = z ^ (z >> 31);
+  }
+}
+
+/** The next 64 random bits
+*/
+uint64_t
+cem_rng_next (cem_rng * rng)
+{
+  uint64_t *s = rng->s;
+  const uint64_t result = rotl (s[1] * 5, 7) * 9;
+  const uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+
+  s[2] ^= t;
+
+  s[3] = rotl (s[3], 45);
+
+  return result;
+}
+
+/** A random number equally distributed in [0, 1)
+*/
+double
+cem_rng_uniform (cem_rng * rng)
+{
+  return (cem_rng_next (rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/** Fills x with n random numbers equally distributed in [0, 1)
+
+The same numbers, in the same order, as n calls to cem_rng_uniform, but
+with the state kept in registers for the whole run of them.
+*/
+void
+cem_rng_fill_uniform (cem_rng * rng, double *x, int n)
+{
+  cem_rng r = *rng;
+  int i;
+
+  for (i = 0; i < n; i++)
+    x[i] = cem_rng_uniform (&r);
+
+  *rng = r;
+}
@@ -0,0 +1,28 @@
+#if !defined( DELTAS_RNG_H )
+#define DELTAS_RNG_H
+
+#include <stdint.h>
+
+#define CEM_RNG_STATE_LEN (4)
+
+/** A xoshiro256** random number generator.
+
+Each instance of the model owns one, so instances don't share, or fight
+over, the state of libc's random().  The state is four words that can be
+saved and restored to carry on a run exactly where it left off.
+*/
+typedef struct
+{
+  uint64_t s[CEM_RNG_STATE_LEN];
+}
+cem_rng;
+
+void cem_rng_seed (cem_rng * rng, uint64_t seed);
+
+uint64_t cem_rng_next (cem_rng * rng);
+
+double cem_rng_uniform (cem_rng * rng);
+
+void cem_rng_fill_uniform (cem_rng * rng, double *x, int n);
+
+#endif
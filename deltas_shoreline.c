@@ -0,0 +1,198 @@
+/** \file
+
+\brief Shoreline time series appended to one binary stream.
+
+A frame costs a few floats a cell of shoreline, so the shoreline can be
+kept every time step.  See deltas_shoreline.h for the layout.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "deltas_api.h"
+#include "deltas_shoreline.h"
+
+#define SHORELINE_MAGIC "CEMSHOR"
+#define SHORELINE_VERSION (1)
+#define SHORELINE_BYTE_ORDER (0x01020304)
+
+struct _cem_shoreline
+{
+  FILE *fp;
+  int ny;
+  int format;
+
+  float *frame;  /**< Filled by the caller, then appended */
+  int n_frame;  /**< Room in frame */
+};
+
+/* Where the last whole frame of fp ends, so that a frame cut short by a
+   crash is written over */
+static off_t
+frames_end (FILE * fp, const cem_shoreline_header * h)
+{
+  off_t size;
+  off_t end = h->header_bytes;
+
+  fseeko (fp, 0, SEEK_END);
+  size = ftello (fp);
+
+  if (h->format == SHORELINE_COLUMNS)
+  {
+    const off_t frame_bytes = sizeof (int32_t) + sizeof (float) * h->ny;
+
+    return end + (size - end) / frame_bytes * frame_bytes;
+  }
+
+  for (;;)
+  {
+    int32_t head[2];
+    off_t next;
+
+    if (fseeko (fp, end, SEEK_SET) != 0
+        || fread (head, sizeof (head), 1, fp) != 1 || head[1] < 0)
+      break;
+    next = end + sizeof (head) + sizeof (float) * 2 * (off_t) head[1];
+    if (next > size)
+      break;
+    end = next;
+  }
+
+  return end;
+}
+
+/** Opens the shoreline stream at path, in format
+
+Frames are added after any already in the file, which must then be of
+the same shape and format.  Returns NULL if path can't be written.
+*/
+cem_shoreline *
+cem_shoreline_open (const char *path, int nx, int ny, int format)
+{
+  cem_shoreline *l;
+  cem_shoreline_header h;
+  FILE *fp = fopen (path, "r+b");
+
+  if (fp)
+  {
+    off_t end;
+
+    if (fread (&h, sizeof (h), 1, fp) != 1
+        || memcmp (h.magic, SHORELINE_MAGIC, sizeof (SHORELINE_MAGIC)) != 0
+        || h.byte_order != SHORELINE_BYTE_ORDER
+        || h.version != SHORELINE_VERSION
+        || h.header_bytes != sizeof (h)
+        || h.nx != nx || h.ny != ny || h.format != format)
+    {
+      fprintf (stderr, "*** %s is not a shoreline stream of this run\n",
+               path);
+      fclose (fp);
+      return NULL;
+    }
+
+    end = frames_end (fp, &h);
+    if (ftruncate (fileno (fp), end) != 0
+        || fseeko (fp, end, SEEK_SET) != 0)
+    {
+      fprintf (stderr, "*** Unable to append to %s\n", path);
+      fclose (fp);
+      return NULL;
+    }
+  }
+  else
+  {
+    fp = fopen (path, "wb");
+    if (!fp)
+    {
+      fprintf (stderr, "*** Unable to open shoreline file %s\n", path);
+      return NULL;
+    }
+
+    memset (&h, 0, sizeof (h));
+    memcpy (h.magic, SHORELINE_MAGIC, sizeof (SHORELINE_MAGIC));
+    h.version = SHORELINE_VERSION;
+    h.byte_order = SHORELINE_BYTE_ORDER;
+    h.header_bytes = sizeof (h);
+    h.nx = nx;
+    h.ny = ny;
+    h.format = format;
+
+    if (fwrite (&h, sizeof (h), 1, fp) != 1)
+    {
+      fprintf (stderr, "*** Unable to write shoreline file %s\n", path);
+      fclose (fp);
+      return NULL;
+    }
+  }
+
+  l = (cem_shoreline *) calloc (1, sizeof (cem_shoreline));
+  l->fp = fp;
+  l->ny = ny;
+  l->format = format;
+
+  return l;
+}
+
+/** Room for a frame of n floats, to be filled and then appended
+
+For SHORELINE_COLUMNS n is ny; for SHORELINE_POLYLINE it is twice the
+number of points.  Returns NULL if there's no memory for it.
+*/
+float *
+cem_shoreline_frame (cem_shoreline * l, int n)
+{
+  if (l->n_frame < n)
+  {
+    free (l->frame);
+    l->frame = (float *)malloc (sizeof (float) * n);
+    l->n_frame = l->frame ? n : 0;
+  }
+  return l->frame;
+}
+
+/** Appends the first n floats of the frame, taken at time_step
+
+Frames go through stdio's buffer; they are on disk once the stream is
+closed.  Returns TRUE on success.
+*/
+int
+cem_shoreline_append (cem_shoreline * l, int time_step, int n)
+{
+  int32_t head[2];
+  int n_head = 1;
+
+  head[0] = time_step;
+  if (l->format == SHORELINE_POLYLINE)
+  {
+    head[1] = n / 2;
+    n = 2 * head[1];
+    n_head = 2;
+  }
+  else if (n != l->ny)
+    return FALSE;
+
+  return fwrite (head, sizeof (int32_t), n_head, l->fp) == (size_t) n_head
+    && fwrite (l->frame, sizeof (float), n, l->fp) == (size_t) n;
+}
+
+/** Closes l and frees it
+
+Returns FALSE if the last frames couldn't be written.
+*/
+int
+cem_shoreline_close (cem_shoreline * l)
+{
+  int ok;
+
+  if (!l)
+    return TRUE;
+
+  ok = (fclose (l->fp) == 0);
+  free (l->frame);
+  free (l);
+
+  return ok;
+}
@@ -0,0 +1,47 @@
+#if !defined( DELTAS_SHORELINE_H )
+#define DELTAS_SHORELINE_H
+
+#include <stdint.h>
+
+/** A binary stream of shorelines, one frame per record.
+
+The file is a cem_shoreline_header followed by the frames, in the byte
+order of the machine that wrote them, so it can be mapped and read in
+place.  Positions are in cells, measured from the initial beach as the
+old lineout files were.
+
+SHORELINE_COLUMNS frames are fixed size: an int32 time step then ny
+floats, the shoreline position at each y.  The n'th frame starts at
+header_bytes + n * (4 + 4 * ny).
+
+SHORELINE_POLYLINE frames are an int32 time step, an int32 point count
+and then that many (x, y) pairs of floats, the beach cells in the order
+they were traced.
+*/
+typedef struct _cem_shoreline cem_shoreline;
+
+#define SHORELINE_COLUMNS (0)
+#define SHORELINE_POLYLINE (1)
+
+typedef struct
+{
+  char magic[8];  /**< "CEMSHOR" */
+  uint32_t version;
+  uint32_t byte_order;  /**< 0x01020304 as written */
+  uint32_t header_bytes;
+  int32_t nx;
+  int32_t ny;
+  int32_t format;  /**< SHORELINE_COLUMNS or SHORELINE_POLYLINE */
+}
+cem_shoreline_header;
+
+cem_shoreline *cem_shoreline_open (const char *path, int nx, int ny,
+                                   int format);
+
+float *cem_shoreline_frame (cem_shoreline * l, int n);
+
+int cem_shoreline_append (cem_shoreline * l, int time_step, int n);
+
+int cem_shoreline_close (cem_shoreline * l);
+
+#endif
@@ -0,0 +1,1625 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <deltas_api.h>
+#include <deltas_archive.h>
+#include <deltas_shoreline.h>
+#include <deltas_text.h>
+#include <deltas.h>
+
+#define CHECKPOINT_FILE "test_deltas.ckpt"
+#define ARCHIVE_FILE "test_deltas.archive"
+#define SHORELINE_FILE "test_deltas.shoreline"
+#define TEXT_FILE "test_deltas.txt"
+
+#define SPLIT_AFTER (20)  /**< updates to run before splitting the run */
+#define RUN_ON (100)  /**< updates to run the split copies on for */
+#define STOP_AT (2500)  /**< time step the branches run to; the first archive frame */
+#define N_MEMBERS (4)
+#define HALO_UPDATES (1500)  /**< updates to run the two layouts for */
+#define BARRIER_NY (200)  /**< columns of the barriers most checks run on */
+#define WIDE_HALO (45)  /**< cells, just under half the barrier's domain */
+#define PATH_UPDATES (600)  /**< updates to check a fast path over */
+#define OVERWASH_CELL (75.)  /**< m, narrow enough for barriers to be washed over */
+#define OVERWASH_UPDATES (50)  /**< updates before such barriers break through */
+#define THREADS_NY (1000)  /**< columns of a barrier with beach enough to share out */
+#define N_THREADS (4)
+#define RAY_STEPS (40)  /**< steps to march each line for */
+#define RAY_UPDATES (100)  /**< updates to take lines from */
+#define N_NEAR_CORNER (20000)  /**< lines aimed at a corner */
+
+static int n_failed = 0;
+
+static void check (int ok, const char *what);
+static void update (BMI_Model * self, double *qs, int n_updates);
+static int same_grids (BMI_Model * a, BMI_Model * b);
+static void keep_grids (Deltas_state * member, int member_id, void *data);
+static int check_ensemble (BMI_Model * base, BMI_Model * expected,
+                           double until, int n_threads);
+static int check_archive (const double *percent, const double *depth);
+static int check_shoreline (int nx, int ny, int n_frames);
+static BMI_Model *new_barrier (int halo_width, double cell_width, int ny);
+static int check_halo (BMI_Model * wide, BMI_Model * halo);
+static int check_retrace (void);
+static int check_next_cell (void);
+static int check_breaking (void);
+static int check_fix_beach (void);
+static int check_x_max_beach (void);
+static int check_overwash (void);
+static int check_threads (void);
+static int check_ray (void);
+static int check_text (void);
+static int check_read_sand (void);
+static int check_config (void);
+
+/** A check that a fast path of the model ends up where the slower one it
+stands in for does, run as test_deltas <name> */
+typedef struct
+{
+  const char *name;
+  int (*check) (void);
+  const char *what;
+}
+Path_check;
+
+static const Path_check path_checks[] = {
+  {"retrace", check_retrace, "retraced shoreline matches a full trace"},
+  {"next_cell", check_next_cell, "next cell table matches the rules"},
+  {"breaking", check_breaking, "breaking table matches wave refraction"},
+  {"fix_beach", check_fix_beach, "fixing changed cells matches fixing all"},
+  {"x_max_beach", check_x_max_beach, "beach row counts match a scan"},
+  {"overwash", check_overwash, "overwash checks cut short match full ones"},
+  {"threads", check_threads, "runs on threads match runs on one"},
+  {"ray", check_ray, "stepped lines visit the cells they used to"},
+  {"text", check_text, "text numbers read as strtod reads them"},
+  {"read_sand", check_read_sand, "sand files of the wrong size are turned down"},
+  {"config", check_config, "a configured shoreface keeps the initial depths"},
+};
+
+/** Checks that a run can be split and carried on exactly as it would have
+
+A model is updated SPLIT_AFTER times, as run_deltas updates it, then
+checkpointed, loaded back and cloned, and all three are updated RUN_ON
+times more.  Their grids must match bit for bit.  Two more clones, a
+branch and the run expected of it, run on to STOP_AT: ensemble members
+branched with one and several threads must end up as the expected run
+does, bit for bit.  The expected run also writes an archive and a
+shoreline stream, which are read back and checked against it.
+
+Given two configuration files, the same but for the width of their halos,
+checks instead that the two runs match (see check_halo), and that they do
+from a barrier island too.
+
+Given the name of one of path_checks, runs that check instead.
+*/
+int
+main (int argc, char *argv[])
+{
+  BMI_Model *self = NULL;
+  BMI_Model *restart = NULL;
+  BMI_Model *clone = NULL;
+  BMI_Model *branch = NULL;
+  BMI_Model *expected = NULL;
+  double *qs = NULL;
+  double *percent = NULL;
+  double *depth = NULL;
+  double dt;
+  int len;
+  int nx, ny;
+  int split_at;
+
+  if (argc == 2) {
+    size_t i;
+
+    for (i = 0; i < sizeof (path_checks) / sizeof (path_checks[0]); i++)
+      if (strcmp (argv[1], path_checks[i].name) == 0) {
+        check (path_checks[i].check (), path_checks[i].what);
+        return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+      }
+    fprintf (stderr, "Error: There is no check named %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  if (argc == 3) {
+    BMI_Model *wide = NULL;
+    BMI_Model *halo = NULL;
+
+    BMI_CEM_Initialize (argv[1], &wide);
+    BMI_CEM_Initialize (argv[2], &halo);
+    check (check_halo (wide, halo), "thin halo matches a wide one");
+    check (check_halo (new_barrier (WIDE_HALO, 100., BARRIER_NY),
+                       new_barrier (1, 100., BARRIER_NY)),
+           "thin halo matches a wide one from a barrier");
+    check (new_barrier (WIDE_HALO + 5, 100., BARRIER_NY) == NULL,
+           "no halo as wide as half the domain");
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+
+  remove (CHECKPOINT_FILE);
+  remove (ARCHIVE_FILE);
+  remove (SHORELINE_FILE);
+
+  if (BMI_CEM_Initialize (NULL, &self)) {
+    fprintf (stderr, "Error: Unable to initialize\n");
+    return EXIT_FAILURE;
+  }
+
+  BMI_CEM_Get_var_point_count (self, "surface__elevation", &len);
+  BMI_CEM_Get_time_step (self, &dt);
+  qs = (double *) malloc (sizeof (double) * len);
+  percent = (double *) malloc (sizeof (double) * len);
+  depth = (double *) malloc (sizeof (double) * len);
+
+  update (self, qs, SPLIT_AFTER);
+  split_at = (int) (deltas_get_current_time (self) / dt + .5);
+
+  check (deltas_save_checkpoint (self, CHECKPOINT_FILE), "save checkpoint");
+  restart = (BMI_Model *) deltas_load_checkpoint (CHECKPOINT_FILE);
+  check (restart != NULL, "load checkpoint");
+  clone = deltas_clone (self);
+  check (clone != NULL, "clone");
+  branch = deltas_clone (self);
+  expected = deltas_clone (self);
+  check (branch && expected, "clone for the ensemble");
+
+  if (!restart || !clone || !branch || !expected)
+    return EXIT_FAILURE;
+
+  update (self, qs, RUN_ON);
+  update (restart, qs, RUN_ON);
+  update (clone, qs, RUN_ON);
+
+  check (same_grids (self, restart), "checkpoint, load and run");
+  check (same_grids (self, clone), "clone and run");
+
+  /* The branch and its copies keep the river as it was at the split */
+  deltas_set_archive_file (expected, ARCHIVE_FILE);
+  deltas_set_shoreline_file (expected, SHORELINE_FILE);
+  deltas_run_until (expected, (STOP_AT + .5) * dt);
+
+  check (check_ensemble (branch, expected, (STOP_AT + .5) * dt, 1),
+         "ensemble with 1 thread");
+  check (check_ensemble (branch, expected, (STOP_AT + .5) * dt, N_MEMBERS),
+         "ensemble with 4 threads");
+
+  nx = deltas_get_nx (expected);
+  ny = len / nx;
+  BMI_CEM_Get_double (expected, "sea_water_to_sediment__depth_ratio",
+                      percent);
+  BMI_CEM_Get_double (expected, "sea_water__depth", depth);
+
+  /* Finalizing writes out what is queued and closes the files */
+  BMI_CEM_Finalize (self);
+  BMI_CEM_Finalize (restart);
+  BMI_CEM_Finalize (clone);
+  BMI_CEM_Finalize (branch);
+  BMI_CEM_Finalize (expected);
+
+  check (check_archive (percent, depth), "read back the archive");
+  check (check_shoreline (nx, ny, STOP_AT - split_at),
+         "read back the shoreline");
+
+  free (depth);
+  free (percent);
+  free (qs);
+
+  remove (CHECKPOINT_FILE);
+  remove (ARCHIVE_FILE);
+  remove (SHORELINE_FILE);
+
+  if (n_failed) {
+    fprintf (stderr, "%d checks failed\n", n_failed);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+static void
+check (int ok, const char *what)
+{
+  fprintf (stderr, "%s: %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok)
+    n_failed++;
+}
+
+static void
+update (BMI_Model * self, double *qs, int n_updates)
+{
+  const double river_flux = 250.;
+  int i;
+
+  for (i = 0; i < n_updates; i++) {
+    deltas_avulsion (self, qs, river_flux);
+    BMI_CEM_Set_double (self, "surface_bed_load_sediment__mass_flow_rate", qs);
+    BMI_CEM_Update (self);
+  }
+}
+
+/** TRUE if a and b have the same grids, including the wrap regions */
+static int
+same_grids (BMI_Model * a, BMI_Model * b)
+{
+  const int n = deltas_get_nx (a) * deltas_get_ny (a);
+
+  if (deltas_get_nx (b) * deltas_get_ny (b) != n)
+    return 0;
+  if (deltas_get_current_time (a) != deltas_get_current_time (b))
+    return 0;
+
+  return memcmp (deltas_get_percent (a), deltas_get_percent (b),
+                 sizeof (double) * n) == 0
+    && memcmp (deltas_get_depth (a), deltas_get_depth (b),
+               sizeof (double) * n) == 0;
+}
+
+typedef struct
+{
+  BMI_Model *expected;
+  int same[N_MEMBERS];
+}
+Ensemble_check;
+
+static void
+keep_grids (Deltas_state * member, int member_id, void *data)
+{
+  Ensemble_check *c = (Ensemble_check *) data;
+
+  c->same[member_id] = same_grids (member, c->expected);
+}
+
+/** TRUE if every member of an ensemble branched from base ends up as
+expected, which was run on its own */
+static int
+check_ensemble (BMI_Model * base, BMI_Model * expected, double until,
+                int n_threads)
+{
+  Ensemble_check c;
+  int i;
+
+  c.expected = expected;
+  for (i = 0; i < N_MEMBERS; i++)
+    c.same[i] = 0;
+
+  if (deltas_run_ensemble (base, N_MEMBERS, until, n_threads, NULL,
+                           keep_grids, &c) != 0)
+    return 0;
+
+  for (i = 0; i < N_MEMBERS; i++)
+    if (!c.same[i])
+      return 0;
+  return 1;
+}
+
+/** TRUE if the archive holds one frame, taken at STOP_AT, of the grids
+percent and depth */
+static int
+check_archive (const double *percent, const double *depth)
+{
+  cem_archive *a;
+  double *frame;
+  int nx, ny, n_layers;
+  int n;
+  int ok;
+
+  a = cem_archive_open_read (ARCHIVE_FILE);
+  if (!a)
+    return 0;
+
+  cem_archive_shape (a, &nx, &ny, &n_layers);
+  n = nx * ny;
+  frame = (double *) malloc (sizeof (double) * n * n_layers);
+
+  ok = cem_archive_n_frames (a) == 1 && n_layers == 2
+    && cem_archive_time_step (a, 0) == STOP_AT
+    && cem_archive_read (a, 0, frame)
+    && memcmp (frame, percent, sizeof (double) * n) == 0
+    && memcmp (frame + n, depth, sizeof (double) * n) == 0;
+
+  free (frame);
+  cem_archive_close (a);
+
+  return ok;
+}
+
+/** TRUE if the shoreline stream has n_frames frames of nx by ny cells,
+and the last of them, taken at STOP_AT, is within a grid's length of the
+initial beach */
+static int
+check_shoreline (int nx, int ny, int n_frames)
+{
+  FILE *fp = fopen (SHORELINE_FILE, "rb");
+  cem_shoreline_header h;
+  const long frame_bytes = sizeof (int32_t) + sizeof (float) * ny;
+  int32_t time_step;
+  float *line;
+  int ok;
+  int y;
+
+  if (!fp)
+    return 0;
+
+  ok = fread (&h, sizeof (h), 1, fp) == 1
+    && memcmp (h.magic, "CEMSHOR", 8) == 0
+    && h.nx == nx && h.ny == ny && h.format == SHORELINE_COLUMNS
+    && fseek (fp, 0, SEEK_END) == 0;
+  if (!ok) {
+    fclose (fp);
+    return 0;
+  }
+
+  line = (float *) malloc (sizeof (float) * ny);
+
+  ok = ftell (fp) == (long) h.header_bytes + n_frames * frame_bytes
+    && fseek (fp, h.header_bytes + (n_frames - 1) * frame_bytes,
+              SEEK_SET) == 0
+    && fread (&time_step, sizeof (time_step), 1, fp) == 1
+    && fread (line, sizeof (float), ny, fp) == (size_t) ny
+    && time_step == STOP_AT;
+  for (y = 0; ok && y < ny; y++)
+    ok = isfinite (line[y]) && fabs (line[y]) < nx;
+
+  free (line);
+  fclose (fp);
+
+  return ok;
+}
+
+/** A model started from a barrier island, 50 by ny cells cell_width
+wide, with a halo halo_width wide, or NULL if the grid can't be shaped */
+static BMI_Model *
+new_barrier (int halo_width, double cell_width, int ny)
+{
+  Deltas_state *s = deltas_new ();
+  int shape[2] = { 50, 0 };
+
+  if (!s)
+    return NULL;
+
+  shape[1] = ny;
+  deltas_set_halo_width (s, halo_width);
+  deltas_init_cell_width (s, cell_width);
+  if (!deltas_init_grid_shape (s, shape))
+    return deltas_destroy (s);
+  deltas_use_barrier (s);
+  deltas_init (s);
+  deltas_use_sed_flux (s);
+
+  return s;
+}
+
+/** TRUE if wide and halo, set up alike but for the width of their halos,
+end up with the same domain, bit for bit, when run the same way
+
+halo's halo must be the narrower, or the two runs could share a layout
+and the check would prove nothing.  Both models are finalized.
+*/
+static int
+check_halo (BMI_Model * wide, BMI_Model * halo)
+{
+  double *qs = NULL;
+  double *a = NULL;
+  double *b = NULL;
+  int len, halo_len;
+  int ok;
+
+  ok = wide && halo;
+  if (ok) {
+    BMI_CEM_Get_var_point_count (wide, "surface__elevation", &len);
+    BMI_CEM_Get_var_point_count (halo, "surface__elevation", &halo_len);
+    ok = len == halo_len && deltas_get_ny (halo) < deltas_get_ny (wide);
+  }
+
+  if (ok) {
+    qs = (double *) malloc (sizeof (double) * len);
+    a = (double *) malloc (sizeof (double) * len);
+    b = (double *) malloc (sizeof (double) * len);
+
+    update (wide, qs, HALO_UPDATES);
+    update (halo, qs, HALO_UPDATES);
+
+    BMI_CEM_Get_double (wide, "sea_water_to_sediment__depth_ratio", a);
+    BMI_CEM_Get_double (halo, "sea_water_to_sediment__depth_ratio", b);
+    ok = memcmp (a, b, sizeof (double) * len) == 0;
+
+    BMI_CEM_Get_double (wide, "sea_water__depth", a);
+    BMI_CEM_Get_double (halo, "sea_water__depth", b);
+    ok = ok && memcmp (a, b, sizeof (double) * len) == 0;
+  }
+
+  if (wide)
+    BMI_CEM_Finalize (wide);
+  if (halo)
+    BMI_CEM_Finalize (halo);
+
+  free (b);
+  free (a);
+  free (qs);
+
+  return ok;
+}
+
+/** TRUE if, after every update of a sandy and a barrier run, retracing the
+shoreline around the cells that flipped (RetraceShoreline) finds the
+shoreline a full trace does
+
+The wrap regions are copied first, as the next update would, so that
+their flips are followed too.  Updates with nothing to retrace, or that
+need a full trace anyway, aren't counted; some must be.
+*/
+static int
+check_retrace (void)
+{
+  BMI_Model *models[2] = { NULL, NULL };
+  int n_retraced = 0;
+  int ok;
+  int m;
+
+  BMI_CEM_Initialize (NULL, &models[0]);
+  models[1] = new_barrier (0, 100., BARRIER_NY);
+  ok = models[0] && models[1];
+
+  for (m = 0; ok && m < 2; m++) {
+    State *p = (State *) models[m];
+    int len;
+    double *qs;
+    int i;
+
+    BMI_CEM_Get_var_point_count (models[m], "surface__elevation", &len);
+    qs = (double *) malloc (sizeof (double) * len);
+
+    for (i = 0; ok && i < PATH_UPDATES; i++) {
+      int *x = NULL;
+      int *y = NULL;
+      int n = 0;
+      int retraced;
+
+      update (models[m], qs, 1);
+      PeriodicBoundaryCopy (p);
+
+      retraced = p->ShorelineValid == 'y' && p->NumShoreDirty > 0
+        && RetraceShoreline (p);
+      if (retraced) {
+        n = p->TotalBeachCells;
+        x = (int *) malloc (sizeof (int) * n);
+        y = (int *) malloc (sizeof (int) * n);
+        memcpy (x, p->X, sizeof (int) * n);
+        memcpy (y, p->Y, sizeof (int) * n);
+      }
+
+      /* Trace it in full, as FindShoreline does when a retrace fails */
+      p->ShorelineValid = 'n';
+      ok = FindShoreline (p);
+
+      if (retraced) {
+        ok = ok && p->TotalBeachCells == n
+          && memcmp (x, p->X, sizeof (int) * n) == 0
+          && memcmp (y, p->Y, sizeof (int) * n) == 0;
+        if (!ok)
+          fprintf (stderr, "Retrace differs after %d updates\n", i + 1);
+        n_retraced++;
+      }
+
+      free (y);
+      free (x);
+    }
+
+    free (qs);
+  }
+
+  fprintf (stderr, "%d shorelines retraced\n", n_retraced);
+
+  for (m = 0; m < 2; m++)
+    if (models[m])
+      BMI_CEM_Finalize (models[m]);
+
+  return ok && n_retraced > 0;
+}
+
+/** TRUE if FindNextCell, which looks most steps up in a table, steps where
+FindNextCellRules does, for every way the eight cells around a cell can
+be beach
+
+The cell is put at both ends of a row as well as in the middle, so the
+steps have to wrap alike, and is come to from above, beside and below,
+for the rules that depend on it.
+*/
+static int
+check_next_cell (void)
+{
+  BMI_Model *self = NULL;
+  State *p;
+  int ok;
+  int mask;
+
+  BMI_CEM_Initialize (NULL, &self);
+  ok = self != NULL;
+  if (!ok)
+    return 0;
+
+  p = (State *) self;
+  for (mask = 0; ok && mask < 256; mask++) {
+    const int x = p->nx - 3;  /* offshore, where nothing else is beach */
+    const int ys[3] = { 0, p->ny_grid / 2, p->ny_grid - 1 };
+    int k;
+
+    for (k = 0; ok && k < 9; k++) {
+      const int y = ys[k / 3];
+      const int y_left = (y == 0) ? p->ny_grid - 1 : y - 1;
+      const int y_right = (y == p->ny_grid - 1) ? 0 : y + 1;
+      int next_x, next_y;
+
+      SetAllBeach (p, x - 1, y, (mask & 1) ? 'y' : 'n');
+      SetAllBeach (p, x - 1, y_left, (mask & 2) ? 'y' : 'n');
+      SetAllBeach (p, x - 1, y_right, (mask & 4) ? 'y' : 'n');
+      SetAllBeach (p, x, y_left, (mask & 8) ? 'y' : 'n');
+      SetAllBeach (p, x, y_right, (mask & 16) ? 'y' : 'n');
+      SetAllBeach (p, x + 1, y, (mask & 32) ? 'y' : 'n');
+      SetAllBeach (p, x + 1, y_left, (mask & 64) ? 'y' : 'n');
+      SetAllBeach (p, x + 1, y_right, (mask & 128) ? 'y' : 'n');
+      p->X[0] = x + k % 3 - 1;
+      p->Y[0] = y;
+
+      p->NextX = p->NextY = -1;
+      FindNextCell (p, x, y, 1);
+      next_x = p->NextX;
+      next_y = p->NextY;
+
+      p->NextX = p->NextY = -1;
+      FindNextCellRules (p, x, y, 1);
+      ok = p->NextX == next_x && p->NextY == next_y;
+      if (!ok)
+        fprintf (stderr, "Mask %d at y = %d steps to (%d, %d), not (%d, %d)\n",
+                 mask, y, next_x, next_y, p->NextX, p->NextY);
+
+      SetAllBeach (p, x - 1, y, 'n');
+      SetAllBeach (p, x - 1, y_left, 'n');
+      SetAllBeach (p, x - 1, y_right, 'n');
+      SetAllBeach (p, x, y_left, 'n');
+      SetAllBeach (p, x, y_right, 'n');
+      SetAllBeach (p, x + 1, y, 'n');
+      SetAllBeach (p, x + 1, y_left, 'n');
+      SetAllBeach (p, x + 1, y_right, 'n');
+    }
+  }
+
+  BMI_CEM_Finalize (self);
+
+  return ok;
+}
+
+/** Transport across a border, up to the constants, from waves breaking
+at angle and height */
+static double
+breaking_flux (double angle, double height)
+{
+  return pow (height, 2.5) * cos (angle) * sin (angle);
+}
+
+/** TRUE if the breaking angles and heights looked up in the table are
+close to those RefractWave walks the waves in to
+
+The wave height and period are changed in turns, one at a time, and the
+table has to be rebuilt each time to hold exactly what RefractWave gives at its own angles.  In between, where
+the depth RefractWave breaks the waves at jumps a step, the transport
+from the table can be off by a little over one percent; on average it is
+off by a few parts in 1e5.
+*/
+static int
+check_breaking (void)
+{
+  const double heights[8] = { 2., .5, .5, 3., 3., 1., 1., 2. };
+  const double periods[8] = { 8., 8., 5., 5., 12., 12., 8., 8. };
+  const double dAngle = 0.995 * M_PI / 2.0 / REFRACT_TABLE_LEN;
+  const int n_angles = 4000;
+  BMI_Model *self = NULL;
+  State *p;
+  int ok;
+  int i;
+
+  BMI_CEM_Initialize (NULL, &self);
+  ok = self != NULL;
+  if (!ok)
+    return 0;
+
+  p = (State *) self;
+  for (i = 0; ok && i < 8; i++) {
+    double angle, height;
+    double table_angle, table_height;
+    double err, sum_err = 0., max_err = 0.;
+    int k;
+
+    deltas_set_wave_height ((Deltas_state *) p, heights[i]);
+    deltas_set_wave_period ((Deltas_state *) p, periods[i]);
+    BuildBreakingTable (p);
+
+    for (k = 0; ok && k <= REFRACT_TABLE_LEN; k++) {
+      RefractWave (p, k * dAngle, &angle, &height);
+      ok = p->BreakAngle[k] == angle && p->BreakHeight[k] == height;
+    }
+    RefractWave (p, 42.0 / (180.0 / M_PI), &angle, &height);
+    ok = ok && p->BreakAngleMaxT == angle && p->BreakHeightMaxT == height;
+    if (!ok) {
+      fprintf (stderr, "Table for waves of %g m, %g s is stale\n",
+               p->wave_height, p->wave_period);
+      break;
+    }
+
+    for (k = -n_angles; k <= n_angles; k++) {
+      const double angle_deep = k * 0.995 * M_PI / 2.0 / (n_angles + .5);
+
+      RefractWave (p, angle_deep, &angle, &height);
+      LookUpBreaking (p, angle_deep, &table_angle, &table_height);
+
+      err = fabs (breaking_flux (table_angle, table_height)
+                  - breaking_flux (angle, height)) / pow (height, 2.5);
+      sum_err += err;
+      if (err > max_err)
+        max_err = err;
+    }
+
+    ok = max_err < 2e-2 && sum_err / (2 * n_angles + 1) < 1e-4;
+    if (!ok)
+      fprintf (stderr, "Waves of %g m, %g s: transport off by %g, %g on average\n",
+               p->wave_height, p->wave_period, max_err,
+               sum_err / (2 * n_angles + 1));
+  }
+
+  BMI_CEM_Finalize (self);
+
+  return ok;
+}
+
+/** Moves sand into and out of cells along p's shoreline, and notes the
+cells as changed, as transport does.  Some are left overfull, some
+underfull and some holding loose bits, for FixBeach to see to.
+*/
+static void
+stir_shoreline (State * p, unsigned int seed)
+{
+  int k;
+
+  for (k = 0; k < 20; k++) {
+    const int i = (seed = seed * 1103515245u + 12345u) % p->TotalBeachCells;
+    const int x = p->X[i] + (int) ((seed >> 8) % 3) - 1;
+    const int y = p->Y[i];
+    const double amount = ((seed >> 16) % 1401) / 1000. - .7;
+
+    if (x > 0 && x < p->nx - 1) {
+      AddPercentFull (p, x, y, amount);
+      MarkFixCell (p, x, y);
+    }
+  }
+}
+
+/** Puts bits of sand past the beach, or with knock, knocks them loose
+
+Each bit is held in place by a full cell next to it - along its row
+either way, across the ends of the row where FixBeach wraps it, and from
+the row below.  Knocking empties half of each cell holding a bit up, and
+notes only those cells as changed.  The bits are far enough apart not to
+be fixed along with each other.
+*/
+static void
+prop_sand (State * p, int knock)
+{
+  const int wrap = HAS_HALO (p) ? p->ny_grid : p->ny;
+  const int x = p->ShadowXMax;
+  const int y = p->ny_lo + p->ny / 4;
+  const int props[5][4] = {
+    /* bit, and the cell holding it up */
+    {x, 0, x, wrap - 1},
+    {x + 3, wrap - 1, x + 3, 0},
+    {x, y + 1, x, y},
+    {x, y - 4, x, y - 3},
+    {x + 1, y + 6, x, y + 6}
+  };
+  int k;
+
+  for (k = 0; k < 5; k++) {
+    if (knock) {
+      AddPercentFull (p, props[k][2], props[k][3], -.5);
+      MarkFixCell (p, props[k][2], props[k][3]);
+    }
+    else {
+      AddPercentFull (p, props[k][0], props[k][1], .2);
+      AddPercentFull (p, props[k][2], props[k][3], 1.);
+      SetAllBeach (p, props[k][2], props[k][3], 'y');
+      MarkFixCell (p, props[k][0], props[k][1]);
+    }
+  }
+}
+
+/** TRUE if FixBeach, fixing only the cells around those that changed,
+leaves the grid, mass and random numbers as looking at every cell does
+
+Every few updates of a sandy, a barrier and a halo barrier run, the
+shoreline of two copies is stirred alike and one is made to look at
+every cell.  Bits of sand propped up past the beach are knocked loose
+too, which FixBeach only finds by the neighbors of what changed.  It must
+have had something to fix some of the time.
+*/
+static int
+check_fix_beach (void)
+{
+  BMI_Model *models[3] = { NULL, NULL, NULL };
+  int n_fixed = 0;
+  int ok;
+  int m;
+
+  BMI_CEM_Initialize (NULL, &models[0]);
+  models[1] = new_barrier (0, 100., BARRIER_NY);
+  models[2] = new_barrier (WIDE_HALO, 100., BARRIER_NY);
+  ok = models[0] && models[1] && models[2];
+
+  for (m = 0; ok && m < 3; m++) {
+    int len;
+    double *qs;
+    int i;
+
+    BMI_CEM_Get_var_point_count (models[m], "surface__elevation", &len);
+    qs = (double *) malloc (sizeof (double) * len);
+
+    for (i = 0; ok && i < PATH_UPDATES; i += 10) {
+      Deltas_state *a;
+      Deltas_state *b;
+      Deltas_state *stirred;
+
+      update (models[m], qs, 10);
+
+      a = deltas_clone (models[m]);
+      b = deltas_clone (models[m]);
+      stirred = deltas_clone (models[m]);
+      ok = a && b && stirred;
+      if (ok) {
+        Deltas_state *copies[3] = { a, b, stirred };
+        uint64_t rng_a[4], rng_b[4];
+        int k;
+
+        for (k = 0; k < 3; k++) {
+          State *c = (State *) copies[k];
+
+          prop_sand (c, FALSE);
+          c->FixAll = TRUE;
+          FixBeach (c);
+
+          stir_shoreline (c, i);
+          prop_sand (c, TRUE);
+        }
+
+        FixBeach ((State *) a);
+        ((State *) b)->FixAll = TRUE;
+        FixBeach ((State *) b);
+
+        deltas_get_rng_state (a, rng_a);
+        deltas_get_rng_state (b, rng_b);
+        ok = same_grids (a, b)
+          && deltas_get_mass (a) == deltas_get_mass (b)
+          && memcmp (rng_a, rng_b, sizeof (rng_a)) == 0;
+        if (!ok)
+          fprintf (stderr, "Run %d fixed differently after %d updates\n",
+                   m, i + 10);
+        if (!same_grids (a, stirred))
+          n_fixed++;
+      }
+
+      if (stirred)
+        deltas_destroy (stirred);
+      if (b)
+        deltas_destroy (b);
+      if (a)
+        deltas_destroy (a);
+    }
+
+    free (qs);
+  }
+
+  fprintf (stderr, "%d stirred beaches fixed\n", n_fixed);
+
+  for (m = 0; m < 3; m++)
+    if (models[m])
+      BMI_CEM_Finalize (models[m]);
+
+  return ok && n_fixed > 0;
+}
+
+/** TRUE if p's count of all beach cells in each row, highest row with
+any, and XMaxBeach from the rows it can start at, are what looking at
+every cell finds
+
+XMaxBeach is started no lower than the lowest row of beach, past row 0,
+so that it finds some.
+*/
+static int
+same_beach_rows (State * p)
+{
+  int lowest = p->nx;
+  int highest = -1;
+  int ok = 1;
+  int x, y;
+  int max;
+
+  for (x = 0; ok && x < p->nx; x++) {
+    int count = 0;
+
+    for (y = 0; y < p->ny_grid; y++)
+      if (IS_BEACH (p, x, y))
+        count++;
+    if (count > 0 && x > 0 && x < lowest)
+      lowest = x;
+    if (count > 0)
+      highest = x;
+    ok = p->BeachRowCount[x] == count;
+  }
+  ok = ok && p->BeachRowMax == highest;
+
+  /* XMaxBeach as it was, trying rows from Max + 2 down */
+  for (max = lowest - 2; ok && max + 2 < p->nx; max++) {
+    int found = p->nx;
+
+    for (x = max + 2; x > 0; x--) {
+      for (y = 0; y < p->ny_grid && !IS_BEACH (p, x, y); y++);
+      if (y < p->ny_grid) {
+        found = x;
+        break;
+      }
+    }
+    ok = XMaxBeach (p, max) == found;
+  }
+
+  return ok;
+}
+
+/** TRUE if, after every update of a sandy, a barrier and a halo barrier
+run and again once the wrap regions are copied, the rows of beach kept
+as cells change are the rows found by looking at every cell
+
+The beach must reach past some of the rows XMaxBeach starts from, so
+that it is looked up, and not reach others, so that it is searched for.
+*/
+static int
+check_x_max_beach (void)
+{
+  BMI_Model *models[3] = { NULL, NULL, NULL };
+  int ok;
+  int m;
+
+  BMI_CEM_Initialize (NULL, &models[0]);
+  models[1] = new_barrier (0, 100., BARRIER_NY);
+  models[2] = new_barrier (WIDE_HALO, 100., BARRIER_NY);
+  ok = models[0] && models[1] && models[2];
+
+  for (m = 0; ok && m < 3; m++) {
+    State *p = (State *) models[m];
+    int len;
+    double *qs;
+    int i;
+
+    BMI_CEM_Get_var_point_count (models[m], "surface__elevation", &len);
+    qs = (double *) malloc (sizeof (double) * len);
+
+    for (i = 0; ok && i < PATH_UPDATES; i++) {
+      update (models[m], qs, 1);
+      ok = same_beach_rows (p);
+
+      PeriodicBoundaryCopy (p);
+      ok = ok && same_beach_rows (p);
+
+      if (!ok)
+        fprintf (stderr, "Run %d has its beach rows wrong after %d updates\n",
+                 m, i + 1);
+    }
+
+    free (qs);
+  }
+
+  for (m = 0; m < 3; m++)
+    if (models[m])
+      BMI_CEM_Finalize (models[m]);
+
+  return ok;
+}
+
+/** TRUE if a and b found the same overwash, leaving aside the cells each
+looked at */
+static int
+same_overwash (const Overwash * a, const Overwash * b)
+{
+  return a->found == b->found
+    && (!a->found
+        || (a->xto == b->xto && a->yto == b->yto
+            && a->xint == b->xint && a->yint == b->yint
+            && a->width == b->width));
+}
+
+/** TRUE if stopping overwash checks where the land is too wide to wash
+over (BarrierWidth) finds what stepping them to the end does
+
+After every update of a sandy, a barrier and a halo barrier run, a copy
+retraces its shoreline, as the update does before its overwash sweep.
+Every beach cell that can be washed over is checked both ways, and then
+two copies sweep, one stepping every check to the end; their grids, mass
+and random numbers must come out the same.  Some overwash must be found.
+
+The barriers' cells are narrow enough for them to be washed over.  The
+runs end before the barriers break through, where their shorelines can't
+be traced and the update stops.
+*/
+static int
+check_overwash (void)
+{
+  BMI_Model *models[3] = { NULL, NULL, NULL };
+  int n_found = 0;
+  int ok;
+  int m;
+
+  BMI_CEM_Initialize (NULL, &models[0]);
+  models[1] = new_barrier (0, OVERWASH_CELL, BARRIER_NY);
+  models[2] = new_barrier (WIDE_HALO, OVERWASH_CELL, BARRIER_NY);
+  ok = models[0] && models[1] && models[2];
+
+  for (m = 0; ok && m < 3; m++) {
+    int len;
+    double *qs;
+    int i;
+
+    BMI_CEM_Get_var_point_count (models[m], "surface__elevation", &len);
+    qs = (double *) malloc (sizeof (double) * len);
+
+    for (i = 0; ok && i < OVERWASH_UPDATES; i++) {
+      Deltas_state *a;
+      Deltas_state *b = NULL;
+      State *p;
+
+      update (models[m], qs, 1);
+
+      a = deltas_clone (models[m]);
+      ok = a != NULL;
+      if (ok) {
+        int k;
+
+        p = (State *) a;
+        PeriodicBoundaryCopy (p);
+        ZeroVars (p);
+        ok = FindShoreline (p);
+        ShadowSweep (p);
+        DetermineAngles (p);
+
+        for (k = 1; ok && k < p->TotalBeachCells - 1; k++) {
+          Overwash cut, full;
+
+          if (!CanOverwash (p, k))
+            continue;
+
+          p->exact_overwash = FALSE;
+          cut.found = FindOverwash (p, k, &cut);
+          p->exact_overwash = TRUE;
+          full.found = FindOverwash (p, k, &full);
+
+          ok = same_overwash (&cut, &full);
+          if (full.found)
+            n_found++;
+        }
+        p->exact_overwash = FALSE;
+
+        b = deltas_clone (a);
+        ok = ok && b;
+      }
+
+      if (ok) {
+        uint64_t rng_a[4], rng_b[4];
+
+        deltas_use_exact_overwash (b);
+        CheckOverwashSweep ((State *) a);
+        CheckOverwashSweep ((State *) b);
+
+        deltas_get_rng_state (a, rng_a);
+        deltas_get_rng_state (b, rng_b);
+        ok = same_grids (a, b)
+          && deltas_get_mass (a) == deltas_get_mass (b)
+          && memcmp (rng_a, rng_b, sizeof (rng_a)) == 0;
+      }
+      if (!ok)
+        fprintf (stderr, "Run %d washes over differently after %d updates\n",
+                 m, i + 1);
+
+      if (b)
+        deltas_destroy (b);
+      if (a)
+        deltas_destroy (a);
+    }
+
+    free (qs);
+  }
+
+  fprintf (stderr, "%d overwashes found\n", n_found);
+
+  for (m = 0; m < 3; m++)
+    if (models[m])
+      BMI_CEM_Finalize (models[m]);
+
+  return ok && n_found > 0;
+}
+
+/** TRUE if barriers run on N_THREADS threads stay the same as they do on
+one, update by update, grids, mass and random numbers
+
+The barriers are wide enough that their beach is shared out among the
+threads, both to move sand along it and to look for overwash, and have
+cells narrow enough for them to be washed over.  One has no halo, the
+other a wide one.  Each must be shared out, and find some overwash while
+it is, for the check to count.
+*/
+static int
+check_threads (void)
+{
+  int halo_widths[2] = { 0, WIDE_HALO };
+  int ok = TRUE;
+  int m;
+
+  for (m = 0; ok && m < 2; m++) {
+    BMI_Model *one = new_barrier (halo_widths[m], OVERWASH_CELL, THREADS_NY);
+    BMI_Model *many = new_barrier (halo_widths[m], OVERWASH_CELL, THREADS_NY);
+    State *p = (State *) many;
+    double *qs = NULL;
+    int n_shared = 0;
+    int n_found = 0;
+    int i;
+
+    ok = one && many;
+    if (ok) {
+      int len;
+
+      deltas_set_n_threads (many, N_THREADS);
+      ok = deltas_get_n_threads (many) == N_THREADS;
+
+      BMI_CEM_Get_var_point_count (one, "surface__elevation", &len);
+      qs = (double *) malloc (sizeof (double) * len);
+    }
+
+    for (i = 0; ok && i < OVERWASH_UPDATES; i++) {
+      uint64_t rng_one[4], rng_many[4];
+
+      update (one, qs, 1);
+      update (many, qs, 1);
+
+      deltas_get_rng_state (one, rng_one);
+      deltas_get_rng_state (many, rng_many);
+      ok = same_grids (one, many)
+        && deltas_get_mass (one) == deltas_get_mass (many)
+        && memcmp (rng_one, rng_many, sizeof (rng_one)) == 0;
+      if (!ok)
+        fprintf (stderr, "Run %d on %d threads differs after %d updates\n",
+                 m, N_THREADS, i + 1);
+
+      /* The update just shared out the shoreline it leaves behind */
+      if (p->TotalBeachCells - 2 >= 2 * BORDERS_PER_TASK) {
+        int k;
+
+        n_shared++;
+        for (k = 1; k < p->TotalBeachCells - 1; k++)
+          n_found += CanOverwash (p, k) && p->Overwashes[k].found;
+      }
+    }
+
+    fprintf (stderr, "Run %d shared out %d updates, finding %d overwashes\n",
+             m, n_shared, n_found);
+    ok = ok && n_shared > 0 && n_found > 0;
+
+    free (qs);
+    if (many)
+      BMI_CEM_Finalize (many);
+    if (one)
+      BMI_CEM_Finalize (one);
+  }
+
+  return ok;
+}
+
+/** One step of a line as the stepping loops of FindIfInShadow (up,
+distances compared as they are) and of AdjustShore, CheckOverwash and
+GetOverwashDepth (down, distances through Raise) took it, before they
+shared RayStep */
+static void
+old_step (double *x, double *y, double slope, int xsign, int ysign,
+          int *xtest, int *ytest)
+{
+  int NextXInt, NextYInt;
+  double Ynext, DistanceNext;
+  double Xside, DistanceSide;
+
+  if (ysign > 0)
+    NextYInt = floor (*y) + 1;
+  else
+    NextYInt = ceil (*y - 1);
+
+  if (xsign > 0) {
+    NextXInt = floor (*x) + 1;
+    Ynext = *y + (NextXInt - *x) * slope * ysign;
+    DistanceNext = ((Ynext - *y) * (Ynext - *y)
+                    + (NextXInt - *x) * (NextXInt - *x));
+    Xside = *x + fabs (NextYInt - *y) / slope;
+    DistanceSide = ((NextYInt - *y) * (NextYInt - *y)
+                    + (Xside - *x) * (Xside - *x));
+  }
+  else {
+    NextXInt = ceil (*x) - 1;
+    Ynext = *y + (*x - NextXInt) * slope * ysign;
+    DistanceNext =
+      Raise (((Ynext - *y) * (Ynext - *y) + (NextXInt - *x) * (NextXInt - *x)),
+             .5);
+    Xside = *x - fabs (NextYInt - *y) / slope;
+    DistanceSide =
+      Raise (((NextYInt - *y) * (NextYInt - *y) + (Xside - *x) * (Xside - *x)),
+             .5);
+  }
+
+  if (DistanceNext < DistanceSide) {
+    *x = NextXInt;
+    *y = Ynext;
+    *xtest = (xsign > 0) ? NextXInt : NextXInt - 1;
+    *ytest = floor (*y);
+  }
+  else {
+    *x = Xside;
+    *y = NextYInt;
+    *xtest = floor (*x);
+    *ytest = *y + (ysign - 1) / 2;
+  }
+}
+
+/** TRUE if RayStep takes the line from x, y along angle, up (xsign 1) as
+shadows are looked for or down as overwash and the shoreface are, through
+the cells, and to the places, the old loops did
+
+n_corners is counted up for each step where comparing the distances the
+other way would have gone into another cell.
+*/
+static int
+same_march (double x, double y, int ylo, double angle, int xsign, int ysign,
+            int *n_corners)
+{
+  double slope;
+  Ray ray;
+  int ok = TRUE;
+  int i;
+
+  if (angle == 0.0)
+    slope = 0.00001;
+  else if (fabs (angle) == 90.0)
+    slope = 9999.9;
+  else
+    slope = fabs (tan (angle));
+
+  RayStart (&ray, x, y, ylo, angle, xsign, ysign, xsign < 0);
+
+  for (i = 0; ok && i < RAY_STEPS; i++) {
+    Ray other = ray;
+    int xtest, ytest;
+
+    other.float_distances = !other.float_distances;
+    RayStep (&other);
+
+    RayStep (&ray);
+    old_step (&x, &y, slope, xsign, ysign, &xtest, &ytest);
+
+    ok = memcmp (&ray.x, &x, sizeof (double)) == 0
+      && memcmp (&ray.y, &y, sizeof (double)) == 0
+      && ray.xtest == xtest && ray.ytest == ytest + ylo;
+    if (!ok)
+      fprintf (stderr, "Step %d along %.17g goes to (%d, %d), not (%d, %d)\n",
+               i, angle, ray.xtest, ray.ytest, xtest, ytest + ylo);
+
+    *n_corners += other.xtest != ray.xtest || other.ytest != ray.ytest;
+  }
+
+  return ok;
+}
+
+/** TRUE if lines stepped with RayStep go where the old stepping loops
+went, bit for bit
+
+Lines are taken from a sandy and a barrier run, for every update, as the
+callers start them: for shadows from ShadowStartPoint along the wave
+angle, and toward land from each beach cell's shore along the shoreline
+angle, as overwash and the shoreface are looked for.  More are aimed to
+pass within rounding of a corner, where the way distances are compared
+decides the cell; some must.
+*/
+static int
+check_ray (void)
+{
+  BMI_Model *models[2] = { NULL, NULL };
+  const double misses[] = { 0., 1e-15, -1e-15, 1e-9, -1e-9, 1e-7, -1e-7 };
+  int n_corners = 0;
+  unsigned seed = 12345;
+  int ok;
+  int m;
+  int i;
+
+  BMI_CEM_Initialize (NULL, &models[0]);
+  models[1] = new_barrier (0, OVERWASH_CELL, BARRIER_NY);
+  ok = models[0] && models[1];
+
+  for (m = 0; ok && m < 2; m++) {
+    State *p = (State *) models[m];
+    int len;
+    double *qs;
+
+    BMI_CEM_Get_var_point_count (models[m], "surface__elevation", &len);
+    qs = (double *) malloc (sizeof (double) * len);
+
+    for (i = 0; ok && i < RAY_UPDATES; i++) {
+      int k;
+
+      update (models[m], qs, 1);
+
+      for (k = 1; ok && k < p->TotalBeachCells - 1; k++) {
+        const double angle = p->SurroundingAngle[k];
+        const double percent = p->PercentFull[p->X[k]][p->Y[k]];
+        const int ysign = (angle > 0) ? 1 : -1;
+        const int y = p->Y[k] - LINE_YLO (p);
+        double xin, yin;
+
+        ShadowStartPoint (p, k, &xin, &yin);
+        ok = same_march (xin, yin, LINE_YLO (p), p->WaveAngle, 1,
+                         (p->WaveAngle > 0) ? -1 : 1, &n_corners);
+
+        ok = ok
+          && same_march (p->X[k] + percent, y + .5, LINE_YLO (p), angle, -1,
+                         ysign, &n_corners)
+          && same_march (p->X[k] + .5, y + percent, LINE_YLO (p), angle, -1,
+                         ysign, &n_corners)
+          && same_march (p->X[k] + .5, y + 1. - percent, LINE_YLO (p), angle,
+                         -1, ysign, &n_corners);
+      }
+    }
+
+    free (qs);
+  }
+
+  /* From x0 the line reaches the next whole x just past corner (x, 0) */
+  for (i = 0; ok && i < N_NEAR_CORNER; i++) {
+    const int xsign = (i % 2) ? 1 : -1;
+    const int ysign = (i % 4 < 2) ? 1 : -1;
+    const double miss = misses[i % (sizeof (misses) / sizeof (misses[0]))];
+    double angle, slope, x0, run;
+
+    seed = seed * 1103515245 + 12345;
+    angle = (.05 + 1.45 * ((seed >> 8) % 65536) / 65536.) * (ysign > 0 ? 1 : -1);
+    seed = seed * 1103515245 + 12345;
+    run = .01 + .98 * ((seed >> 8) % 65536) / 65536.;
+
+    slope = fabs (tan (angle));
+    x0 = 10. - run * xsign;
+    ok = same_march (x0, -run * slope * ysign + miss, 0, angle, xsign, ysign,
+                     &n_corners);
+  }
+
+  fprintf (stderr, "%d steps would go another way comparing distances the "
+           "other way\n", n_corners);
+
+  for (m = 0; m < 2; m++)
+    if (models[m])
+      BMI_CEM_Finalize (models[m]);
+
+  return ok && n_corners > 0;
+}
+
+static int
+write_text (const char *path, const char *text)
+{
+  FILE *fp = fopen (path, "w");
+
+  if (!fp)
+    return FALSE;
+  fputs (text, fp);
+  return fclose (fp) == 0;
+}
+
+/** TRUE if cem_text reads the words of text as strtod and strtol would,
+each on the line it's on
+
+Words are read with cem_text_double, or cem_text_int if as_int.  Reading
+stops at the first word that isn't a number, which must be the bad word
+given (NULL if they all are), and must leave t there, on its line.
+*/
+static int
+same_as_strto (const char *text, const char *bad, int as_int)
+{
+  cem_text t;
+  const char *p = text;
+  size_t n_words = 0;
+  int line = 1;
+  int ok;
+
+  ok = write_text (TEXT_FILE, text) && cem_text_open (&t, TEXT_FILE);
+  if (!ok)
+    return FALSE;
+
+  for (;;) {
+    char word[128];
+    size_t len;
+    char *end;
+    int read;
+
+    for (; *p && strchr (" \t\r\n\v\f", *p); p++)
+      if (*p == '\n')
+        line++;
+    len = strcspn (p, " \t\r\n\v\f");
+    memcpy (word, p, len);
+    word[len] = '\0';
+
+    if (as_int) {
+      int value = 0;
+      long expected = strtol (word, &end, 10);
+
+      read = cem_text_int (&t, &value);
+      if (read)
+        ok = ok && value == expected;
+    }
+    else {
+      double value = 0.;
+      double expected = strtod (word, &end);
+
+      read = cem_text_double (&t, &value);
+      if (read)
+        ok = ok && memcmp (&value, &expected, sizeof (double)) == 0;
+    }
+    if (!ok)
+      fprintf (stderr, "%s read wrongly\n", word);
+
+    if (!read) {
+      ok = ok && (bad ? strcmp (word, bad) == 0 : len == 0)
+        && t.p == t.text + (p - text) && t.line == line;
+      if (!ok)
+        fprintf (stderr, "Stopped at \"%s\" line %d, not \"%s\" line %d\n",
+                 word, t.line, bad ? bad : "", line);
+      break;
+    }
+
+    n_words++;
+    p += len;
+    ok = ok && t.line == line;
+  }
+
+  ok = ok && (bad || cem_text_count (&t) == n_words);
+
+  cem_text_close (&t);
+  remove (TEXT_FILE);
+
+  return ok;
+}
+
+/** TRUE if cem_text reads numbers as strtod does, whitespace and all,
+and turns down what isn't one, or is too big for an int, where it is */
+static int
+check_text (void)
+{
+  const char *numbers =
+    "0.000000 1.000000\t0.883163\r\n-0.5  +2\n\n12. .25 -0 007\n"
+    "3.14159265358979 3.141592653589793238 123456789012345\f"
+    "1234567890123456 0.1000000000000000055511151231257827\n"
+    "1e3 -2.5E-3 inf nan 1e400 0.0000000000000000000001\v"
+    "0.00000000000000000000001 -123.456789 \n 99999999999999999999";
+  const char *not_numbers[] = {
+    "abc", "1.2.3", "-", "+", ".", "-.", "1-2", "--1", "1e", "12abc",
+    "0x", "1,5"
+  };
+  const char *ints = "0 42\n-7 +3\t007 2147483647\r\n-2147483648 ";
+  const char *not_ints[] = {
+    "3.5", "x", "-", "+", "2147483648", "-2147483649", "9999999999",
+    "12345678901", "4e2", "1-"
+  };
+  int ok = TRUE;
+  size_t i;
+
+  ok = ok && same_as_strto (numbers, NULL, FALSE);
+  ok = ok && same_as_strto (ints, NULL, TRUE);
+  ok = ok && same_as_strto ("", NULL, FALSE);
+  ok = ok && same_as_strto (" \n\t\n ", NULL, TRUE);
+
+  for (i = 0; ok && i < sizeof (not_numbers) / sizeof (not_numbers[0]); i++) {
+    char text[128];
+
+    sprintf (text, "1.5 -2\n  %s 7\n", not_numbers[i]);
+    ok = same_as_strto (text, not_numbers[i], FALSE);
+  }
+
+  for (i = 0; ok && i < sizeof (not_ints) / sizeof (not_ints[0]); i++) {
+    char text[128];
+
+    sprintf (text, "15\n\n-2 %s 7", not_ints[i]);
+    ok = same_as_strto (text, not_ints[i], TRUE);
+  }
+
+  if (ok) {
+    cem_text t;
+
+    remove (TEXT_FILE);
+    ok = !cem_text_open (&t, TEXT_FILE);
+  }
+
+  return ok;
+}
+
+/** Writes a sand file for p's grid, of n_values values of each cell,
+with bad in place of value i if it isn't NULL */
+static int
+write_sand (State * p, int n_values, long i, const char *bad)
+{
+  FILE *fp = fopen (TEXT_FILE, "w");
+  long n = 0;
+  int k;
+  int x,
+    y;
+
+  if (!fp)
+    return FALSE;
+
+  for (k = 0; k < n_values; k++)
+    for (y = 0; y < p->ny; y++)
+      for (x = 0; x < p->nx; x++, n++) {
+        if (bad && n == i)
+          fprintf (fp, " %s", bad);
+        else if (k == 0)
+          fprintf (fp, " %f", ((x * 7 + y * 13) % 101) / 100.);
+        else if (k == 1)
+          fprintf (fp, (x + y) % 2 ? " %f" : " %.17g",
+                   -((x + 2 * y) % 50) / 3.);
+        else
+          fprintf (fp, " %d", (x * y) % 1000);
+        if (x == p->nx - 1)
+          fputc ('\n', fp);
+      }
+
+  return fclose (fp) == 0;
+}
+
+/** TRUE if p's grid holds what write_sand writes for it */
+static int
+holds_sand (State * p)
+{
+  int ok = TRUE;
+  int x,
+    y;
+
+  for (y = 0; ok && y < p->ny; y++)
+    for (x = 0; ok && x < p->nx; x++) {
+      char text[64];
+      double percent;
+      double depth;
+
+      sprintf (text, "%f", ((x * 7 + y * 13) % 101) / 100.);
+      percent = strtod (text, NULL);
+      sprintf (text, (x + y) % 2 ? "%f" : "%.17g", -((x + 2 * y) % 50) / 3.);
+      depth = strtod (text, NULL);
+
+      ok = p->PercentFull[x][p->ny_lo + y] == percent
+        && p->CellDepth[x][p->ny_lo + y] == depth
+        && !IS_BEACH (p, x, p->ny_lo + y) == (percent < 1.)
+        && (!p->Age || p->Age[x][p->ny_lo + y] == (x * y) % 1000);
+    }
+
+  return ok && same_beach_rows (p);
+}
+
+/** TRUE if ReadSandFromFile reads back a grid of percents and depths,
+with or without ages, and turns down files that have too few or too many
+values, or a word that isn't a number, leaving the grid alone when the
+size is wrong */
+static int
+check_read_sand (void)
+{
+  BMI_Model *model = NULL;
+  BMI_Model *keep = NULL;
+  State *p;
+  char path[] = TEXT_FILE;
+  long n;
+  int ok;
+
+  BMI_CEM_Initialize (NULL, &model);
+  ok = model != NULL;
+  if (!ok)
+    return FALSE;
+  p = (State *) model;
+  n = (long) p->nx * p->ny;
+  deltas_set_read_file (model, path);
+
+  ok = write_sand (p, 2, -1, NULL) && ReadSandFromFile (p) && holds_sand (p);
+  ok = ok && write_sand (p, 3, -1, NULL) && ReadSandFromFile (p)
+    && holds_sand (p);
+  if (!ok)
+    fprintf (stderr, "Good sand files read wrongly\n");
+
+  keep = deltas_clone (model);
+  ok = ok && keep;
+  ok = ok && write_sand (p, 2, 2 * n - 1, "") && !ReadSandFromFile (p)
+    && same_grids (model, keep);
+  ok = ok && write_sand (p, 3, 3 * n - 1, "") && !ReadSandFromFile (p)
+    && same_grids (model, keep);
+  ok = ok && write_sand (p, 1, -1, NULL) && !ReadSandFromFile (p)
+    && same_grids (model, keep);
+  ok = ok && write_sand (p, 4, -1, NULL) && !ReadSandFromFile (p)
+    && same_grids (model, keep);
+  ok = ok && write_text (TEXT_FILE, "") && !ReadSandFromFile (p)
+    && same_grids (model, keep);
+  if (!ok)
+    fprintf (stderr, "Sand files of the wrong size read\n");
+
+  ok = ok && write_sand (p, 2, n / 2, "0.5x") && !ReadSandFromFile (p);
+  ok = ok && write_sand (p, 2, n + 3, "-") && !ReadSandFromFile (p);
+  ok = ok && write_sand (p, 3, 2 * n + 5, "1.5") && !ReadSandFromFile (p);
+  if (!ok)
+    fprintf (stderr, "Sand files with bad numbers read\n");
+
+  remove (TEXT_FILE);
+  ok = ok && !ReadSandFromFile (p);
+
+  if (keep)
+    deltas_destroy (keep);
+  BMI_CEM_Finalize (model);
+
+  return ok;
+}
+
+/** The model a configuration file of text sets up, or NULL */
+static BMI_Model *
+configured (const char *text)
+{
+  BMI_Model *self = NULL;
+
+  if (!write_text (TEXT_FILE, text) || BMI_CEM_Initialize (TEXT_FILE, &self))
+    self = NULL;
+  remove (TEXT_FILE);
+
+  return self;
+}
+
+/** TRUE if a configuration file's shoreface and shelf are set once the
+grid is built, as they always were, so the initial depths come from the
+default ones, and if a halo is still wide enough for the configured
+shoreface, which needs a wider one than the default */
+static int
+check_config (void)
+{
+  BMI_Model *plain = configured ("50, 200, 100., 1\n0.01, 10.0, 0.001\n");
+  BMI_Model *steep = configured ("50, 200, 100., 1\n0.01, 12.0, 0.002\n");
+  BMI_Model *halo = configured ("50, 200, 100., 1\n0.01, 12.0, 0.002\n1\n");
+  int ok = plain && steep && halo;
+
+  if (ok) {
+    State *p = (State *) halo;
+    int len;
+    double *a, *b, *c;
+
+    BMI_CEM_Get_var_point_count (plain, "sea_water__depth", &len);
+    a = (double *) malloc (sizeof (double) * len);
+    b = (double *) malloc (sizeof (double) * len);
+    c = (double *) malloc (sizeof (double) * len);
+    BMI_CEM_Get_double (plain, "sea_water__depth", a);
+    BMI_CEM_Get_double (steep, "sea_water__depth", b);
+    BMI_CEM_Get_double (halo, "sea_water__depth", c);
+
+    ok = memcmp (a, b, sizeof (double) * len) == 0
+      && memcmp (a, c, sizeof (double) * len) == 0
+      && p->shoreface_depth == 12. && p->shelf_slope == .002
+      && p->ny_lo >= deltas_halo_min_width (100., .01, 12.)
+      && deltas_halo_min_width (100., .01, 12.)
+         > deltas_halo_min_width (100., .01, 10.);
+
+    free (c);
+    free (b);
+    free (a);
+  }
+
+  if (halo)
+    BMI_CEM_Finalize (halo);
+  if (steep)
+    BMI_CEM_Finalize (steep);
+  if (plain)
+    BMI_CEM_Finalize (plain);
+
+  return ok;
+}
@@ -0,0 +1,241 @@
+/** \file
+
+\brief Fast reading of numbers from the model's text files.
+
+Grid files hold a value per cell, written with "%f", so a large grid
+is millions of short numbers.  Those are parsed here as a mantissa and a
+power of ten, which gives the same double strtod would whenever the
+mantissa has fewer than 16 digits.  Anything else - more digits, an
+exponent, nan - is handed to strtod.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "deltas_api.h"
+#include "deltas_text.h"
+
+#define TOKEN_MAX (64)  /**< Longest number passed to strtod */
+
+static const double powers_of_ten[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int
+is_space (char c)
+{
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v'
+    || c == '\f';
+}
+
+/** Opens path to read numbers from
+
+Returns FALSE if it can't be opened or read.
+*/
+int
+cem_text_open (cem_text * t, const char *path)
+{
+  struct stat st;
+  int fd;
+
+  memset (t, 0, sizeof (cem_text));
+  t->path = path;
+  t->line = 1;
+
+  fd = open (path, O_RDONLY);
+  if (fd < 0)
+    return FALSE;
+  if (fstat (fd, &st) != 0)
+  {
+    close (fd);
+    return FALSE;
+  }
+  t->len = st.st_size;
+
+  if (t->len > 0)
+  {
+    t->text = (char *)mmap (NULL, t->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    t->mapped = (t->text != (char *)MAP_FAILED);
+    if (t->mapped)
+      madvise (t->text, t->len, MADV_SEQUENTIAL);
+    else
+    {
+      size_t n = 0;
+
+      t->text = (char *)malloc (t->len);
+      while (n < t->len)
+      {
+        const ssize_t got = read (fd, t->text + n, t->len - n);
+
+        if (got <= 0)
+          break;
+        n += got;
+      }
+      t->len = n;
+    }
+  }
+  close (fd);
+
+  t->p = t->text;
+
+  return TRUE;
+}
+
+/** The number of whitespace separated words in the file */
+size_t
+cem_text_count (const cem_text * t)
+{
+  const char *p = t->text;
+  const char *end = t->text + t->len;
+  size_t n = 0;
+  int in_word = FALSE;
+
+  for (; p < end; p++)
+  {
+    if (is_space (*p))
+      in_word = FALSE;
+    else if (!in_word)
+    {
+      in_word = TRUE;
+      n++;
+    }
+  }
+
+  return n;
+}
+
+/* Moves t past whitespace, keeping count of lines.  Returns the end of
+   the word that follows. */
+static const char *
+next_word (cem_text * t)
+{
+  const char *end = t->text + t->len;
+  const char *p = t->p;
+
+  for (; p < end && is_space (*p); p++)
+    if (*p == '\n')
+      t->line++;
+  t->p = p;
+
+  for (; p < end && !is_space (*p); p++);
+
+  return p;
+}
+
+/** Reads the next number into value
+
+Returns FALSE, and leaves t at the word, if the next word isn't a number
+or there are no more.
+*/
+int
+cem_text_double (cem_text * t, double *value)
+{
+  const char *end = next_word (t);
+  const char *p = t->p;
+  uint64_t m = 0;
+  int n_digits = 0;
+  int n_places = 0;
+  int negative = FALSE;
+  int seen_digit = FALSE;
+
+  if (p == end)
+    return FALSE;
+
+  if (*p == '-' || *p == '+')
+    negative = (*p++ == '-');
+
+  for (; p < end && *p >= '0' && *p <= '9'; p++)
+  {
+    seen_digit = TRUE;
+    if (m > 0 || *p != '0')
+    {
+      m = m * 10 + (*p - '0');
+      n_digits++;
+    }
+  }
+  if (p < end && *p == '.')
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+      seen_digit = TRUE;
+      m = m * 10 + (*p - '0');
+      n_places++;
+      if (m > 0)
+        n_digits++;
+    }
+
+  if (p == end && seen_digit && n_digits < 16
+      && n_places < (int)(sizeof (powers_of_ten) / sizeof (double)))
+  {
+    *value = (double)m / powers_of_ten[n_places];
+    if (negative)
+      *value = -*value;
+  }
+  else
+  {
+    char word[TOKEN_MAX];
+    char *word_end;
+
+    if (end - t->p >= TOKEN_MAX)
+      return FALSE;
+    memcpy (word, t->p, end - t->p);
+    word[end - t->p] = '\0';
+
+    *value = strtod (word, &word_end);
+    if (word_end == word || *word_end != '\0')
+      return FALSE;
+  }
+
+  t->p = end;
+  return TRUE;
+}
+
+/** Reads the next whole number into value
+
+Returns FALSE, and leaves t at the word, if the next word isn't a whole
+number, is too big for an int, or there are no more.
+*/
+int
+cem_text_int (cem_text * t, int *value)
+{
+  const char *end = next_word (t);
+  const char *p = t->p;
+  long n = 0;
+  int negative = FALSE;
+
+  if (p < end && (*p == '-' || *p == '+'))
+    negative = (*p++ == '-');
+  if (p == end || end - p > 10)
+    return FALSE;
+
+  for (; p < end; p++)
+  {
+    if (*p < '0' || *p > '9')
+      return FALSE;
+    n = n * 10 + (*p - '0');
+  }
+  if (negative ? -n < INT_MIN : n > INT_MAX)
+    return FALSE;
+
+  *value = (int)(negative ? -n : n);
+  t->p = end;
+  return TRUE;
+}
+
+void
+cem_text_close (cem_text * t)
+{
+  if (t->mapped)
+    munmap (t->text, t->len);
+  else
+    free (t->text);
+  t->text = NULL;
+  t->len = 0;
+}
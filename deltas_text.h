@@ -0,0 +1,32 @@
+#if !defined( DELTAS_TEXT_H )
+#define DELTAS_TEXT_H
+
+#include <stddef.h>
+
+/** Whitespace separated numbers read from a text file.
+
+The file is mapped, or read whole where it can't be, and the numbers are
+parsed straight from memory rather than through stdio.
+*/
+typedef struct
+{
+  const char *path;
+  char *text;
+  size_t len;
+  int mapped;  /**< text is mapped rather than allocated */
+  const char *p;  /**< Next character to read */
+  int line;  /**< Line p is on, from 1 */
+}
+cem_text;
+
+int cem_text_open (cem_text * t, const char *path);
+
+size_t cem_text_count (const cem_text * t);
+
+int cem_text_double (cem_text * t, double *value);
+
+int cem_text_int (cem_text * t, int *value);
+
+void cem_text_close (cem_text * t);
+
+#endif
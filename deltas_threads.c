@@ -0,0 +1,180 @@
+/** \file
+
+\brief A persistent pool of threads for the parallel phases of a time step.
+*/
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "deltas_threads.h"
+
+struct _cem_pool
+{
+  int n_threads;
+  pthread_t *workers;
+
+  pthread_mutex_t lock;
+  pthread_cond_t start;  /**< Signaled when a new batch of tasks is posted */
+  pthread_cond_t done;   /**< Signaled when the last task of a batch finishes */
+
+  cem_task_func func;
+  void *data;
+  int n_tasks;
+  int next_task;  /**< Next task to hand out */
+  int n_done;  /**< Tasks of the batch that have finished */
+  int batch;  /**< Counts batches, so workers can tell a new one was posted */
+  int quit;
+};
+
+/** Hand out tasks of the current batch until there are none left.
+
+Called with the pool locked; returns with it locked.
+*/
+static void
+run_tasks (cem_pool * pool)
+{
+  while (pool->next_task < pool->n_tasks)
+  {
+    int task = pool->next_task++;
+
+    pthread_mutex_unlock (&pool->lock);
+    pool->func (pool->data, task);
+    pthread_mutex_lock (&pool->lock);
+
+    if (++pool->n_done == pool->n_tasks)
+      pthread_cond_broadcast (&pool->done);
+  }
+}
+
+static void *
+worker_main (void *arg)
+{
+  cem_pool *pool = (cem_pool *) arg;
+  int batch = 0;
+
+  pthread_mutex_lock (&pool->lock);
+  for (;;)
+  {
+    while (!pool->quit && pool->batch == batch)
+      pthread_cond_wait (&pool->start, &pool->lock);
+    if (pool->quit)
+      break;
+    batch = pool->batch;
+    run_tasks (pool);
+  }
+  pthread_mutex_unlock (&pool->lock);
+
+  return NULL;
+}
+
+/** A new pool of n_threads threads, or NULL if there's no memory for it
+*/
+cem_pool *
+cem_pool_new (int n_threads)
+{
+  cem_pool *pool = (cem_pool *) malloc (sizeof (cem_pool));
+  int i;
+
+  if (!pool)
+    return NULL;
+
+  if (n_threads < 1)
+    n_threads = 1;
+
+  pool->n_threads = n_threads;
+  pool->workers = (pthread_t *) malloc (sizeof (pthread_t) * n_threads);
+  if (!pool->workers)
+  {
+    free (pool);
+    return NULL;
+  }
+  pool->func = NULL;
+  pool->data = NULL;
+  pool->n_tasks = 0;
+  pool->next_task = 0;
+  pool->n_done = 0;
+  pool->batch = 0;
+  pool->quit = 0;
+
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->start, NULL);
+  pthread_cond_init (&pool->done, NULL);
+
+  for (i = 1; i < n_threads; i++)
+  {
+    if (pthread_create (&pool->workers[i], NULL, worker_main, pool) != 0)
+    {
+      pool->n_threads = i;
+      break;
+    }
+  }
+
+  return pool;
+}
+
+/** Run func(data, i) for i = 0 ... n_tasks-1 and wait for all of them.
+
+Tasks may run in any order and on any thread, so each one must only write
+to memory that no other task touches.
+*/
+void
+cem_pool_run (cem_pool * pool, int n_tasks, cem_task_func func, void *data)
+{
+  if (pool->n_threads == 1 || n_tasks <= 1)
+  {
+    int i;
+
+    for (i = 0; i < n_tasks; i++)
+      func (data, i);
+    return;
+  }
+
+  pthread_mutex_lock (&pool->lock);
+
+  pool->func = func;
+  pool->data = data;
+  pool->n_tasks = n_tasks;
+  pool->next_task = 0;
+  pool->n_done = 0;
+  pool->batch++;
+  pthread_cond_broadcast (&pool->start);
+
+  run_tasks (pool);
+  while (pool->n_done < pool->n_tasks)
+    pthread_cond_wait (&pool->done, &pool->lock);
+
+  pool->n_tasks = 0;
+  pool->next_task = 0;
+
+  pthread_mutex_unlock (&pool->lock);
+}
+
+int
+cem_pool_get_n_threads (cem_pool * pool)
+{
+  return pool->n_threads;
+}
+
+void
+cem_pool_free (cem_pool * pool)
+{
+  if (pool)
+  {
+    int i;
+
+    pthread_mutex_lock (&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast (&pool->start);
+    pthread_mutex_unlock (&pool->lock);
+
+    for (i = 1; i < pool->n_threads; i++)
+      pthread_join (pool->workers[i], NULL);
+
+    pthread_cond_destroy (&pool->done);
+    pthread_cond_destroy (&pool->start);
+    pthread_mutex_destroy (&pool->lock);
+
+    free (pool->workers);
+    free (pool);
+  }
+}
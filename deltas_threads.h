@@ -0,0 +1,22 @@
+#if !defined( DELTAS_THREADS_H )
+#define DELTAS_THREADS_H
+
+/** A small pool of worker threads that run numbered tasks.
+
+The calling thread takes tasks along with the workers, so a pool of
+n_threads starts n_threads-1 workers.
+*/
+typedef struct _cem_pool cem_pool;
+
+typedef void (*cem_task_func) (void *data, int task);
+
+cem_pool *cem_pool_new (int n_threads);
+
+void cem_pool_run (cem_pool * pool, int n_tasks, cem_task_func func,
+                   void *data);
+
+int cem_pool_get_n_threads (cem_pool * pool);
+
+void cem_pool_free (cem_pool * pool);
+
+#endif
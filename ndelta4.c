@@ -32,29 +32,35 @@ Program Notes:
 
 #include "deltas.h"
 
-#define DEBUG_ON
+#define DEBUG_ON  /**< Undefine to compile every trace away, whatever the categories below */
 
-#ifdef DEBUG_ON
-# if defined(__GNUC__)
-#  define DEBUG_PRINT( exp, format... ) { if (exp) fprintf(stderr,format); }
-# else
-static void
-DEBUG_PRINT (int exp, const char *format, ...)
-{
-  if (exp)
-  {
-    va_list args;
+/* Tracing.  Each DEBUG_ category below is one of TRACE_OFF, whose
+   statements (arguments and all) compile to nothing, TRACE_ON, or
+   TRACE_RUNTIME, which prints when its bit is in the mask given to
+   deltas_set_trace - a test of an int when it's clear. */
+#define TRACE_OFF (0)
+#define TRACE_ON  (1)
+#define TRACE_RUNTIME( bit ) ((_s)->trace & (bit))
 
-    va_start (args, format);
-    fprintf (stderr, format, args);
-    va_end (args);
-  }
-}
-# endif
+#ifdef DEBUG_ON
+# define DEBUG_PRINT( exp, ... ) \
+  do { if (exp) fprintf (stderr, __VA_ARGS__); } while (0)
 #else
-# define DEBUG_PRINT( exp, format... ) { }
+# define DEBUG_PRINT( exp, ... ) do { } while (0)
 #endif
 
+/* Profiling (see deltas_use_profile) - a test of a flag when it's off */
+#define PROFILE_START( s ) ((s)->profiling ? cem_profile_clock () : 0.)
+#define PROFILE_STOP( s, phase, t0 ) \
+  { if ((s)->profiling) { \
+      (s)->Profile.seconds[phase] += cem_profile_clock () - (t0); \
+      (s)->Profile.calls[phase]++; } }
+#define PROFILE_COUNT( s, event, n ) \
+  { if ((s)->profiling) (s)->Profile.events[event] += (n); }
+#define PROFILE_COUNT_SHARED( s, event, n ) \
+  { if ((s)->profiling) \
+      __sync_fetch_and_add (&(s)->Profile.events[event], (long) (n)); }
+
 /*  Run Control Parameters */
 #define TimeStep     (0.2)  /**< days - reflects rate of sediment transport per
                              time step */
@@ -90,13 +96,24 @@ DEBUG_PRINT (int exp, const char *format, ...)
 #define InitBeach       (30)    /**< cell where intial conditions changes from beach to ocean */
 #define InitialDepth    (9.0)   /**< theoretical depth in meters of continental shelf at x = InitBeach */
 #define LandHeight      (1.0)   /**< elevation of land above MHW  */
-#define InitCType       (0)     /**< type of initial conds 0 = sandy, 1 = barrier */
+#define InitCType       (0)     /**< type of initial conds 0 = sandy, 1 = barrier (see deltas_use_barrier) */
 #define InitBWidth      (4)     /**< initial minimum width of barrier (Cells) */
 #define OWType          (1)     /**< 0 = use depth array, 1 = use geometric rule */
 //#define OWMinDepth	(0.1)   /**<  littlest overwash of all */
 #define OWMinDepth	(5.0)
 #define FindCellError	(5)     /**< if we run off of array, how far over do we try again? */
 
+/* Neighbors packed into the FindNextCell lookup mask (up is +x, offshore) */
+#define NB_DOWN          (1 << 0)
+#define NB_DOWN_LEFT     (1 << 1)
+#define NB_DOWN_RIGHT    (1 << 2)
+#define NB_LEFT          (1 << 3)
+#define NB_RIGHT         (1 << 4)
+#define NB_UP            (1 << 5)
+#define NB_UP_LEFT       (1 << 6)
+#define NB_UP_RIGHT      (1 << 7)
+#define NEXT_CELL_ESCAPE (9)    /**< no table entry - use FindNextCellRules */
+
 /* Plotting Controls */
 #define CELL_PIXEL_SIZE (4)
 #define XPlotExtent     (Xmax)
@@ -116,21 +133,21 @@ DEBUG_PRINT (int exp, const char *format, ...)
 #define InitialSmooth     (0)    /**< Smooth starting conditions */
 #define WaveAngleSign     (0.7)    /**< used to change sign of wave angles */
 
-#define DEBUG_0   (0)  /**< Main program steps */
-#define DEBUG_1   (0)  /**< Find Next Cell */
-#define DEBUG_2   (0)  /**< Shadow Routine */
-#define DEBUG_3   (0)  /**< Determine Angles */
-#define DEBUG_4   (0)  /**< Upwind/Downwind */
-#define DEBUG_5   (0)  /**< Sediment Transport Decisions*/
-#define DEBUG_6   (0)  /**< Sediment Trans Calculations */
-#define DEBUG_7   (0)  /**< Transport Sweep (move sediment) */
-#define DEBUG_7A  (0)  /**< Slope Calcs */
-#define DEBUG_8   (0)  /**< Full/Empty */
-#define DEBUG_9   (0)  /**< FixBeach */
-#define DEBUG_10A (0)  /**< Overwash Tests*/
-#define DEBUG_10B (0)  /**< doing overwash (w/screen) */
-
-#define DEBUG_ERIC (0)  /**< EWHH Debug statements */
+#define DEBUG_0   (TRACE_RUNTIME (DELTAS_TRACE_STEPS))  /**< Main program steps */
+#define DEBUG_1   (TRACE_OFF)  /**< Find Next Cell */
+#define DEBUG_2   (TRACE_OFF)  /**< Shadow Routine */
+#define DEBUG_3   (TRACE_OFF)  /**< Determine Angles */
+#define DEBUG_4   (TRACE_OFF)  /**< Upwind/Downwind */
+#define DEBUG_5   (TRACE_OFF)  /**< Sediment Transport Decisions*/
+#define DEBUG_6   (TRACE_OFF)  /**< Sediment Trans Calculations */
+#define DEBUG_7   (TRACE_OFF)  /**< Transport Sweep (move sediment) */
+#define DEBUG_7A  (TRACE_OFF)  /**< Slope Calcs */
+#define DEBUG_8   (TRACE_OFF)  /**< Full/Empty */
+#define DEBUG_9   (TRACE_OFF)  /**< FixBeach */
+#define DEBUG_10A (TRACE_OFF)  /**< Overwash Tests*/
+#define DEBUG_10B (TRACE_RUNTIME (DELTAS_TRACE_OVERWASH))  /**< doing overwash (w/screen) */
+
+#define DEBUG_ERIC (TRACE_RUNTIME (DELTAS_TRACE_SETUP))  /**< EWHH Debug statements */
 int OWflag = 0;         /**< debugger */
 
 /* Universal Constants */
@@ -145,8 +162,9 @@ int OWflag = 0;         /**< debugger */
 #define SAVE_LINE_SPACING (1000) /**< space between saved line files */
 #define SAVE_FILE         (0)    /**< save full file? */
 #define SAVE_LINE         (0)    /**< Save line */
+#define OUTPUT_BUFFERS    (2)    /**< Saves that may be waiting to be written before the run waits for them */
 
-#define AGE_UPDATE        (10) /**< Time space for updating age of non-beach cells */
+#define MASS_RECOUNT_SPACING (0) /**< Time steps between full recounts to check the running mass (0 = never) */
 
 #define SED_TRANS_LIMIT (90) /**< beyond what absolute slope don't do sed trans (degrees)*/
 
@@ -155,17 +173,26 @@ int OWflag = 0;         /**< debugger */
 #define READ_WAVE_NAME "WIS_509_150.dat"
 #define AGE_SHADE_SPACING (10000) /**< For graphics - how many time steps means back to original shade */
 #define OVERWASH_LIMIT (75) /**< beyond what angle don't do overwash */
+#define RAY_SLACK      (1e-6) /**< cells - how far a stepped line may stray
+                                 from the exact one (see RayInBeach) */
 
 /* Function Prototypes */
 void AdjustShore (State * _s, int i);
 
-void AgeCells (State * _s);
-
 void ButtonEnter (State * _s);
 
 void CheckOverwash (State * _s, int icheck);
 
-void CheckOverwashSweep (State * _s);
+void FindOverwashTask (void *data, int task);
+
+void ApplyOverwash (State * _s, int icheck);
+
+void LogOverwashWrite (State * _s, int x, int y);
+void StopOverwashLog (State * _s);
+
+int OutputName (State * _s, char *buffer, const char *name);
+
+int OverwashLogged (State * _s, const Overwash * ow);
 
 void DeliverSediment (State * _s);
 
@@ -179,8 +206,6 @@ void ActualizeFluvialSed (State * _s, int xin, int yin, double Depth,
                           double SedIn);
 void DeliverSedimentFlux (State * _s);
 
-void DetermineAngles (State * _s);
-
 void DetermineSedTransport (State * _s);
 
 void DoOverwash (State * _s, int xfrom, int yfrom, int xto, int yto,
@@ -189,12 +214,17 @@ void FindBeachCells (State * _s, int YStart);
 
 char FindIfInShadow (State * _s, int icheck, int ShadMax);
 
-void FindNextCell (State * _s, int x, int y, int z);
-
 double FindWaveAngle (State * _s);
 
-void FixBeach (State * _s);
+void FixBeachCell (State * _s, int x, int y);
+void FixBeachWorklist (State * _s, int FixXMax, int sweepsign);
+void MarkCopiedCells (State * _s, double **grid, int x, int from, int to,
+                      int n);
+void QueueFixNeighbors (State * _s, int c, int FixXMax, int sweepsign,
+                        int after);
+void QueueFixCell (State * _s, int c, int FixXMax, int sweepsign, int after);
 
+double BackBarrierReach (State * _s);
 double GetOverwashDepth (State * _s, int xin, int yin, double xintto,
                         double yintto, int ishore);
 void GraphCells (State * _s);
@@ -204,6 +234,8 @@ void InitConds (State * _s);
 void InitPert (State * _s);
 
 double MassCount (State * _s);
+void AddMass (State * _s, double amount);
+void SetPercentFull (State * _s, int x, int y, double value);
 
 void OopsImEmpty (State * _s, int x, int y);
 
@@ -213,35 +245,38 @@ void OpenWindow (State * _s);
 
 void PauseRun (State * _s, int x, int y, int in);
 
-void PeriodicBoundaryCopy (State * _s);
-
 void PutPixel (State * _s, double x, double y, double R, double G, double B);
 
 void PrintLocalConds (State * _s, int x, int y, int in);
 
-double Raise (double b, double e);
+int RayInBeach (State * _s, const Ray * r, double xend);
 
-double RandZeroToOne ();
+double RandZeroToOne (State * _s);
 
-void ReadSandFromFile (State * _s);
 
 void ReadWaveIn (State * _s);
 
 void SaveSandToFile (State * _s);
 
 void SaveLineToFile (State * _s);
+void WriteSand (FILE * fp, const cem_output * out);
+int ArchiveSand (const cem_output * out);
+int AppendLine (const cem_output * out);
 
 void ScreenInit (State * _s);
 
-void SedTrans (State * _s, int From, int To, double ShoreAngle, char MaxT);
+void CountBarrierWidth (State * _s, int x, int y);
+int ReserveShoreCell (State * _s, int z);
 
-void ShadowSweep (State * _s);
+void BorderTransport (State * _s, int i);
+int BorderTasks (State * _s);
+void BorderTransportTask (void *data, int task);
+double SedTrans (State * _s, double ShoreAngle, char MaxT);
 
-void TransportSedimentSweep (State * _s);
 
-int XMaxBeach (State * _s, int Max);
+void TransportSedimentSweep (State * _s);
 
-void ZeroVars (State * _s);
+int RowBeachCount (State * _s, int x);
 
 void
 deltas_init_state (State * s)
@@ -256,6 +291,12 @@ deltas_init_state (State * s)
   s->shoreface_slope = ShorefaceSlope;
   s->shoreface_depth = DepthShoreface;
   s->shelf_slope = ShelfSlope;
+  s->exact_refraction = FALSE;
+  s->exact_overwash = FALSE;
+  s->track_age = FALSE;
+  s->init_barrier = (InitCType == 1);
+  s->RefractHeight = -1.;
+  s->RefractPeriod = -1.;
 /*
    s->river_flux = (double*)malloc (sizeof(double)*_s->nx*2*_s->ny);
    s->river_x = (int*)malloc (sizeof(int)*_s->nx*2*_s->ny);
@@ -268,6 +309,7 @@ deltas_init_state (State * s)
   s->river_x_ind = NULL;
   s->river_y_ind = NULL;
   s->n_rivers = 0;
+  s->river_cap = 0;
 
   // NOTE: This is no longer being used.
   s->stream_spot = StreamSpot;
@@ -280,6 +322,13 @@ deltas_init_state (State * s)
 */
   s->savefilename = NULL;
   s->readfilename = NULL;
+  s->archivename = NULL;
+  s->archive = NULL;
+  s->shorelinename = NULL;
+  s->shoreline_polyline = FALSE;
+  s->shoreline = NULL;
+  s->shoreline_failed = FALSE;
+  s->member = -1;
 
   s->CurrentTimeStep = 0;
 
@@ -292,12 +341,39 @@ deltas_init_state (State * s)
   s->external_waves = FALSE;
   s->WaveAngle = 0.;
 
+  s->n_threads = 1;
+  s->pool = NULL;
+  s->writer = NULL;
+  s->profiling = FALSE;
+  memset (&s->Profile, 0, sizeof (Deltas_profile));
+  s->trace = 0;
+
   s->FindStart = 0;
 
   s->FellOffArray = 0;
 
+  s->ShorelineValid = 'n';
+  s->NumShoreDirty = 0;
+
+  s->FixAll = TRUE;
+  s->FixScannedXMax = 0;
+  s->FixList = NULL;
+  s->NumFix = 0;
+  s->FixListCap = 0;
+  s->FixBits = NULL;
+  s->FixQueue = NULL;
+  s->NumFixQueued = 0;
+  s->FixQueueCap = 0;
+  s->FixQueued = NULL;
+
+  s->OverwashLog = NULL;
+  s->NumOverwashLog = -1;
+  s->OverwashLogCap = 0;
+  s->OverwashBits = NULL;
+
   s->MassInitial = 0.;
   s->MassCurrent = 0.;
+  s->MassError = 0.;
 
   s->NumWaveBins = 0.;
 
@@ -312,9 +388,8 @@ deltas_init_state (State * s)
       j;
 
     for (i = 0; i < _s->nx; i++)
-      for (j = 0; j < 2 * _s->ny; j++)
+      for (j = 0; j < _s->ny_grid; j++)
       {
-        s->AllBeach[i][j] = '\0';
         s->PercentFull[i][j] = 0.;
         s->Age[i][j] = 0;
         s->CellDepth[i][j] = 0.;
@@ -336,24 +411,42 @@ deltas_init_state (State * s)
 #endif
   s->nx = 0;
   s->ny = 0;
+  s->ny_lo = 0;
+  s->ny_grid = 0;
+  s->halo_width = 0;
+  s->max_beach_len = 0;
+  s->shore_cap = 0;
+  s->ShoreTraced = 0;
 
-  s->AllBeach = NULL;
   s->PercentFull = NULL;
   s->Age = NULL;
   s->CellDepth = NULL;
   s->InitDepth = NULL;
+  s->BeachBits = NULL;
+  s->BeachRowCount = NULL;
+  s->BarrierWidth = NULL;
+  s->BeachRowMax = -1;
+  s->GridBlock = NULL;
+  s->GridBytes = 0;
+  s->GridMapped = FALSE;
 
   s->X = NULL;
   s->Y = NULL;
+  s->OldX = NULL;
+  s->OldY = NULL;
   s->InShadow = NULL;
   s->ShorelineAngle = NULL;
   s->SurroundingAngle = NULL;
   s->UpWind = NULL;
   s->VolumeIn = NULL;
   s->VolumeOut = NULL;
+  s->BorderFrom = NULL;
+  s->BorderTo = NULL;
+  s->BorderFlux = NULL;
+  s->Overwashes = NULL;
 
-  s->state = (char *)malloc (sizeof (char) * 256);
-  initstate (44, s->state, 256);
+  s->seed = SEED;
+  cem_rng_seed (&s->rng, s->seed);
 
   return;
 }
@@ -365,32 +458,183 @@ deltas_free_state (State * s)
     free (s->savefilename);
   if (s->readfilename)
     free (s->readfilename);
+  free (s->archivename);
+  free (s->shorelinename);
   free (s->river_flux);
   free (s->river_x);
   free (s->river_y);
   free (s->river_x_ind);
   free (s->river_y_ind);
 
+  free (s->X);
+  free (s->Y);
+  free (s->OldX);
+  free (s->OldY);
+  free (s->InShadow);
+  free (s->ShorelineAngle);
+  free (s->SurroundingAngle);
+  free (s->UpWind);
+  free (s->VolumeIn);
+  free (s->VolumeOut);
+  free (s->BorderFrom);
+  free (s->BorderTo);
+  free (s->BorderFlux);
+  free (s->Overwashes);
+  free (s->FixList);
+  free (s->FixQueue);
+  free (s->OverwashLog);
+  free (s->OverwashBits);
+
+  cem_pool_free (s->pool);
+  s->pool = NULL;
+  cem_writer_free (s->writer);
+  s->writer = NULL;
+  cem_archive_close (s->archive);
+  s->archive = NULL;
+  cem_shoreline_close (s->shoreline);
+  s->shoreline = NULL;
+
   return;
 }
 
+/* Grows the array *p points to to size bytes, leaving it as it was if
+   there isn't room */
+int
+deltas_grow_array (void *p, size_t size)
+{
+  void **array = (void **) p;
+  void *grown = realloc (*array, size);
+
+  if (!grown)
+    return FALSE;
+  *array = grown;
+  return TRUE;
+}
+
+/** Makes sure the shoreline arrays have room for len cells
+
+The arrays grow by doubling.  New entries are given the values ZeroVars
+and FindShoreline reset them to, so only the first _s->ShoreTraced
+entries ever need resetting.
+
+Returns FALSE, with s->shore_cap as it was, if there isn't room.  Arrays
+that did grow keep their new size, which does no harm.
+*/
+int
+deltas_reserve_shoreline (State * s, int len)
+{
+  int cap = (s->shore_cap > 0) ? s->shore_cap : 64;
+  int z;
+
+  if (len <= s->shore_cap)
+    return TRUE;
+
+  while (cap < len)
+    cap *= 2;
+
+  if (!deltas_grow_array (&s->X, sizeof (int) * cap)
+      || !deltas_grow_array (&s->Y, sizeof (int) * cap)
+      || !deltas_grow_array (&s->OldX, sizeof (int) * cap)
+      || !deltas_grow_array (&s->OldY, sizeof (int) * cap)
+      || !deltas_grow_array (&s->InShadow, sizeof (char) * cap)
+      || !deltas_grow_array (&s->ShorelineAngle, sizeof (double) * cap)
+      || !deltas_grow_array (&s->SurroundingAngle, sizeof (double) * cap)
+      || !deltas_grow_array (&s->UpWind, sizeof (char) * cap)
+      || !deltas_grow_array (&s->VolumeIn, sizeof (double) * cap)
+      || !deltas_grow_array (&s->VolumeOut, sizeof (double) * cap)
+      || !deltas_grow_array (&s->BorderFrom, sizeof (int) * cap)
+      || !deltas_grow_array (&s->BorderTo, sizeof (int) * cap)
+      || !deltas_grow_array (&s->BorderFlux, sizeof (double) * cap)
+      || !deltas_grow_array (&s->Overwashes, sizeof (Overwash) * cap))
+  {
+    fprintf (stderr, "*** Unable to make room for %d shoreline cells\n",
+             cap);
+    return FALSE;
+  }
+
+  for (z = s->shore_cap; z < cap; z++)
+  {
+    s->X[z] = -1;
+    s->Y[z] = -1;
+    s->InShadow[z] = '?';
+    s->ShorelineAngle[z] = -999;
+    s->SurroundingAngle[z] = -998;
+    s->UpWind[z] = '?';
+    s->VolumeIn[z] = 0;
+    s->VolumeOut[z] = 0;
+  }
+
+  s->shore_cap = cap;
+
+  return TRUE;
+}
+
+/** The narrowest the wrap regions can be (see deltas_set_halo_width) for
+cells cell_width wide and the shoreface given
+
+A halo has to reach past the longest line run out from a beach cell of
+the domain - the line out to the shoreface depth (AdjustShore), or the
+one across the barrier (FindOverwash) followed by the search for the back
+of the barrier (GetOverwashDepth) - and HALO_MARGIN cells more for the
+shoreline neighbors each cell looks at.  Shadow lines stop at the edge of
+the domain, so they don't need any.
+*/
+int
+deltas_halo_min_width (double cell_width, double shoreface_slope,
+                       double shoreface_depth)
+{
+  const double shoreface = shoreface_depth / cell_width / shoreface_slope;
+  const double overwash = CritBWidth / cell_width + 2 * shoreface;  /* BackBarrierReach */
+
+  return (int) ceil (fmax (shoreface, overwash)) + HALO_MARGIN;
+}
+
+/** How far along the coast, in cells, GetOverwashDepth looks for the back
+of a barrier when the grid has a halo
+
+Past twice the width of the shoreface a back barrier that isn't on the
+shoreline is as deep as the shoreface anyway, so the search stops there
+as it does at the ends of the grid.  That keeps it inside the halo.  The
+default wrap regions let it run on to the ends of the grid, as it always
+has.
+*/
+double
+BackBarrierReach (State * _s)
+{
+  return 2 * _s->shoreface_depth / _s->cell_width / _s->shoreface_slope;
+}
+
+/** Notes that shoreline cell z is about to be written, making room for it
+and the cell after it
+
+Returns FALSE if there isn't room, and the trace has to stop.
+*/
+int
+ReserveShoreCell (State * _s, int z)
+{
+  if (z >= _s->ShoreTraced)
+  {
+    if (z + 2 > _s->shore_cap && !deltas_reserve_shoreline (_s, z + 2))
+      return FALSE;
+    _s->ShoreTraced = z + 1;
+  }
+  return TRUE;
+}
+
 /** Initialize variables for a simulation.
 
 */
 int
 _cem_initialize (State * _s)
 {       /* Initialize Variables and Device */
-  int seed = 44;
-
-  char StartFromFile = 'n';     /* start from saved file? */
+  char StartFromFile =          /* start from saved file? */
+    _s->readfilename ? 'y' : 'n';
 
   _s->CurrentTimeStep = 0;
 
   _s->ShadowXMax = _s->nx - 5;
 
-  //srandom(seed);
-  setstate (_s->state);
-  srandom (SEED);
+  cem_rng_seed (&_s->rng, _s->seed);
 
   /* Start from file or not? */
   if (PromptStart == 'y')
@@ -421,9 +665,9 @@ _cem_initialize (State * _s)
       printf ("InitConds OK \n");
     }
   }
-  else if (StartFromFile == 'y')
+  else if (StartFromFile == 'y' && ReadSandFromFile (_s))
   {
-    ReadSandFromFile (_s);
+    DEBUG_PRINT (DEBUG_ERIC, "Read %s\n", _s->readfilename);
   }
   else
   {
@@ -443,11 +687,19 @@ _cem_initialize (State * _s)
   /* Count Initial Mass */
 
   DEBUG_PRINT (DEBUG_ERIC, "Set periodic boundary conditions\n");
+  /* The initial conditions were written straight into the grid */
+  _s->FixAll = TRUE;
+
   PeriodicBoundaryCopy (_s);
   DEBUG_PRINT (DEBUG_ERIC, "Fix beach\n");
   FixBeach (_s);
   DEBUG_PRINT (DEBUG_ERIC, "Add up initial mass\n");
   _s->MassInitial = MassCount (_s);
+  _s->MassCurrent = _s->MassInitial;
+  _s->MassError = 0.;
+
+  /* No shoreline has been traced for these conditions yet */
+  _s->ShorelineValid = 'n';
 
   /*if (SaveLine)
      SaveLineToFile();
@@ -461,7 +713,7 @@ _cem_initialize (State * _s)
     _s->xcellwidth = 2.0 / (2.0 * (double)XPlotExtent) * (CELL_PIXEL_SIZE) / 2.0;
     _s->ycellwidth = 2.0 / (2.0 * (double)YPlotExtent) * (CELL_PIXEL_SIZE) / 2.0;
     _s->xplotoff = 0;
-    _s->yplotoff = _s->ny / 2;
+    _s->yplotoff = _s->ny_lo;
 
     OpenWindow (_s);
 
@@ -491,13 +743,8 @@ _cem_run_until (State * _s, int until)
 
   int SaveLine = SAVE_LINE;
 
-  int AgeUpdate = AGE_UPDATE;
-
   int StopAfter = until;
 
-  //setstate( _s->state );
-  //srandom( SEED );
-
   DEBUG_PRINT (DEBUG_ERIC, "*** DELTAS: Current time step = %d\n",
                _s->CurrentTimeStep);
   DEBUG_PRINT (DEBUG_ERIC, "*** DELTAS: Run until = %d\n", until);
@@ -534,42 +781,15 @@ _cem_run_until (State * _s, int until)
       {
         printf ("==== WaveAngle: %2.2f:  MASS Percent: %1.4f:  Time Step: %d\n",
                 180 * (_s->WaveAngle) / M_PI,
-                _s->MassCurrent / _s->MassInitial, _s->CurrentTimeStep);
+                (_s->MassCurrent + _s->MassError) / _s->MassInitial,
+                _s->CurrentTimeStep);
       }
 
       PeriodicBoundaryCopy (_s);
 
       ZeroVars (_s);
-      /* Initialize for Find Beach Cells  (make sure strange beach does not cause trouble */
-
-      _s->FellOffArray = 'y';
-      _s->FindStart = 1;
-
-      /*  Look for beach - if you fall off of array, bump over a little and try again */
-
-      while (_s->FellOffArray == 'y')
-      {
-        DEBUG_PRINT (DEBUG_ERIC, "Find beach cells\n");
-        FindBeachCells (_s, _s->FindStart);
-        /*printf("FoundCells: %d GetO = %c \n", _s->FindStart,_s->FellOffArray); */
-        _s->FindStart += FindCellError;
-        if (_s->FellOffArray == 'y')
-        {
-          /*printf("NOODLE  !!!!!FoundCells: %d GetO = %c \n", _s->FindStart,_s->FellOffArray); */
-          /*PauseRun(1,1,-1); */
-        }
-
-        /* Get Out if no good beach spots exist - finish program */
-
-        if (_s->FindStart > _s->ny / 2 + 1)
-        {
-          printf ("Stopped Finding Beach - done %d %d", _s->FindStart,
-                  _s->ny / 2 - 5);
-          fflush (stdout);
-          SaveSandToFile (_s);
-          return 1;
-        }
-      }
+      if (!FindShoreline (_s))
+        return 1;
 
       DEBUG_PRINT (DEBUG_ERIC, "Deliver sediment\n");
       if (_s->use_sed_flux)
@@ -582,39 +802,8 @@ _cem_run_until (State * _s, int until)
 
       DEBUG_PRINT (DEBUG_ERIC, "Zero vars\n");
       ZeroVars (_s);
-
-      /* Initialize for Find Beach Cells  (make sure strange beach does not cause trouble */
-
-      _s->FellOffArray = 'y';
-      _s->FindStart = 1;
-
-      /*  Look for beach - if you fall off of array, bump over a little and try again */
-
-      while (_s->FellOffArray == 'y')
-      {
-        DEBUG_PRINT (DEBUG_ERIC, "Find beach cells, again\n");
-        FindBeachCells (_s, _s->FindStart);
-        /*printf("FoundCells: %d GetO = %c \n", _s->FindStart,_s->FellOffArray); */
-        _s->FindStart += FindCellError;
-        if (_s->FellOffArray == 'y')
-        {
-          /*printf("NOODLE  !!!!!FoundCells: %d GetO = %c \n", _s->FindStart,_s->FellOffArray); */
-          /*PauseRun(1,1,-1); */
-        }
-
-        /* Get Out if no good beach spots exist - finish program */
-
-        if (_s->FindStart > _s->ny / 2 + 1)
-        {
-          printf ("Stopped Finding Beach - done %d %d", _s->FindStart,
-                  _s->ny / 2 - 5);
-          fprintf (stderr, "Stopped Finding Beach - done %d %d",
-                   _s->FindStart, _s->ny / 2 - 5);
-          fflush (stderr);
-          SaveSandToFile (_s);
-          return 1;
-        }
-      }
+      if (!FindShoreline (_s))
+        return 1;
 
       /* printf("Foundbeach!: %d \n", _s->CurrentTimeStep); */
 
@@ -639,35 +828,8 @@ _cem_run_until (State * _s, int until)
       /* because shoreline config may have been changed, need to refind shoreline and recalc angles */
 
       ZeroVars (_s);
-      /* Initialize for Find Beach Cells  (make sure strange beach does not cause trouble */
-
-      _s->FellOffArray = 'y';
-      _s->FindStart = 1;
-
-      /*  Look for beach - if you fall off of array, bump over a little and try again */
-
-      while (_s->FellOffArray == 'y')
-      {
-        FindBeachCells (_s, _s->FindStart);
-        /*printf("FoundCells: %d GetO = %c \n", _s->FindStart,_s->FellOffArray); */
-        _s->FindStart += FindCellError;
-        if (_s->FellOffArray == 'y')
-        {
-          /*printf("NOODLE  !!!!!FoundCells: %d GetO = %c \n", _s->FindStart,_s->FellOffArray); */
-          /*PauseRun(1,1,-1); */
-        }
-
-        /* Get Out if no good beach spots exist - finish program */
-
-        if (_s->FindStart > _s->ny / 2 + 1)
-        {
-          printf ("Stopped Finding Beach - done %d %d", _s->FindStart,
-                  _s->ny / 2 - 5);
-          fflush (stdout);
-          SaveSandToFile (_s);
-          return 1;
-        }
-      }
+      if (!FindShoreline (_s))
+        return 1;
 
       /* printf("Foundbeach!: %d \n", _s->CurrentTimeStep); */
 
@@ -686,14 +848,24 @@ _cem_run_until (State * _s, int until)
 
       DEBUG_PRINT (DEBUG_0, "End of Time Step: %d \n", _s->CurrentTimeStep);
 
-      /* Age Empty Cells */
-
-      if ((_s->CurrentTimeStep % AgeUpdate == 0) && SaveAge)
-        AgeCells (_s);
+      /* Check the running mass against a full count */
 
-      /* Count Mass */
+#if MASS_RECOUNT_SPACING
+      if (_s->CurrentTimeStep % MASS_RECOUNT_SPACING == 0)
+      {
+        const double Mass = MassCount (_s);
 
-      _s->MassCurrent = MassCount (_s);
+        if (fabs (Mass - (_s->MassCurrent + _s->MassError)) >
+            1e-9 * _s->MassInitial)
+        {
+          fprintf (stderr, "Mass has drifted by %g at time step %d\n",
+                   _s->MassCurrent + _s->MassError - Mass,
+                   _s->CurrentTimeStep);
+        }
+        _s->MassCurrent = Mass;
+        _s->MassError = 0.;
+      }
+#endif
 
       /* GRAPHING */
 
@@ -718,7 +890,7 @@ _cem_run_until (State * _s, int until)
 		SaveSandToFile( _s );
 	    }
 */
-      if (SaveFile)
+      if (SaveFile || _s->archivename)
         if (_s->CurrentTimeStep % SaveSpacing == 0 &&
             _s->CurrentTimeStep >= StartSavingAt)
           SaveSandToFile (_s);
@@ -729,7 +901,9 @@ _cem_run_until (State * _s, int until)
 		SaveLineToFile( _s );
 	    }
 */
-      if (SaveLine)
+      if (_s->shorelinename)
+        SaveLineToFile (_s);
+      else if (SaveLine)
         if (_s->CurrentTimeStep % SaveLineSpacing == 0 &&
             _s->CurrentTimeStep >= StartSavingAt)
           SaveLineToFile (_s);
@@ -746,9 +920,13 @@ _cem_run_until (State * _s, int until)
 int
 _cem_finalize (State * _s)
 {
+  if (_s->writer && cem_writer_flush (_s->writer) > 0)
+  {
+    printf ("Run Complete, but some output files couldn't be written\n");
+    return FALSE;
+  }
   if (_s->savefilename)
     printf ("Run Complete.  Output file: %s\n", _s->savefilename);
-  free (_s->state);
   return TRUE;
 }
 
@@ -785,8 +963,8 @@ FindWaveAngle (State * _s)
   if (WAVE_IN)
   {
 
-    RandBin = RandZeroToOne ();
-    RandAngle = RandZeroToOne ();
+    RandBin = RandZeroToOne (_s);
+    RandAngle = RandZeroToOne (_s);
 
     /*printf("Time = %d RandBin = %f RandAng = %f\n",_s->CurrentTimeStep, RandBin, RandAngle); */
 
@@ -817,7 +995,7 @@ FindWaveAngle (State * _s)
     /*      variable Asym will determine fractional distribution of waves coming from the           */
     /*      positive direction (positive direction coming from left)  -i.e. fractional wave asymmetry */
 
-    AsymRandom = RandZeroToOne ();
+    AsymRandom = RandZeroToOne (_s);
 
     if (AsymRandom <= _s->angle_asymmetry)
       Sign = 1;
@@ -827,7 +1005,7 @@ FindWaveAngle (State * _s)
     /*  Determine wave angle */
     /*  New formulation - even distribution */
 
-    AngleRandom = RandZeroToOne ();
+    AngleRandom = RandZeroToOne (_s);
 
     if (AngleRandom > _s->angle_highness)
     {
@@ -850,6 +1028,273 @@ FindWaveAngle (State * _s)
 
 }
 
+/**
+Finds the shoreline for the next sweep along the beach.
+
+The shoreline found for the previous sweep is kept between sweeps.  If it
+is still good, only the stretch of it next to cells whose AllBeach flag
+has flipped since is traced again (RetraceShoreline).  Otherwise the whole
+beach is found from scratch with FindBeachCells - if we fall off of the
+array, bump over a little and try again.
+
+This function will affect and determine the global arrays:  _s->X[] and _s->Y[]
+Returns FALSE if no good beach spots exist.
+*/
+int
+FindShoreline (State * _s)
+{
+  const double t0 = PROFILE_START (_s);
+  int z;
+
+  if (_s->ShorelineValid == 'y' && RetraceShoreline (_s))
+  {
+    _s->NumShoreDirty = 0;
+    PROFILE_STOP (_s, DELTAS_PHASE_FIND_BEACH, t0);
+    return TRUE;
+  }
+
+  for (z = 0; z < _s->ShoreTraced; z++)
+  {
+    _s->X[z] = -1;
+    _s->Y[z] = -1;
+  }
+  _s->ShoreTraced = 0;
+
+  /* Initialize for Find Beach Cells  (make sure strange beach does not cause trouble */
+
+  _s->FellOffArray = 'y';
+  _s->FindStart = 1;
+
+  /*  Look for beach - if you fall off of array, bump over a little and try again */
+
+  while (_s->FellOffArray == 'y')
+  {
+    DEBUG_PRINT (DEBUG_ERIC, "Find beach cells\n");
+    FindBeachCells (_s, _s->FindStart);
+    _s->FindStart += FindCellError;
+
+    /* Get Out if no good beach spots exist - finish program */
+
+    if (_s->FindStart > _s->ny_lo + 1)
+    {
+      printf ("Stopped Finding Beach - done %d %d", _s->FindStart,
+              _s->ny_lo - 5);
+      fflush (stdout);
+      SaveSandToFile (_s);
+      _s->ShorelineValid = 'n';
+      PROFILE_STOP (_s, DELTAS_PHASE_FIND_BEACH, t0);
+      return FALSE;
+    }
+  }
+
+  /* Only a beach found on the first try can be retraced - a later search */
+  /* might find it from further left */
+
+  if (_s->FindStart == 1 + FindCellError)
+    _s->ShorelineValid = 'y';
+  else
+    _s->ShorelineValid = 'n';
+  _s->NumShoreDirty = 0;
+
+  PROFILE_STOP (_s, DELTAS_PHASE_FIND_BEACH, t0);
+  return TRUE;
+}
+
+/**
+Brings the shoreline of the previous sweep up to date with the cells whose
+AllBeach flag has flipped since it was traced.
+
+FindNextCell only looks at the cells surrounding the current one (and the
+one we came from), so the old shoreline holds up to the first cell next to
+a flipped one.  From there we trace again until we are back on the old
+shoreline past the last cell next to a flipped one, coming from the same
+cell, and splice the rest of the old shoreline back on.
+
+Returns FALSE if the beach has to be found from scratch.
+*/
+int
+RetraceShoreline (State * _s)
+{
+  const int n = _s->TotalBeachCells;
+
+  int xmin,
+    xmax,
+    ymin,
+    ymax;                       /* box around flipped cells and neighbors */
+
+  int first = -1,
+    last = -1;                  /* first and last cells next to a flip */
+
+  int i,
+    j,
+    k,
+    z;
+
+  if (_s->NumShoreDirty == 0)
+    return TRUE;
+
+  xmin = xmax = _s->ShoreDirtyX[0];
+  ymin = ymax = _s->ShoreDirtyY[0];
+  for (k = 0; k < _s->NumShoreDirty; k++)
+  {
+    /* A flip in the starting column may move the starting cell */
+    if (_s->ShoreDirtyY[k] == _s->Y[0])
+      return FALSE;
+
+    if (_s->ShoreDirtyX[k] < xmin)
+      xmin = _s->ShoreDirtyX[k];
+    if (_s->ShoreDirtyX[k] > xmax)
+      xmax = _s->ShoreDirtyX[k];
+    if (_s->ShoreDirtyY[k] < ymin)
+      ymin = _s->ShoreDirtyY[k];
+    if (_s->ShoreDirtyY[k] > ymax)
+      ymax = _s->ShoreDirtyY[k];
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    if (_s->X[i] < xmin - 1 || _s->X[i] > xmax + 1 ||
+        _s->Y[i] < ymin - 1 || _s->Y[i] > ymax + 1)
+      continue;
+
+    for (k = 0; k < _s->NumShoreDirty; k++)
+      if (abs (_s->X[i] - _s->ShoreDirtyX[k]) <= 1
+          && abs (_s->Y[i] - _s->ShoreDirtyY[k]) <= 1)
+      {
+        if (first < 0)
+          first = i;
+        last = i;
+        break;
+      }
+  }
+
+  if (first < 0)
+    return TRUE;
+  if (first == 0)
+    return FALSE;
+
+  DEBUG_PRINT (DEBUG_1, "Retrace: %d to %d of %d\n", first, last, n);
+
+  for (i = first; i < n; i++)
+  {
+    _s->OldX[i] = _s->X[i];
+    _s->OldY[i] = _s->Y[i];
+  }
+
+  for (z = first + 1; z < _s->max_beach_len && _s->Y[z - 1] < _s->ny_grid - 1;
+       z++)
+  {
+    _s->NextX = -2;
+    _s->NextY = -2;
+
+    FindNextCell (_s, _s->X[z - 1], _s->Y[z - 1], z - 1);
+    if (!ReserveShoreCell (_s, z))
+      return FALSE;
+    _s->X[z] = _s->NextX;
+    _s->Y[z] = _s->NextY;
+
+    DEBUG_PRINT (DEBUG_1, "* _s->NextX: %3d  _s->NextY: %3d  z: %d \n",
+                 _s->NextX, _s->NextY, z);
+
+    if (_s->PercentFull[_s->X[z]][_s->Y[z]] == 0)
+    {
+      printf ("\nFINDBEACH: PercentFull Zero x: %d y: %d\n", _s->X[z],
+              _s->Y[z]);
+    }
+
+    if ((_s->NextY < 1)
+        || ((_s->NextY == _s->Y[0]) && (_s->NextX == _s->X[0]))
+        || (z > _s->max_beach_len - 2))
+      return FALSE;
+
+    /* Back on the old shoreline? */
+
+    for (j = last + 1; j < n && j <= last + SHORE_REJOIN_WINDOW; j++)
+      if (_s->OldX[j] == _s->X[z] && _s->OldY[j] == _s->Y[z]
+          && _s->OldX[j - 1] == _s->X[z - 1]
+          && _s->OldY[j - 1] == _s->Y[z - 1])
+        break;
+
+    if (j < n && j <= last + SHORE_REJOIN_WINDOW)
+    {
+      if (z + n - j > _s->max_beach_len - 1)
+        return FALSE;
+
+      if (!ReserveShoreCell (_s, z + n - j - 1))
+        return FALSE;
+      for (k = j + 1; k < n; k++)
+      {
+        _s->X[z + k - j] = _s->OldX[k];
+        _s->Y[z + k - j] = _s->OldY[k];
+      }
+      z += n - j;
+      break;
+    }
+  }
+
+  for (i = z; i < n; i++)
+  {
+    _s->X[i] = -1;
+    _s->Y[i] = -1;
+  }
+
+  _s->TotalBeachCells = z;
+
+  DEBUG_PRINT (DEBUG_1, "Total Beach: %d  \n \n", _s->TotalBeachCells);
+
+  return TRUE;
+}
+
+/** Sets the AllBeach flag of a cell to flag, 'y' or 'n'
+
+The flags are the bits of _s->BeachBits, read with IS_BEACH.  Cells that
+flip are remembered so that the shoreline can be retraced around them
+(see RetraceShoreline).  This is the only place the flags are written,
+so the row counts and _s->BarrierWidth always match them.
+*/
+void
+SetAllBeach (State * _s, int x, int y, char flag)
+{
+  const int i = CELL_INDEX (_s, x, y);
+  const uint64_t bit = (uint64_t) 1 << (i % 64);
+
+  if (IS_BEACH (_s, x, y) == (flag == 'y'))
+    return;
+
+  LogOverwashWrite (_s, x, y);
+
+  if (flag == 'y')
+  {
+    _s->BeachBits[i / 64] |= bit;
+    _s->BeachRowCount[x]++;
+    if (x > _s->BeachRowMax)
+      _s->BeachRowMax = x;
+  }
+  else
+  {
+    _s->BeachBits[i / 64] &= ~bit;
+    _s->BeachRowCount[x]--;
+    while (_s->BeachRowMax >= 0 && _s->BeachRowCount[_s->BeachRowMax] == 0)
+      _s->BeachRowMax--;
+  }
+
+  CountBarrierWidth (_s, x, y);
+
+  MarkFixCell (_s, x, y);
+
+  if (_s->ShorelineValid == 'y')
+  {
+    if (_s->NumShoreDirty < SHORE_DIRTY_MAX)
+    {
+      _s->ShoreDirtyX[_s->NumShoreDirty] = x;
+      _s->ShoreDirtyY[_s->NumShoreDirty] = y;
+      _s->NumShoreDirty++;
+    }
+    else
+      _s->ShorelineValid = 'n';
+  }
+}
+
 /**
 Determines locations of beach cells moving from left to right direction
 This function will affect and determine the global arrays:  _s->X[] and _s->Y[]
@@ -868,23 +1313,28 @@ FindBeachCells (State * _s, int YStart)
 
     fprintf (stderr, "***\n");
     for (i = 0; i < _s->nx; i++)
-      fprintf (stderr, "[%d][250] = %c\n", i, _s->AllBeach[i][250]);
+      fprintf (stderr, "[%d][250] = %c\n", i, IS_BEACH (_s, i, 250) ? 'y' : 'n');
     fprintf (stderr, "***\n");
   }
-  fprintf (stderr, "-> [29][250] = %c\n", _s->AllBeach[29][250]);
+  fprintf (stderr, "-> [29][250] = %c\n", IS_BEACH (_s, 29, 250) ? 'y' : 'n');
 #endif
   /* Starting at left end, find the x - value for first cell that is 'allbeach' */
 
   xstart = _s->nx - 1;
   y = YStart;
 
-  while (_s->AllBeach[xstart][y] == 'n')
+  while (!IS_BEACH (_s, xstart, y))
   {
     xstart -= 1;
   }
 
   xstart += 1;  /* Step back to where partially full beach */
 
+  if (!ReserveShoreCell (_s, 0))
+  {
+    _s->FellOffArray = 'y';
+    return;
+  }
   _s->X[0] = xstart;
   _s->Y[0] = YStart;
 
@@ -895,19 +1345,26 @@ FindBeachCells (State * _s, int YStart)
 /*
   z = 0;
 
-  while ((_s->Y[z] < 2 * _s->ny - 1) && (z < _s->max_beach_len - 1))
+  while ((_s->Y[z] < _s->ny_grid - 1) && (z < _s->max_beach_len - 1))
   {
     z++;
 */
-  //fprintf (stderr, "-> [29][250] = %c\n", _s->AllBeach[29][250]);
+  //fprintf (stderr, "-> [29][250] = %c\n", IS_BEACH (_s, 29, 250) ? 'y' : 'n');
   //for (z=1; z<_s->max_beach_len && _s->Y[z]<2*_s->ny-1 ; z++)
-  for (z = 1; z < _s->max_beach_len && _s->Y[z - 1] < 2 * _s->ny - 1; z++)
+  for (z = 1; z < _s->max_beach_len && _s->Y[z - 1] < _s->ny_grid - 1; z++)
   {
     _s->NextX = -2;
     _s->NextY = -2;
 
     FindNextCell (_s, _s->X[z - 1], _s->Y[z - 1], z - 1);
-    //fprintf (stderr, "-> [29][250] = %c\n", _s->AllBeach[29][250]);
+    //fprintf (stderr, "-> [29][250] = %c\n", IS_BEACH (_s, 29, 250) ? 'y' : 'n');
+    if (!ReserveShoreCell (_s, z))
+    {
+      /* Out of memory - give up on this start as if we fell off */
+      _s->FellOffArray = 'y';
+      ZeroVars (_s);
+      return;
+    }
     _s->X[z] = _s->NextX;
     _s->Y[z] = _s->NextY;
 
@@ -963,101 +1420,178 @@ fprintf (stderr, "max_beach_len = %d\n", _s->max_beach_len);
 
 }
 
+/**
+The step FindNextCell takes for each mask of surrounding beach cells -
+FindNextCellRules worked out for every case that doesn't depend on the
+cell we came from.  NEXT_CELL_ESCAPE (9) marks the cases left to the rules.
+*/
+static const signed char NextCellDx[256] = {
+   9, -1,  9, -1,  0,  0,  0,  0, -1, -1, -1, -1, -1,  0, -1,  0,
+   1,  1,  1,  1,  1,  1,  1,  1,  9,  1,  9,  1,  9,  1,  9,  1,
+   1,  9,  1,  9,  1,  9,  1,  9, -1,  9, -1,  9, -1,  9, -1,  9,
+   9,  9,  1,  9,  9,  9,  1,  9,  9,  9,  9,  9,  9,  9,  9,  9,
+   9, -1,  9, -1,  0,  0,  0,  0, -1, -1, -1, -1, -1,  0, -1,  0,
+   1,  1,  1,  1,  1,  1,  1,  1,  9,  1,  9,  1,  9,  1,  9,  1,
+   0,  9,  0,  9,  0,  9,  0,  9, -1,  9, -1,  9, -1,  9, -1,  9,
+   0,  9,  0,  9,  0,  9,  0,  9,  9,  9,  9,  9,  9,  9,  9,  9,
+   9, -1,  9, -1,  0,  0,  0,  0, -1, -1, -1, -1, -1,  0, -1,  0,
+   1,  1,  1,  1,  1,  1,  1,  1,  9,  1,  9,  1,  9,  1,  9,  1,
+   1,  9,  1,  9,  1,  9,  1,  9, -1,  9, -1,  9, -1,  9, -1,  9,
+   9,  9,  1,  9,  9,  9,  1,  9,  9,  9,  9,  9,  9,  9,  9,  9,
+   9, -1,  9, -1,  0,  0,  0,  0, -1, -1, -1, -1, -1,  0, -1,  0,
+   1,  1,  1,  1,  1,  1,  1,  1,  9,  1,  9,  1,  9,  1,  9,  1,
+   0,  9,  0,  9,  0,  9,  0,  9, -1,  9, -1,  9, -1,  9, -1,  9,
+   0,  9,  0,  9,  0,  9,  0,  9,  9,  9,  9,  9,  9,  9,  9,  9
+};
+
+static const signed char NextCellDy[256] = {
+   9,  1,  9,  1,  1,  1,  1,  1, -1,  1,  0,  1, -1,  1,  0,  1,
+   1,  1,  1,  1,  1,  1,  1,  1,  9,  1,  9,  1,  9,  1,  9,  1,
+  -1,  9, -1,  9, -1,  9, -1,  9, -1,  9,  0,  9, -1,  9,  0,  9,
+   9,  9, -1,  9,  9,  9, -1,  9,  9,  9,  9,  9,  9,  9,  9,  9,
+   9,  1,  9,  1,  1,  1,  1,  1, -1,  1,  0,  1, -1,  1,  0,  1,
+   1,  1,  1,  1,  1,  1,  1,  1,  9,  1,  9,  1,  9,  1,  9,  1,
+  -1,  9, -1,  9, -1,  9, -1,  9, -1,  9,  0,  9, -1,  9,  0,  9,
+  -1,  9, -1,  9, -1,  9, -1,  9,  9,  9,  9,  9,  9,  9,  9,  9,
+   9,  1,  9,  1,  1,  1,  1,  1, -1,  1,  0,  1, -1,  1,  0,  1,
+   0,  0,  0,  0,  0,  0,  0,  0,  9,  0,  9,  0,  9,  0,  9,  0,
+  -1,  9, -1,  9, -1,  9, -1,  9, -1,  9,  0,  9, -1,  9,  0,  9,
+   9,  9, -1,  9,  9,  9, -1,  9,  9,  9,  9,  9,  9,  9,  9,  9,
+   9,  1,  9,  1,  1,  1,  1,  1, -1,  1,  0,  1, -1,  1,  0,  1,
+   0,  0,  0,  0,  0,  0,  0,  0,  9,  0,  9,  0,  9,  0,  9,  0,
+  -1,  9, -1,  9, -1,  9, -1,  9, -1,  9,  0,  9, -1,  9,  0,  9,
+  -1,  9, -1,  9, -1,  9, -1,  9,  9,  9,  9,  9,  9,  9,  9,  9
+};
+
 /**
 Function to find next cell that is beach moving in the general positive X
 direction changes global variables _s->NextX and _s->NextY, coordinates for the
 next beach cell
 
-This function will use but not affect the global arrays:  AllBeach [][],
+The AllBeach flags of the eight surrounding cells are packed into a mask
+and the step looked up in NextCellDx[] and NextCellDy[], wrapping around
+the ends of the row as the neighbors do.  Cases that depend on which
+cell we came from are left to FindNextCellRules.
+
+This function will use but not affect the global arrays:  _s->BeachBits,
 _s->X[], and _s->Y[]
 */
 void
 FindNextCell (State * _s, const int x, const int y, const int z)
 {
-  const int y_left = (y == 0) ? 2 * _s->ny - 1 : y - 1;
+  const int y_left = (y == 0) ? _s->ny_grid - 1 : y - 1;
 
-  const int y_right = (y == 2 * _s->ny - 1) ? 0 : y + 1;
+  const int y_right = (y == _s->ny_grid - 1) ? 0 : y + 1;
 
-//  const int y_left = y-1;
-//  const int y_right = y+1;
+  int mask;
 
   if (x <= 0)
     fprintf (stderr, "ERROR: x<=0 (%d)\n", x);
   if (x >= _s->nx - 1)
     fprintf (stderr, "ERROR: x>=%d (%d)\n", _s->nx - 1, x);
 
-  if (_s->AllBeach[x - 1][y] == 'n')
-    /* No beach directly beneath cell */
+  mask = IS_BEACH (_s, x - 1, y) * NB_DOWN
+    | IS_BEACH (_s, x - 1, y_left) * NB_DOWN_LEFT
+    | IS_BEACH (_s, x - 1, y_right) * NB_DOWN_RIGHT
+    | IS_BEACH (_s, x, y_left) * NB_LEFT
+    | IS_BEACH (_s, x, y_right) * NB_RIGHT
+    | IS_BEACH (_s, x + 1, y) * NB_UP
+    | IS_BEACH (_s, x + 1, y_left) * NB_UP_LEFT
+    | IS_BEACH (_s, x + 1, y_right) * NB_UP_RIGHT;
+
+  if (NextCellDx[mask] != NEXT_CELL_ESCAPE)
+  {
+    _s->NextX = x + NextCellDx[mask];
+    _s->NextY = (NextCellDy[mask] < 0) ? y_left
+      : (NextCellDy[mask] > 0) ? y_right : y;
+    return;
+  }
+
+  FindNextCellRules (_s, x, y, z);
+}
+
+/**
+The rules FindNextCell follows to find the next beach cell, for the cases
+it can not look up.
+
+This function will use but not affect the global arrays:  _s->BeachBits,
+_s->X[], and _s->Y[]
+*/
+void
+FindNextCellRules (State * _s, const int x, const int y, const int z)
+{
+  const int y_left = (y == 0) ? _s->ny_grid - 1 : y - 1;
+
+  const int y_right = (y == _s->ny_grid - 1) ? 0 : y + 1;
+
+  if (!IS_BEACH (_s, x - 1, y))
+    /* No beach directly beneath cell */
   {
-    if (_s->AllBeach[x][y_left] == 'y' && _s->AllBeach[x][y_right] == 'n')
+    if (IS_BEACH (_s, x, y_left) && !IS_BEACH (_s, x, y_right))
       /* If on right side of protuberance */
     {
-      if (_s->AllBeach[x - 1][y_left] == 'y')
+      if (IS_BEACH (_s, x - 1, y_left))
       { /* Move one inshore */
         _s->NextX = x - 1;
         _s->NextY = y;
         return;
       }
-      else if (_s->AllBeach[x - 1][y_left] == 'n')      /* This is where shadow procedure was */
+      else if (!IS_BEACH (_s, x - 1, y_left))      /* This is where shadow procedure was */
       { /* Back and to the left */
         _s->NextX = x - 1;
-        _s->NextY = y - 1;
-        //_s->NextY = y_left;
+        _s->NextY = y_left;
         return;
       }
       printf ("Should've found next cell (1): %d, %d \n", x, y);
       PauseRun (_s, x, y, z);
     }
 
-    else if (_s->AllBeach[x][y_left] == 'n' && _s->AllBeach[x][y_right] == 'y')
+    else if (!IS_BEACH (_s, x, y_left) && IS_BEACH (_s, x, y_right))
       /* If on left side of protuberance */
     {
-      if (_s->AllBeach[x + 1][y_right] == 'n' && _s->AllBeach[x + 1][y] == 'n')
+      if (!IS_BEACH (_s, x + 1, y_right) && !IS_BEACH (_s, x + 1, y))
         /*  Up and right - move around spit end */
       {
         _s->NextX = x + 1;
-        _s->NextY = y + 1;
-        //_s->NextY = y_right;
+        _s->NextY = y_right;
         return;
       }
 
-      else if (_s->AllBeach[x + 1][y] == 'y')
+      else if (IS_BEACH (_s, x + 1, y))
         /*  On underside of regular or diagonally thin spit */
       {
-        if (_s->AllBeach[x + 1][y_left] == 'n'
-            && _s->AllBeach[x - 1][y_left] == 'n' && _s->X[z - 1] > x)
+        if (!IS_BEACH (_s, x + 1, y_left)
+            && !IS_BEACH (_s, x - 1, y_left) && _s->X[z - 1] > x)
           /* Reaching end of spit - not going in circles */
         {
           _s->NextX = x - 1;
           _s->NextY = y;
           return;
         }
-        else if (_s->AllBeach[x + 1][y_left] == 'n')
+        else if (!IS_BEACH (_s, x + 1, y_left))
           /* This is reaching end of spit */
         {
           _s->NextX = x + 1;
-          _s->NextY = y - 1;
-          //_s->NextY = y_left;
+          _s->NextY = y_left;
           return;
         }
         /* Moving along back side of spit */
         {
           _s->NextX = x;
-          _s->NextY = y - 1;
-          //_s->NextY = y_left;
+          _s->NextY = y_left;
           return;
         }
       }
 
-      else if (_s->AllBeach[x + 1][y_right] == 'y')
-        /* we know ( _s->AllBeach[x+1][y] == 'n') */
+      else if (IS_BEACH (_s, x + 1, y_right))
+        /* we know ( !IS_BEACH (_s, x+1, y)) */
         /* Moving straight up */
         /* NEW - we still don't want to go in */
       {
         //fprintf (stderr, "***\n");
-        //fprintf (stderr, "[%d][%d] == %c\n", x-1, y_right, _s->AllBeach[x - 1][y_right]);
-        //fprintf (stderr, "[%d][%d] == %c\n", x, y_right, _s->AllBeach[x][y_right]);
-        //fprintf (stderr, "[%d][%d] == %c\n", x+1, y_right, _s->AllBeach[x + 1][y_right]);
+        //fprintf (stderr, "[%d][%d] == %c\n", x-1, y_right, IS_BEACH (_s, x - 1, y_right) ? 'y' : 'n');
+        //fprintf (stderr, "[%d][%d] == %c\n", x, y_right, IS_BEACH (_s, x, y_right) ? 'y' : 'n');
+        //fprintf (stderr, "[%d][%d] == %c\n", x+1, y_right, IS_BEACH (_s, x + 1, y_right) ? 'y' : 'n');
         _s->NextX = x + 1;
         _s->NextY = y;
         return;
@@ -1067,42 +1601,39 @@ FindNextCell (State * _s, const int x, const int y, const int z)
       PauseRun (_s, x, y, z);
     }
 
-    if (_s->AllBeach[x][y_left] == 'n' && _s->AllBeach[x][y_right] == 'n')
+    if (!IS_BEACH (_s, x, y_left) && !IS_BEACH (_s, x, y_right))
       /* Hanging out - nothing on sides or top - maybe on corner? */
     {
-      if (_s->AllBeach[x - 1][y_right] == 'y' && _s->AllBeach[x + 1][y] == 'n')
+      if (IS_BEACH (_s, x - 1, y_right) && !IS_BEACH (_s, x + 1, y))
         /* On left corner of protuberence, move right */
       {
         _s->NextX = x;
-        _s->NextY = y + 1;
-        //_s->NextY = y_right;
+        _s->NextY = y_right;
         return;
       }
 
-      else if (_s->AllBeach[x + 1][y] == 'y'
-               && _s->AllBeach[x + 1][y_left] == 'n')
+      else if (IS_BEACH (_s, x + 1, y)
+               && !IS_BEACH (_s, x + 1, y_left))
         /* Under protuberance, move around to left and up  */
       {
         _s->NextX = x + 1;
-        _s->NextY = y - 1;
-        //_s->NextY = y_left;
+        _s->NextY = y_left;
         return;
       }
 
-      else if (_s->AllBeach[x + 1][y] == 'y'
-               && _s->AllBeach[x + 1][y_left] == 'y')
+      else if (IS_BEACH (_s, x + 1, y)
+               && IS_BEACH (_s, x + 1, y_left))
         /* Under protuberance, move to left */
       {
         _s->NextX = x;
-        _s->NextY = y - 1;
-        //_s->NextY = y_left;
+        _s->NextY = y_left;
         return;
       }
       printf ("Should've found next cell (3): %d, %d \n", x, y);
       PauseRun (_s, x, y, z);
     }
 
-    else if (_s->AllBeach[x][y_left] == 'y' && _s->AllBeach[x][y_right] == 'y')
+    else if (IS_BEACH (_s, x, y_left) && IS_BEACH (_s, x, y_right))
       /* thin entrance between spits.  Don't even think about going in there */
       /* (Similar case to over head and underneath - don't go in */
       /* check to see which way we were coming in - from below or from side       */
@@ -1110,56 +1641,52 @@ FindNextCell (State * _s, const int x, const int y, const int z)
       if (_s->X[z - 1] > x)
         /* coming from above */
       {
-        if (_s->AllBeach[x + 1][y_right] == 'n')
+        if (!IS_BEACH (_s, x + 1, y_right))
           /* Move right and up */
         {
           _s->NextX = x + 1;
-          _s->NextY = y + 1;
-          //_s->NextY = y_right;
+          _s->NextY = y_right;
           return;
         }
-        else if (_s->AllBeach[x + 1][y] == 'n')
+        else if (!IS_BEACH (_s, x + 1, y))
           /* Straight up */
         {
           _s->NextX = x + 1;
           _s->NextY = y;
           return;
         }
-        else if (_s->AllBeach[x + 1][y_left] == 'n')
+        else if (!IS_BEACH (_s, x + 1, y_left))
           /* Up and left */
           /* shouldn't need this, this where coming from */
         {
           _s->NextX = x + 1;
-          _s->NextY = y - 1;
-          //_s->NextY = y_left;
+          _s->NextY = y_left;
           return;
         }
       }
       else if (_s->X[z - 1] < x)
         /* coming from below */
       {
-        if (_s->AllBeach[x - 1][y_left] == 'n')
+        if (!IS_BEACH (_s, x - 1, y_left))
           /* move down and left */
         {
           _s->NextX = x - 1;
-          _s->NextY = y - 1;
-          //_s->NextY = y_left;
+          _s->NextY = y_left;
           return;
         }
-        else if (_s->AllBeach[x - 1][y] == 'n')
+        else if (!IS_BEACH (_s, x - 1, y))
           /*move straight down */
         {
           _s->NextX = x - 1;
           _s->NextY = y;
           return;
         }
-        else if (_s->AllBeach[x - 1][y_right] == 'n')
+        else if (!IS_BEACH (_s, x - 1, y_right))
           /*move straight down */
           /* shouldn't need this, this would be where coming from */
         {
           _s->NextX = x - 1;
-          _s->NextY = y + 1;
-          //_s->NextY = y_right;
+          _s->NextY = y_right;
           return;
         }
       }
@@ -1171,26 +1698,24 @@ FindNextCell (State * _s, const int x, const int y, const int z)
     PauseRun (_s, x, y, z);
   }
 
-  else if (_s->AllBeach[x - 1][y] == 'y' && _s->AllBeach[x + 1][y] == 'n')
+  else if (IS_BEACH (_s, x - 1, y) && !IS_BEACH (_s, x + 1, y))
     /* There is beach beneath cell, nothing over the head */
   {
-    if (_s->AllBeach[x][y_right] == 'n')
+    if (!IS_BEACH (_s, x, y_right))
       /*  Adjacent Cell to right is vacant */
     {
-      if (_s->AllBeach[x - 1][y_right] == 'y')
+      if (IS_BEACH (_s, x - 1, y_right))
         /* move straight right */
       {
         _s->NextX = x;
-        _s->NextY = y + 1;
-        //_s->NextY = y_right;
+        _s->NextY = y_right;
         return;
       }
-      else if (_s->AllBeach[x - 1][y_right] == 'n')
+      else if (!IS_BEACH (_s, x - 1, y_right))
         /* Move down and to right */
       {
         _s->NextX = x - 1;
-        _s->NextY = y + 1;
-        //_s->NextY = y_right;
+        _s->NextY = y_right;
         return;
       }
 
@@ -1198,19 +1723,18 @@ FindNextCell (State * _s, const int x, const int y, const int z)
       PauseRun (_s, x, y, z);
     }
 
-    else if (_s->AllBeach[x][y_right] == 'y')
+    else if (IS_BEACH (_s, x, y_right))
       /*Brad's note : DON'T REALLY NEED TO REPEAT THIS (WORKS SAME IN BOTH CASES) */
       /* Right neighbor occupied */
     {
-      if (_s->AllBeach[x + 1][y_right] == 'n')
+      if (!IS_BEACH (_s, x + 1, y_right))
         /* Move up and to right */
       {
         _s->NextX = x + 1;
-        _s->NextY = y + 1;
-        //_s->NextY = y_right;
+        _s->NextY = y_right;
         return;
       }
-      else if (_s->AllBeach[x + 1][y_right] == 'y')
+      else if (IS_BEACH (_s, x + 1, y_right))
         /* Move straight up */
       {
         _s->NextX = x + 1;
@@ -1226,7 +1750,7 @@ FindNextCell (State * _s, const int x, const int y, const int z)
     PauseRun (_s, x, y, z);
   }
 
-  else if ((_s->AllBeach[x - 1][y] == 'y') && (_s->AllBeach[x + 1][y] == 'y'))
+  else if ((IS_BEACH (_s, x - 1, y)) && (IS_BEACH (_s, x + 1, y)))
     /* There is beach behind cell, and over the head don't want to go in (will be shadowed anyway */
     /* Need to use last cell to find out if going into left or right enclosure */
   {
@@ -1237,28 +1761,25 @@ FindNextCell (State * _s, const int x, const int y, const int z)
     if (_s->Y[z - 1] < y)
       /* Moving towards right, bump up and over the problem */
     {
-      if (_s->AllBeach[x + 1][y_left] == 'n')
+      if (!IS_BEACH (_s, x + 1, y_left))
         /* Move up and to the left */
       {
         _s->NextX = x + 1;
-        _s->NextY = y - 1;
-        //_s->NextY = y_left;
+        _s->NextY = y_left;
         return;
       }
-      else if (_s->AllBeach[x][y_left] == 'n')
+      else if (!IS_BEACH (_s, x, y_left))
         /* Move directly left */
       {
         _s->NextX = x;
-        _s->NextY = y - 1;
-        //_s->NextY = y_left;
+        _s->NextY = y_left;
         return;
       }
-      else if (_s->AllBeach[x - 1][y_left] == 'n')
+      else if (!IS_BEACH (_s, x - 1, y_left))
         /* Move left and down */
       {
         _s->NextX = x - 1;
-        _s->NextY = y - 1;
-        //_s->NextY = y_left;
+        _s->NextY = y_left;
         return;
       }
       printf ("Should've found next cell (8): %d, %d \n", x, y);
@@ -1268,28 +1789,25 @@ FindNextCell (State * _s, const int x, const int y, const int z)
     else if (_s->Y[z - 1] > y)
       /* Moving towards left, go back right */
     {
-      if (_s->AllBeach[x - 1][y_right] == 'n')
+      if (!IS_BEACH (_s, x - 1, y_right))
         /* Move down and to the right */
       {
         _s->NextX = x - 1;
-        _s->NextY = y + 1;
-        //_s->NextY = y_right;
+        _s->NextY = y_right;
         return;
       }
-      else if (_s->AllBeach[x][y_right] == 'n')
+      else if (!IS_BEACH (_s, x, y_right))
         /* Move directly right */
       {
         _s->NextX = x;
-        _s->NextY = y + 1;
-        //_s->NextY = y_right;
+        _s->NextY = y_right;
         return;
       }
-      else if (_s->AllBeach[x + 1][y_right] == 'n')
+      else if (!IS_BEACH (_s, x + 1, y_right))
         /* Move right and up */
       {
         _s->NextX = x + 1;
-        _s->NextY = y + 1;
-        //_s->NextY = y_right;
+        _s->NextY = y_right;
         return;
       }
       printf ("Should've found next cell (8): %d, %d \n", x, y);
@@ -1308,9 +1826,9 @@ FindNextCell (State * _s, const int x, const int y, const int z)
 *  When thin entrance is discovered, fill it up *
 	
 {
-if (_s->AllBeach[X][Y+2*LorR] == 'n')
+if (!IS_BEACH (_s, X, Y+2*LorR))
 {
-    _s->AllBeach[X][Y+2*LorR] = 'y';
+    SetAllBeach (_s, X, Y+2*LorR, 'y');
     _s->PercentFull[X][Y+2*LorR] = 1;
     printf("!!!!!!!!!!!!!!!!!\n		FILLEDERUP: %d, %d, %d \n", X, Y, LorR);
 }	
@@ -1325,6 +1843,7 @@ This function will use but not adjust the variable:  _s->TotalBeachCells
 void
 ShadowSweep (State * _s)
 {
+  const double t0 = PROFILE_START (_s);
 
   int i;
 
@@ -1344,46 +1863,109 @@ ShadowSweep (State * _s)
     _s->InShadow[i] = FindIfInShadow (_s, i, _s->ShadowXMax);
   }
 
+  PROFILE_STOP (_s, DELTAS_PHASE_SHADOW, t0);
 }
 
 /** Finds extent of beach in x direction.
 
 Starts searching at a point 3 rows higher than input Max
 Function returns integer value equal to max extent of 'allbeach'
+
+The highest row is kept by SetAllBeach, so this is a lookup unless the
+beach has grown past Max + 2, when rows below that are tried in turn.
 */
 int
 XMaxBeach (State * _s, int Max)
 {
-  int xtest,
-    ytest;
+  int xtest = _s->BeachRowMax;
 
-  xtest = Max + 2;
-  ytest = 0;
+  if (xtest > Max + 2)
+    for (xtest = Max + 2; xtest > 0 && _s->BeachRowCount[xtest] == 0;
+         xtest--);
 
-  while (xtest > 0)
-  {
-    while (ytest < 2 * _s->ny)
-    {
-      if (_s->AllBeach[xtest][ytest] == 'y')
-      {
-        return xtest;
-      }
+  if (xtest > 0)
+    return xtest;
 
-      ytest++;
-    }
+  printf ("***** Should've found _s->nx for shadow): %d, %d ***** \n", xtest,
+          0);
+
+  return _s->nx;
+
+}
+
+/** The number of cells of row x that are all beach
+
+Counts _s->BeachBits 64 cells at a time.
+*/
+int
+RowBeachCount (State * _s, int x)
+{
+  int i = CELL_INDEX (_s, x, 0);
+  const int end = CELL_INDEX (_s, x + 1, 0);
+  int count = 0;
+
+  while (i < end)
+  {
+    const int bit = i % 64;
+    const int n = (end - i < 64 - bit) ? end - i : 64 - bit;
+    const uint64_t mask = (n == 64) ? ~(uint64_t) 0
+      : (((uint64_t) 1 << n) - 1) << bit;
 
-    ytest = 0;
+    count += __builtin_popcountll (_s->BeachBits[i / 64] & mask);
 
-    xtest--;
+    i += n;
   }
 
-  printf ("***** Should've found _s->nx for shadow): %d, %d ***** \n", xtest,
-          ytest);
+  return count;
+}
 
-  return _s->nx;
+/** Recounts _s->BarrierWidth up column y from row x
+
+Only the run of all beach cells above a cell that has flipped can change,
+and that run ends at the shore, so near the shore this is a cell or two.
+*/
+void
+CountBarrierWidth (State * _s, int x, int y)
+{
+  int below = (x > 0) ? _s->BarrierWidth[CELL_INDEX (_s, x - 1, y)] : 0;
+  int xtest;
+
+  for (xtest = x; xtest < _s->nx; xtest++)
+  {
+    int *width = _s->BarrierWidth + CELL_INDEX (_s, xtest, y);
+    const int count = (IS_BEACH (_s, xtest, y)) ? below + 1 : 0;
 
+    if (xtest > x && *width == count)
+      break;
+
+    *width = count;
+    below = count;
+  }
 }
 
+/** Counts the all beach cells of each row, and down each column, again
+
+For a grid that was loaded rather than built with SetAllBeach.
+*/
+void
+deltas_count_beach (State * _s)
+{
+  int x,
+    y;
+
+  _s->BeachRowMax = -1;
+  for (x = 0; x < _s->nx; x++)
+  {
+    _s->BeachRowCount[x] = RowBeachCount (_s, x);
+    if (_s->BeachRowCount[x] > 0)
+      _s->BeachRowMax = x;
+
+    for (y = 0; y < _s->ny_grid; y++)
+      _s->BarrierWidth[CELL_INDEX (_s, x, y)] =
+        (!IS_BEACH (_s, x, y)) ? 0
+        : (x > 0) ? _s->BarrierWidth[CELL_INDEX (_s, x - 1, y)] + 1 : 1;
+  }
+}
 /**  Function to determine if particular cell xin,yin is in shadow
 
 Returns a character 'y' if yes 'n' if no
@@ -1391,12 +1973,14 @@ New 2/04 - use pixelwise march  - make it faster, more accurate - aa
 New 3/04 - correctly take acocunt for sideways and underneath shadows - aa
 
 This function will use but not affect the global arrays:
-_s->AllBeach[][] and _s->PercentFull[][]
+_s->BeachBits and _s->PercentFull[][]
 This function refers to global variable:  _s->WaveAngle				*/
 char
 FindIfInShadow (State * _s, int icheck, int ShadMax)
 {
 
+  Ray ray;                      /* search line */
+
   double slope;                  /* search line slope - slope of zero goes staight forward */
 
   int ysign;                    /* holder for going left or right alongshore */
@@ -1407,27 +1991,19 @@ FindIfInShadow (State * _s, int icheck, int ShadMax)
   double xin = -9999,
     yin = -9999;        /* starting 'real' locations */
 
-  int xinint,
-    yinint;                     /* integer locations for starting location */
-
   int xtestint,
     ytestint;                   /* cell looking at */
 
+  int ycell;                    /* ytestint, measured as yin is */
+
+  const int ylo = LINE_YLO (_s);
+
   double xtest = -9999,
     ytest = -9999;      /* 'real' location of testing */
 
   double xout,
     yout;                       /* used in AllBeach check - exit coordinates */
 
-  int NextXInt,
-    NextYInt;                   /* holder vairables for cell to check */
-
-  double Yup,
-    DistanceUp;                 /* when going to next x cell, what other values */
-
-  double Xside,
-    DistanceSide;               /* when gpoing to next y cell,other values */
-
   int DEBUG_2a = 0;             /* local debuggers */
 
   int debug2b = 0;
@@ -1436,133 +2012,37 @@ FindIfInShadow (State * _s, int icheck, int ShadMax)
   /* note that for case of shoreline, positive angle will be minus y direction */
   /*if (icheck == 106) {DEBUG_2a = 1;debug2b=1;} */
 
-  if (_s->WaveAngle == 0.0)
-  {
-    /* unlikely, but make sure no div by zero */
-    slope = 0.00001;
-  }
-  else if (fabs (_s->WaveAngle) == 90.0)
-  {
-    slope = 9999.9;
-  }
-  else
-  {
-    slope = fabs (tan (_s->WaveAngle));
-  }
-
   if (_s->WaveAngle > 0)
     ysign = -1;
   else
     ysign = 1;
 
-  DEBUG_PRINT (DEBUG_2a,
-               "\nI: %d----------x: %d  Y: %d  Wang:  %f Slope: %f sign: %d \n",
-               icheck, _s->X[icheck], _s->Y[icheck], _s->WaveAngle * radtodeg,
-               slope, ysign);
-
   /* 03/04 AA: depending on local orientations, starting point will differ */
-  /* so go through scenarios */
-
-  xinint = _s->X[icheck];
-  yinint = _s->Y[icheck];
-
-  {
-    const int y_left = (yinint == 0) ? 2 * _s->ny - 1 : yinint - 1;
-
-    const int y_right = (yinint == 2 * _s->ny - 1) ? 0 : yinint + 1;
-
-/*
-fprintf (stderr, "icheck=%d\n", icheck);
-fprintf (stderr, "y_left=%d\n", y_left);
-fprintf (stderr, "y=%d\n", yinint);
-fprintf (stderr, "y_right=%d\n", y_right);
-*/
-    if (_s->AllBeach[xinint - 1][yinint] == 'y'
-        || ((_s->AllBeach[xinint][y_left] == 'y')
-            && (_s->AllBeach[xinint][y_right] == 'y')))
-      /* 'regular condition' */
-      /* plus 'stuck in the middle' situation (unlikely scenario) */
-    {
-      xin = xinint + _s->PercentFull[xinint][yinint];
-      yin = yinint + 0.5;
-      DEBUG_PRINT (DEBUG_2a, "-- Regular xin: %f  yin: %f\n", xin, yin);
-    }
-    else if (_s->AllBeach[xinint][y_left] == 'y')
-      /* on right side */
-    {
-      xin = xinint + 0.5;
-      yin = yinint + _s->PercentFull[xinint][yinint];
-      DEBUG_PRINT (DEBUG_2a, "-- Right xin: %f  yin: %f\n", xin, yin);
-    }
-    else if (_s->AllBeach[xinint][y_right] == 'y')
-      /* on left side */
-    {
-      xin = xinint + 0.5;
-      yin = yinint + 1.0 - _s->PercentFull[xinint][yinint];
-      DEBUG_PRINT (DEBUG_2a, "-- Left xin: %f  yin: %f\n", xin, yin);
-    }
-    else if (_s->AllBeach[xinint + 1][yinint] == 'y')
-      /* gotta be on the bottom now */
-    {
-      xin = xinint + 1 - _s->PercentFull[xinint][yinint];
-      yin = yinint + 0.5;
-      DEBUG_PRINT (DEBUG_2a, "-- Under xin: %f  yin: %f\n", xin, yin);
-    }
-    else
-      /* debug ain't just an insect */
-    {
-      printf ("Shadowstart Broke !!!! ");
-      PauseRun (_s, xinint, yinint, icheck);
-    }
 
-  }
+  ShadowStartPoint (_s, icheck, &xin, &yin);
 
   DEBUG_PRINT (xin < -9998, "xin is uninitialized!");
   DEBUG_PRINT (yin < -9998, "yin is uninitialized!");
 
-  x = xin;
-  y = yin;
-
-  while ((floor (x) < ShadMax) && (y > _s->ny / 2) && (y < 3 * _s->ny / 2))
-  {
-    NextXInt = floor (x) + 1;
-    if (ysign > 0)
-      NextYInt = floor (y) + 1;
-    else
-      NextYInt = ceil (y - 1);
-
-    /* moving to next whole 'x' position, what is y position? */
-    Yup = y + (NextXInt - x) * slope * ysign;
-    DistanceUp = ((Yup - y) * (Yup - y) + (NextXInt - x) * (NextXInt - x));
+  RayStart (&ray, xin, yin, ylo, _s->WaveAngle, 1, ysign, FALSE);
+  slope = ray.slope;
 
-    /* moving to next whole 'y' position, what is x position? */
-    Xside = x + fabs (NextYInt - y) / slope;
-    DistanceSide =
-      ((NextYInt - y) * (NextYInt - y) + (Xside - x) * (Xside - x));
+  DEBUG_PRINT (DEBUG_2a,
+               "\nI: %d----------x: %d  Y: %d  Wang:  %f Slope: %f sign: %d \n",
+               icheck, _s->X[icheck], _s->Y[icheck], _s->WaveAngle * radtodeg,
+               ray.slope, ysign);
 
-    DEBUG_PRINT (DEBUG_2a,
-                 "x: %f  y: %f  X:%d  Y: %d  Yd: %f  DistD: %f Xs: %f DistS: %f\n",
-                 x, y, NextXInt, NextYInt, Yup, DistanceUp, Xside,
-                 DistanceSide);
+  while ((floor (ray.x) < ShadMax) && (ray.y > _s->ny_lo - ylo)
+         && (ray.y < _s->ny_lo + _s->ny - ylo))
+  {
+    PROFILE_COUNT (_s, DELTAS_EVENT_SHADOW_STEPS, 1);
 
-    if (DistanceUp < DistanceSide)
-      /* next cell is the up cell */
-    {
-      x = NextXInt;
-      y = Yup;
-      xtestint = NextXInt;
-      ytestint = floor (y);
-      DEBUG_PRINT (DEBUG_2a, " up ");
-    }
-    else
-      /* next cell is the side cell */
-    {
-      x = Xside;
-      y = NextYInt;
-      xtestint = floor (x);
-      ytestint = y + (ysign - 1) / 2;
-      DEBUG_PRINT (DEBUG_2a, " side ");
-    }
+    RayStep (&ray);
+    x = ray.x;
+    y = ray.y;
+    xtestint = ray.xtest;
+    ytestint = ray.ytest;
+    ycell = ytestint - ylo;
 
     DEBUG_PRINT (DEBUG_2a, "	x: %f  y: %f  xtesti: %d ytesti: %d \n\n", x,
                  y, xtestint, ytestint);
@@ -1572,34 +2052,14 @@ fprintf (stderr, "y_right=%d\n", y_right);
     /* Trick - if crossing through the diamond, will change quadrants       */
     /* Probably won't get to this one, though                               */
 
-    if (_s->AllBeach[xtestint][ytestint] == 'y')
+    if (IS_BEACH (_s, xtestint, ytestint))
     {
-      /* use same approach to find exit (could make this modular)  */
-      /* don't change 'x' or 'y' and this will be ok                      */
-      NextXInt = floor (x) + 1;
-      if (ysign > 0)
-        NextYInt = floor (y) + 1;
-      else
-        NextYInt = ceil (y - 1);
+      /* step a copy of the line on to find the exit */
+      Ray exit = ray;
 
-      Yup = y + (NextXInt - x) * slope * ysign;
-      DistanceUp = ((Yup - y) * (Yup - y) + (NextXInt - x) * (NextXInt - x));
-      Xside = x + fabs (NextYInt - y) / slope;
-      DistanceSide =
-        ((NextYInt - y) * (NextYInt - y) + (Xside - x) * (Xside - x));
-
-      if (DistanceUp < DistanceSide)
-        /* next cell is the up cell */
-      {
-        xout = NextXInt;
-        yout = Yup;
-      }
-      else
-        /* next cell is the side cell */
-      {
-        xout = Xside;
-        yout = NextYInt;
-      }
+      RayStep (&exit);
+      xout = exit.x;
+      yout = exit.y;
 
       /*DEBUG_PRINT( DEBUG_2a, "In Allbeach xin: %2.2f yin: %2.2f xout: %2.2f yout: %2.2f\n",
          x,y,xout,yout);
@@ -1607,7 +2067,7 @@ fprintf (stderr, "y_right=%d\n", y_right);
          (xout-xtestint-0.5),(x-xtestint-0.5),(yout-ytestint-0.5),(y-ytestint-0.5)); */
 
       if (((xout - xtestint - 0.5) * (x - xtestint - 0.5) < 0)
-          || ((yout - ytestint - 0.5) * (y - ytestint - 0.5) < 0))
+          || ((yout - ycell - 0.5) * (y - ycell - 0.5) < 0))
       {
         DEBUG_PRINT (DEBUG_2a, "  Shaddowded ");
         return 'y';
@@ -1620,14 +2080,14 @@ fprintf (stderr, "y_right=%d\n", y_right);
 
     else if (_s->PercentFull[xtestint][ytestint] > 0)
     {
-      if (_s->AllBeach[xtestint - 1][ytestint] == 'y'
-          || ((_s->AllBeach[xtestint][ytestint - 1] == 'y')
-              && (_s->AllBeach[xtestint][ytestint + 1] == 'y')))
+      if (IS_BEACH (_s, xtestint - 1, ytestint)
+          || ((IS_BEACH (_s, xtestint, ytestint - 1))
+              && (IS_BEACH (_s, xtestint, ytestint + 1))))
         /* 'regular' condition */
         /* plus 'stuck in the middle' situation (unlikely scenario) */
       {
         xtest = xtestint + _s->PercentFull[xtestint][ytestint];
-        ytest = ytestint + 0.5;
+        ytest = ycell + 0.5;
 
         if (xtest > (xin + fabs (ytest - yin) / slope))
         {
@@ -1639,11 +2099,11 @@ fprintf (stderr, "y_right=%d\n", y_right);
           return 'y';
         }
       }
-      else if (_s->AllBeach[xtestint][ytestint - 1] == 'y')
+      else if (IS_BEACH (_s, xtestint, ytestint - 1))
         /* on right side */
       {
         xtest = xtestint + 0.5;
-        ytest = ytestint + _s->PercentFull[xtestint][ytestint];
+        ytest = ycell + _s->PercentFull[xtestint][ytestint];
 
         if (ytest > (yin + (xtest - xin) * slope))
         {
@@ -1653,11 +2113,11 @@ fprintf (stderr, "y_right=%d\n", y_right);
           return 'y';
         }
       }
-      else if (_s->AllBeach[xtestint][ytestint + 1] == 'y')
+      else if (IS_BEACH (_s, xtestint, ytestint + 1))
         /* on left side */
       {
         xtest = xtestint + 0.5;
-        ytest = ytestint + 1.0 - _s->PercentFull[xtestint][ytestint];
+        ytest = ycell + 1.0 - _s->PercentFull[xtestint][ytestint];
 
         if (ytest < (yin + (xtest - xin) * slope)*ysign)
         {
@@ -1667,11 +2127,11 @@ fprintf (stderr, "y_right=%d\n", y_right);
           return 'y';
         }
       }
-      else if (_s->AllBeach[xtestint + 1][ytestint] == 'y')
+      else if (IS_BEACH (_s, xtestint + 1, ytestint))
         /* gotta be on the bottom now */
       {
         xtest = xtestint + 1 - _s->PercentFull[xtestint][ytestint];
-        ytest = ytestint + 0.5;
+        ytest = ycell + 0.5;
 
         if (xtest < (xin + fabs (ytest - yin) / slope))
         {
@@ -1699,19 +2159,78 @@ fprintf (stderr, "y_right=%d\n", y_right);
   return 'n';
 }
 
+/** Finds the 'real' location a beach cell's shadow search starts from
+
+03/04 AA: depending on local orientations, starting point will differ
+so go through scenarios.  xin and yin are left alone if none of them fit.
+yin is measured from LINE_YLO, as a Ray's y is.
+*/
+void
+ShadowStartPoint (State * _s, int icheck, double *xin, double *yin)
+{
+  const int xinint = _s->X[icheck];
+
+  const int yinint = _s->Y[icheck];
+
+  const int ydomain = yinint - LINE_YLO (_s);  /* yin is measured as a Ray's y */
+
+  const int y_left = (yinint == 0) ? _s->ny_grid - 1 : yinint - 1;
+
+  const int y_right = (yinint == _s->ny_grid - 1) ? 0 : yinint + 1;
+
+  if (IS_BEACH (_s, xinint - 1, yinint)
+      || ((IS_BEACH (_s, xinint, y_left))
+          && (IS_BEACH (_s, xinint, y_right))))
+    /* 'regular condition' */
+    /* plus 'stuck in the middle' situation (unlikely scenario) */
+  {
+    *xin = xinint + _s->PercentFull[xinint][yinint];
+    *yin = ydomain + 0.5;
+    DEBUG_PRINT (DEBUG_2, "-- Regular xin: %f  yin: %f\n", *xin, *yin);
+  }
+  else if (IS_BEACH (_s, xinint, y_left))
+    /* on right side */
+  {
+    *xin = xinint + 0.5;
+    *yin = ydomain + _s->PercentFull[xinint][yinint];
+    DEBUG_PRINT (DEBUG_2, "-- Right xin: %f  yin: %f\n", *xin, *yin);
+  }
+  else if (IS_BEACH (_s, xinint, y_right))
+    /* on left side */
+  {
+    *xin = xinint + 0.5;
+    *yin = ydomain + 1.0 - _s->PercentFull[xinint][yinint];
+    DEBUG_PRINT (DEBUG_2, "-- Left xin: %f  yin: %f\n", *xin, *yin);
+  }
+  else if (IS_BEACH (_s, xinint + 1, yinint))
+    /* gotta be on the bottom now */
+  {
+    *xin = xinint + 1 - _s->PercentFull[xinint][yinint];
+    *yin = ydomain + 0.5;
+    DEBUG_PRINT (DEBUG_2, "-- Under xin: %f  yin: %f\n", *xin, *yin);
+  }
+  else
+    /* debug ain't just an insect */
+  {
+    printf ("Shadowstart Broke !!!! ");
+    PauseRun (_s, xinint, yinint, icheck);
+  }
+}
+
 /**  Function to determine beach angles for all beach cells from left to right
 
 By convention, the ShorelineAngle will apply to current cell and right neighbor
 This function will determine global arrays:
    _s->ShorelineAngle[], _s->UpWind[], _s->SurroundingAngle[]
 This function will use but not affect the following arrays and values:
-   _s->X[], _s->Y[], _s->PercentFull[][], _s->AllBeach[][], _s->WaveAngle
+   _s->X[], _s->Y[], _s->PercentFull[][], _s->BeachBits, _s->WaveAngle
 ADA Revised underside, SurroundingAngle 6/03, 2/04 fixed
 ADA Revised angle calc 5/04
 */
 void
 DetermineAngles (State * _s)
 {
+  const double t0 = PROFILE_START (_s);
 
   int i,
     j,
@@ -1732,7 +2251,7 @@ DetermineAngles (State * _s)
   /* first angle should be regular one - periodic BC's should also take care          */
 
   x2 = _s->X[0] + _s->PercentFull[_s->X[0]][_s->Y[0]];
-  y2 = _s->Y[0] + 0.5;
+  y2 = _s->Y[0] - LINE_YLO (_s) + 0.5;  /* measured as a Ray's y */
 
   /* Compute _s->ShorelineAngle[]  */
   /*  not equal to _s->TotalBeachCells because angle between cell and rt neighbor */
@@ -1742,9 +2261,11 @@ DetermineAngles (State * _s)
   {
     const int y_next = _s->Y[i + 1];
 
-    const int y2int_left = (y_next == 0) ? 2 * _s->ny - 1 : y_next - 1;
+    const int y2domain = y_next - LINE_YLO (_s);
 
-    const int y2int_right = (y_next == 2 * _s->ny - 1) ? 0 : y_next + 1;
+    const int y2int_left = (y_next == 0) ? _s->ny_grid - 1 : y_next - 1;
+
+    const int y2int_right = (y_next == _s->ny_grid - 1) ? 0 : y_next + 1;
 
     x1 = x2;
     y1 = y2;
@@ -1752,58 +2273,58 @@ DetermineAngles (State * _s)
     x2int = _s->X[i + 1];
     y2int = _s->Y[i + 1];
 
-    if (_s->AllBeach[x2int - 1][y2int] == 'y' ||
-        ((_s->AllBeach[x2int][y2int_left] == 'y') &&
-         (_s->AllBeach[x2int][y2int_right] == 'y')) &&
-        (_s->AllBeach[x2int + 1][y2int] == 'n'))
+    if (IS_BEACH (_s, x2int - 1, y2int) ||
+        ((IS_BEACH (_s, x2int, y2int_left)) &&
+         (IS_BEACH (_s, x2int, y2int_right))) &&
+        (!IS_BEACH (_s, x2int + 1, y2int)))
       /* 'regular condition' - if between  */
       /* plus 'stuck in the middle' situation (unlikely scenario) */
     {
       x2 = x2int + _s->PercentFull[x2int][y2int];
-      y2 = y2int + 0.5;
+      y2 = y2domain + 0.5;
       if (debug3a)
         printf ("-- Regular xin: %f  yin: %f\n", x2, y2);
     }
-    else if ((_s->AllBeach[x2int + 1][y2int] == 'y')
-             && (_s->AllBeach[x2int - 1][y2int] == 'y'))
+    else if ((IS_BEACH (_s, x2int + 1, y2int))
+             && (IS_BEACH (_s, x2int - 1, y2int)))
       /* in a sideways nook (or is that a cranny?) */
     {
       x2 = x2int + 0.5;
 
-      if (_s->AllBeach[x2int][y2int_left] == 'y')
+      if (IS_BEACH (_s, x2int, y2int_left))
         /* right-facing nook */
       {
-        y2 = y2int + _s->PercentFull[x2int][y2int];
+        y2 = y2domain + _s->PercentFull[x2int][y2int];
       }
       else
         /* left-facing nook */
       {
-        y2 = y2int + 1.0 - _s->PercentFull[x2int][y2int];
+        y2 = y2domain + 1.0 - _s->PercentFull[x2int][y2int];
       }
       if (debug3a)
         printf ("-- Nook  xin: %f  yin: %f\n", x2, y2);
     }
-    else if (_s->AllBeach[x2int][y2int_left] == 'y')
+    else if (IS_BEACH (_s, x2int, y2int_left))
       /* on right side */
     {
       x2 = x2int + 0.5;
-      y2 = y2int + _s->PercentFull[x2int][y2int];
+      y2 = y2domain + _s->PercentFull[x2int][y2int];
       if (debug3a)
         printf ("-- Right xin: %f  yin: %f\n", x2, y2);
     }
-    else if (_s->AllBeach[x2int][y2int_right] == 'y')
+    else if (IS_BEACH (_s, x2int, y2int_right))
       /* on left side */
     {
       x2 = x2int + 0.5;
-      y2 = y2int + 1.0 - _s->PercentFull[x2int][y2int];
+      y2 = y2domain + 1.0 - _s->PercentFull[x2int][y2int];
       if (debug3a)
         printf ("-- Left xin: %f  yin: %f\n", x2, y2);
     }
-    else if (_s->AllBeach[x2int + 1][y2int] == 'y')
+    else if (IS_BEACH (_s, x2int + 1, y2int))
       /* gotta be on the bottom now */
     {
       x2 = x2int + 1 - _s->PercentFull[x2int][y2int];
-      y2 = y2int + 0.5;
+      y2 = y2domain + 0.5;
       if (debug3a)
         printf ("-- Under xin: %f  yin: %f\n", x2, y2);
     }
@@ -1908,6 +2429,7 @@ DetermineAngles (State * _s)
 
   }
 
+  PROFILE_STOP (_s, DELTAS_PHASE_ANGLES, t0);
 }
 
 /**
@@ -1916,17 +2438,102 @@ transport calcs
 
 Once situation is determined, will use function SedTrans to determine actual
 transport
-This function will call SedTrans which will determine global arrays:
+This function will call BorderTransport for each border, then add up the
+border fluxes to determine global arrays:
    _s->VolumeIn[], _s->VolumeOut[]
 This function will use but not affect the following arrays and values:
    _s->X[], _s->Y[], _s->InShadow[], _s->UpWind[], _s->ShorelineAngle[]
-   _s->PercentFull[][], _s->AllBeach[][], _s->WaveAngle
+   _s->PercentFull[][], _s->BeachBits, _s->WaveAngle
 */
 void
 DetermineSedTransport (State * _s)
 {
+  const double t0 = PROFILE_START (_s);
+  int i;
+  int n_borders = _s->TotalBeachCells - 2;
+
+  DEBUG_PRINT (DEBUG_5, "\nSEDTRANS: %d  @  %f \n\n", _s->CurrentTimeStep,
+               _s->WaveAngle * radtodeg);
+
+  if (!_s->exact_refraction)
+    BuildBreakingTable (_s);
+
+  /*  Each border only writes its own slot of BorderFrom, BorderTo and   */
+  /*  BorderFlux, so the borders can be shared out among threads          */
+
+  if (_s->pool && n_borders >= 2 * BORDERS_PER_TASK)
+    cem_pool_run (_s->pool, BorderTasks (_s), BorderTransportTask, _s);
+  else
+  {
+    for (i = 1; i < _s->TotalBeachCells - 1; i++)
+      BorderTransport (_s, i);
+  }
+
+  /*  Gather in border order so the sums come out the same for any number */
+  /*  of threads                                                          */
+
+  for (i = 1; i < _s->TotalBeachCells - 1; i++)
+  {
+    if (_s->BorderFrom[i] >= 0)
+    {
+      _s->VolumeOut[_s->BorderFrom[i]] += _s->BorderFlux[i];
+      _s->VolumeIn[_s->BorderTo[i]] += _s->BorderFlux[i];
+
+      DEBUG_PRINT (DEBUG_6, "VolumeAcrossBorder: %f  ", _s->BorderFlux[i]);
+      DEBUG_PRINT (DEBUG_6, "VolumeIn : %f ", _s->VolumeIn[_s->BorderTo[i]]);
+      DEBUG_PRINT (DEBUG_6, "VolumeOut : %f \n\n",
+                   _s->VolumeOut[_s->BorderFrom[i]]);
+    }
+  }
+
+  PROFILE_STOP (_s, DELTAS_PHASE_SED_TRANSPORT, t0);
+}
+
+/**
+Number of blocks of beach borders DetermineSedTransport hands to the
+threads - a few per thread so an uneven block doesn't hold everyone up
+*/
+int
+BorderTasks (State * _s)
+{
+  int n_tasks = cem_pool_get_n_threads (_s->pool) * 4;
+  int n_borders = _s->TotalBeachCells - 2;
 
-  int i;                        /* Loop variable */
+  if (n_tasks > n_borders / BORDERS_PER_TASK)
+    n_tasks = n_borders / BORDERS_PER_TASK;
+
+  return n_tasks;
+}
+
+/**
+Runs BorderTransport over the task'th of the BorderTasks blocks of beach
+borders
+*/
+void
+BorderTransportTask (void *data, int task)
+{
+  State *_s = (State *) data;
+  int n_tasks = BorderTasks (_s);
+  long n_borders = _s->TotalBeachCells - 2;
+  int i;
+
+  for (i = 1 + n_borders * task / n_tasks;
+       i < 1 + n_borders * (task + 1) / n_tasks; i++)
+    BorderTransport (_s, i);
+}
+
+/**
+Determines the transport across the border between beach cells i and i+1
+
+This function will set _s->BorderFrom[i], _s->BorderTo[i] and
+_s->BorderFlux[i], with BorderFrom[i] = -1 when no sediment crosses.  It
+writes nothing else, so borders can be done in any order, on any thread.
+This function will use but not affect the following arrays and values:
+   _s->InShadow[], _s->UpWind[], _s->ShorelineAngle[], _s->WaveAngle
+*/
+void
+BorderTransport (State * _s, int i)
+{
 
   double ShoreAngleUsed = -9999; /* Temporary holder for shoreline angle                                 */
 
@@ -1945,175 +2552,155 @@ DetermineSedTransport (State * _s)
 
   double SedTansLimit = SED_TRANS_LIMIT;
 
-  DEBUG_PRINT (DEBUG_5, "\nSEDTRANS: %d  @  %f \n\n", _s->CurrentTimeStep,
-               _s->WaveAngle * radtodeg);
+  double Flux;                  /* Sediment volume across the border                                    */
 
-  for (i = 1; i < _s->TotalBeachCells - 1; i++)
-  {
-    DEBUG_PRINT (DEBUG_5, "\n  i: %d  ", i);
+  _s->BorderFrom[i] = -1;
 
-    MaxTrans = 'n';
+  DEBUG_PRINT (DEBUG_5, "\n  i: %d  ", i);
 
-    /*  Is littoral transport going left or right?  */
+  MaxTrans = 'n';
 
-    if ((_s->WaveAngle - _s->ShorelineAngle[i]) > 0)
-    {
-      /*  Transport going right, center on cell to left side of border     */
-      /*  Next cell in positive direction, no correction term needed              */
-      CalcCell = i;
-      Next = 1;
-      Last = -1;
-      Correction = 0;
-
-      DEBUG_PRINT (DEBUG_5, "RT  %d ", CalcCell);
-    }
-    else
-    {
-      /*  Transport going left, center on cell to right side of border    */
-      /*  Next cell in negative direction, correction term needed                 */
-      CalcCell = i + 1;
-      Next = -1;
-      Last = 1;
-      Correction = -1;
-
-      DEBUG_PRINT (DEBUG_5, "LT  %d ", CalcCell);
-    }
+  /*  Is littoral transport going left or right?  */
 
-    if (_s->InShadow[CalcCell] == 'n')
-    {
+  if ((_s->WaveAngle - _s->ShorelineAngle[i]) > 0)
+  {
+    /*  Transport going right, center on cell to left side of border     */
+    /*  Next cell in positive direction, no correction term needed              */
+    CalcCell = i;
+    Next = 1;
+    Last = -1;
+    Correction = 0;
+
+    DEBUG_PRINT (DEBUG_5, "RT  %d ", CalcCell);
+  }
+  else
+  {
+    /*  Transport going left, center on cell to right side of border    */
+    /*  Next cell in negative direction, correction term needed                 */
+    CalcCell = i + 1;
+    Next = -1;
+    Last = 1;
+    Correction = -1;
+
+    DEBUG_PRINT (DEBUG_5, "LT  %d ", CalcCell);
+  }
 
-      /*  Adjustment for maximum transport when passing through 45 degrees                */
-      /*  This adjustment is only made for moving from downwind to upwind conditions      */
-      /*                                                                          */
-      /*  purposefully done before shadow adjustment, only use maxtran when               */
-      /*  transition from dw to up not because of shadow                          */
-      /* keeping transition from uw to dw - does not seem to be big deal (04/02 AA) */
-
-      if (((_s->UpWind[CalcCell] == 'd')
-           && (_s->UpWind[CalcCell + Next] == 'u')
-           && (_s->InShadow[CalcCell + Next] == 'n'))
-          || ((_s->UpWind[CalcCell + Last] == 'u')
-              && (_s->UpWind[CalcCell] == 'd')
-              && (_s->InShadow[CalcCell + Last] == 'n')))
-      {
-        MaxTrans = 'y';
-        DEBUG_PRINT (DEBUG_5, "MAXTRAN  ");
-      }
+  if (_s->InShadow[CalcCell] == 'n')
+  {
 
-      /*  Upwind/Downwind adjustment Make sure sediment is put into shadows               */
-      /*  If Next cell is in shadow, use UpWind condition                         */
+    /*  Adjustment for maximum transport when passing through 45 degrees                */
+    /*  This adjustment is only made for moving from downwind to upwind conditions      */
+    /*                                                                          */
+    /*  purposefully done before shadow adjustment, only use maxtran when               */
+    /*  transition from dw to up not because of shadow                          */
+    /* keeping transition from uw to dw - does not seem to be big deal (04/02 AA) */
+
+    if (((_s->UpWind[CalcCell] == 'd')
+         && (_s->UpWind[CalcCell + Next] == 'u')
+         && (_s->InShadow[CalcCell + Next] == 'n'))
+        || ((_s->UpWind[CalcCell + Last] == 'u')
+            && (_s->UpWind[CalcCell] == 'd')
+            && (_s->InShadow[CalcCell + Last] == 'n')))
+    {
+      MaxTrans = 'y';
+      DEBUG_PRINT (DEBUG_5, "MAXTRAN  ");
+    }
 
-      DoFlux = 1;
-      UpWindLocal = _s->UpWind[CalcCell];
+    /*  Upwind/Downwind adjustment Make sure sediment is put into shadows               */
+    /*  If Next cell is in shadow, use UpWind condition                         */
 
-      if (_s->InShadow[CalcCell + Next] == 'y')
-      {
-        UpWindLocal = 'u';
-        DEBUG_PRINT (DEBUG_5, "U(2)  ");
-      }
+    DoFlux = 1;
+    UpWindLocal = _s->UpWind[CalcCell];
 
-      /*  If coming out of shadow, downwind should be used                */
-      /*  HOWEVER- 02/04 AA - if high angle, will result in same flux in/out problem */
-      /*          solution  - no flux for high angle waves */
+    if (_s->InShadow[CalcCell + Next] == 'y')
+    {
+      UpWindLocal = 'u';
+      DEBUG_PRINT (DEBUG_5, "U(2)  ");
+    }
 
-      if ((_s->InShadow[CalcCell + Last] == 'y') && (UpWindLocal == 'u'))
-      {
-        DoFlux = 0;
-        DEBUG_PRINT (DEBUG_5, "U(X) NOFLUX \n");
+    /*  If coming out of shadow, downwind should be used                */
+    /*  HOWEVER- 02/04 AA - if high angle, will result in same flux in/out problem */
+    /*          solution  - no flux for high angle waves */
 
-      }
+    if ((_s->InShadow[CalcCell + Last] == 'y') && (UpWindLocal == 'u'))
+    {
+      DoFlux = 0;
+      DEBUG_PRINT (DEBUG_5, "U(X) NOFLUX \n");
 
-      /*  Use upwind or downwind shoreline angle for calcs                        */
+    }
 
-      if (UpWindLocal == 'u')
-      {
-        ShoreAngleUsed = _s->ShorelineAngle[CalcCell + Last + Correction];
-        DEBUG_PRINT (DEBUG_5, "UP  ShoreAngle: %3.1f  ",
-                     ShoreAngleUsed * radtodeg);
-      }
-      else if (UpWindLocal == 'd')
-      {
-        ShoreAngleUsed = _s->ShorelineAngle[CalcCell + Correction];
-        DEBUG_PRINT (DEBUG_5, "DN  ShoreAngle: %3.1f  ",
-                     ShoreAngleUsed * radtodeg);
-      }
+    /*  Use upwind or downwind shoreline angle for calcs                        */
+
+    if (UpWindLocal == 'u')
+    {
+      ShoreAngleUsed = _s->ShorelineAngle[CalcCell + Last + Correction];
+      DEBUG_PRINT (DEBUG_5, "UP  ShoreAngle: %3.1f  ",
+                   ShoreAngleUsed * radtodeg);
+    }
+    else if (UpWindLocal == 'd')
+    {
+      ShoreAngleUsed = _s->ShorelineAngle[CalcCell + Correction];
+      DEBUG_PRINT (DEBUG_5, "DN  ShoreAngle: %3.1f  ",
+                   ShoreAngleUsed * radtodeg);
+    }
 
-      DEBUG_PRINT (ShoreAngleUsed < -9998, "ShoreAngleUsed is uninitialized!");
+    DEBUG_PRINT (ShoreAngleUsed < -9998, "ShoreAngleUsed is uninitialized!");
 
-      /* !!! Do not do transport on unerneath c'cause it gets all messed up */
-      if (fabs (ShoreAngleUsed) > SedTansLimit / radtodeg)
-      {
-        DoFlux = 0;
-      }
+    /* !!! Do not do transport on unerneath c'cause it gets all messed up */
+    if (fabs (ShoreAngleUsed) > SedTansLimit / radtodeg)
+    {
+      DoFlux = 0;
+    }
 
-      /* Send to SedTrans to calculate VolumeIn and VolumeOut */
+    /* Send to SedTrans to calculate the volume across the border */
 
-      /* printf("i = %d  Cell: %d NextCell: %d Angle: %f Trans Angle: %f\n",
-         i, CalcCell, CalcCell+Next, ShoreAngleUsed*180/pi, (_s->WaveAngle - ShoreAngleUsed)*180/pi); */
+    /* printf("i = %d  Cell: %d NextCell: %d Angle: %f Trans Angle: %f\n",
+       i, CalcCell, CalcCell+Next, ShoreAngleUsed*180/pi, (_s->WaveAngle - ShoreAngleUsed)*180/pi); */
 
-      DEBUG_PRINT (DEBUG_5, "From: %d  To: %d  TransAngle %3.1f", CalcCell,
-                   CalcCell + Next,
-                   (_s->WaveAngle - ShoreAngleUsed) * radtodeg);
+    DEBUG_PRINT (DEBUG_5, "From: %d  To: %d  TransAngle %3.1f", CalcCell,
+                 CalcCell + Next,
+                 (_s->WaveAngle - ShoreAngleUsed) * radtodeg);
 
-      if (DoFlux)
+    if (DoFlux)
+    {
+      Flux = SedTrans (_s, ShoreAngleUsed, MaxTrans);
+      if (Flux >= 0.)
       {
-        SedTrans (_s, CalcCell, CalcCell + Next, ShoreAngleUsed, MaxTrans);
+        _s->BorderFrom[i] = CalcCell;
+        _s->BorderTo[i] = CalcCell + Next;
+        _s->BorderFlux[i] = Flux;
       }
     }
-
   }
-
 }
 
 /**
-This central function will calcualte the sediment transported from the cell at From to the cell at To, using the input ShoreAngle
+This central function will calcualte the sediment transported across a border, using the input ShoreAngle
 
-This function will caluclate and determine the global arrays:
-   _s->VolumeIn[] and _s->VolumeOut[]
-This function does not use any other arrays
+This function will return the volume across the border, or -1 if the waves
+are too oblique to the shore to move any sediment
+This function does not use any arrays
 This function will use the global values defining the wave field:
    _s->WaveAngle, Period, OffShoreWvHt
 Revised 6/02 - New iterative calc for refraction and breaking, parameters revised
 */
-void
-SedTrans (State * _s, int From, int To, double ShoreAngle, char MaxT)
+double
+SedTrans (State * _s, double ShoreAngle, char MaxT)
 {
 
   /* Coefficients - some of these are important */
 
-  double StartDepth = 3 * _s->wave_height;       /* m, depth to begin refraction calcs (needs to be beyond breakers)      */
-
-  double RefractStep = .2;       /* m, step size to iterate depth for refraction calcs                   */
-
-  double KBreak = 0.5;           /* coefficient for wave breaking threshold                              */
-
   double rho = 1020;             /* kg/m3 - density of water and dissolved matter                                */
 
   /* Variables */
 
-  int Broken = 0;               /* is wave broken yet?                          */
-
   double AngleDeep;              /* rad, Angle of waves to shore at inner shelf  */
 
-  double Depth = StartDepth;     /* m, water depth for current iteration         */
-
   double Angle;                  /* rad, calculation angle                       */
 
-  double CDeep;                  /* m/s, phase velocity in deep water            */
-
-  double LDeep;                  /* m, offhsore wavelength                       */
+  double WvHeight;               /* m, current wave height                       */
 
-  double C;                      /* m/s, current step phase velocity             */
-
-  double kh;                     /* wavenumber times depth                       */
-
-  double n;                      /* n                                            */
-
-  double WaveLength;             /* m, current wavelength                        */
-
-  double WvHeight;               /* m, current wave height                       */
-
-  double VolumeAcrossBorder;     /* m3/day                                       */
+  double VolumeAcrossBorder;     /* m3/day                                       */
 
   /* Primary assumption is that waves refract over shore-parallel contours                    */
   /* New algorithm 6/02 iteratively takes wiave onshore until they break, then computes Qs    */
@@ -2134,61 +2721,20 @@ SedTrans (State * _s, int From, int To, double ShoreAngle, char MaxT)
 
   if (AngleDeep > 0.995 * M_PI / 2.0 || AngleDeep < -0.995 * M_PI / 2.0)
   {
-    return;
+    return -1.;
   }
 
   else
   {
-    /* Calculate Deep Water Celerity & Length, Komar 5.11 c = gT / pi, L = CT       */
-
-    CDeep = GRAV * _s->wave_period / (2.0 * M_PI);
-    LDeep = CDeep * _s->wave_period;
-    DEBUG_PRINT (DEBUG_6, "CDeep = %2.2f LDeep = %2.2f \n", CDeep, LDeep);
-
-    while (!Broken)
+    if (_s->exact_refraction)
+      RefractWave (_s, AngleDeep, &Angle, &WvHeight);
+    else if (MaxT == 'y')
     {
-      /* non-iterative eqn for L, from Fenton & McKee             */
-
-      WaveLength =
-        LDeep *
-        Raise (tanh
-               (Raise
-                (Raise (2.0 * M_PI / _s->wave_period, 2) * Depth / GRAV,
-                 .75)), 2.0 / 3.0);
-      C = WaveLength / _s->wave_period;
-      DEBUG_PRINT (DEBUG_6, "DEPTH: %2.2f Wavelength = %2.2f C = %2.2f ",
-                   Depth, WaveLength, C);
-
-      /* Determine n = 1/2(1+2kh/tanh(kh)) Komar 5.21                     */
-      /* First Calculate kh = 2 pi Depth/L  from k = 2 pi/L               */
-
-      kh = M_PI * Depth / WaveLength;
-      n = 0.5 * (1 + 2.0 * kh / sinh (2.0 * kh));
-      DEBUG_PRINT (DEBUG_6, "kh: %2.3f  n: %2.3f ", kh, n);
-
-      /* Calculate angle, assuming shore parallel contours and no conv/div of rays        */
-      /* from Komar 5.47                                                          */
-
-      Angle = asin (C / CDeep * sin (AngleDeep));
-      DEBUG_PRINT (DEBUG_6, "Angle: %2.2f", Angle * radtodeg);
-
-      /* Determine Wave height from refract calcs - Komar 5.49                    */
-
-      WvHeight =
-        _s->wave_height * Raise (CDeep * cos (AngleDeep) /
-                                 (C * 2.0 * n * cos (Angle)), .5);
-      DEBUG_PRINT (DEBUG_6, " WvHeight : %2.3f\n", WvHeight);
-
-      if (WvHeight > Depth * KBreak)
-        Broken = 1;
-      else if (Depth == RefractStep)
-      {
-        Broken = 1;
-        Depth -= RefractStep;
-      }
-      else
-        Depth -= RefractStep;
+      Angle = _s->BreakAngleMaxT;
+      WvHeight = _s->BreakHeightMaxT;
     }
+    else
+      LookUpBreaking (_s, AngleDeep, &Angle, &WvHeight);
 
     /* Now Determine Transport */
     /* eq. 9.6b (10.8) Komar, including assumption of sed density = 2650 kg/m3              */
@@ -2200,15 +2746,169 @@ SedTrans (State * _s, int From, int To, double ShoreAngle, char MaxT)
       fabs (1.1 * rho * Raise (GRAV, 3.0 / 2.0) * Raise (WvHeight, 2.5) *
             cos (Angle) * sin (Angle) * TimeStep);
 
-    _s->VolumeOut[From] = _s->VolumeOut[From] + VolumeAcrossBorder;
+    return VolumeAcrossBorder;
+  }
+}
+
+/**
+Walks waves coming in at AngleDeep to the shore (over shore-parallel
+contours) until they break, and returns the angle and height they break at
+
+This function will use the global values defining the wave field:
+   _s->wave_height, _s->wave_period
+Revised 6/02 - New iterative calc for refraction and breaking, parameters revised
+*/
+void
+RefractWave (State * _s, double AngleDeep, double *BreakAngle,
+             double *BreakHeight)
+{
+
+  /* Coefficients - some of these are important */
+
+  double StartDepth = 3 * _s->wave_height;       /* m, depth to begin refraction calcs (needs to be beyond breakers)      */
+
+  double RefractStep = .2;       /* m, step size to iterate depth for refraction calcs                   */
+
+  double KBreak = 0.5;           /* coefficient for wave breaking threshold                              */
+
+  /* Variables */
+
+  int Broken = 0;               /* is wave broken yet?                          */
 
-    _s->VolumeIn[To] = _s->VolumeIn[To] + VolumeAcrossBorder;
+  int Steps = 0;                /* depth steps taken                            */
 
-    DEBUG_PRINT (DEBUG_6, "VolumeAcrossBorder: %f  ", VolumeAcrossBorder);
-    DEBUG_PRINT (DEBUG_6, "VolumeIn : %f ", _s->VolumeIn[To]);
-    DEBUG_PRINT (DEBUG_6, "VolumeOut : %f \n\n", _s->VolumeOut[From]);
+  double Depth = StartDepth;     /* m, water depth for current iteration         */
 
+  double Angle;                  /* rad, calculation angle                       */
+
+  double CDeep;                  /* m/s, phase velocity in deep water            */
+
+  double LDeep;                  /* m, offhsore wavelength                       */
+
+  double C;                      /* m/s, current step phase velocity             */
+
+  double kh;                     /* wavenumber times depth                       */
+
+  double n;                      /* n                                            */
+
+  double WaveLength;             /* m, current wavelength                        */
+
+  double WvHeight;               /* m, current wave height                       */
+
+  /* Calculate Deep Water Celerity & Length, Komar 5.11 c = gT / pi, L = CT       */
+
+  CDeep = GRAV * _s->wave_period / (2.0 * M_PI);
+  LDeep = CDeep * _s->wave_period;
+  DEBUG_PRINT (DEBUG_6, "CDeep = %2.2f LDeep = %2.2f \n", CDeep, LDeep);
+
+  while (!Broken)
+  {
+    Steps++;
+
+    /* non-iterative eqn for L, from Fenton & McKee             */
+
+    WaveLength =
+      LDeep *
+      Raise (tanh
+             (Raise
+              (Raise (2.0 * M_PI / _s->wave_period, 2) * Depth / GRAV,
+               .75)), 2.0 / 3.0);
+    C = WaveLength / _s->wave_period;
+    DEBUG_PRINT (DEBUG_6, "DEPTH: %2.2f Wavelength = %2.2f C = %2.2f ",
+                 Depth, WaveLength, C);
+
+    /* Determine n = 1/2(1+2kh/tanh(kh)) Komar 5.21                     */
+    /* First Calculate kh = 2 pi Depth/L  from k = 2 pi/L               */
+
+    kh = M_PI * Depth / WaveLength;
+    n = 0.5 * (1 + 2.0 * kh / sinh (2.0 * kh));
+    DEBUG_PRINT (DEBUG_6, "kh: %2.3f  n: %2.3f ", kh, n);
+
+    /* Calculate angle, assuming shore parallel contours and no conv/div of rays        */
+    /* from Komar 5.47                                                          */
+
+    Angle = asin (C / CDeep * sin (AngleDeep));
+    DEBUG_PRINT (DEBUG_6, "Angle: %2.2f", Angle * radtodeg);
+
+    /* Determine Wave height from refract calcs - Komar 5.49                    */
+
+    WvHeight =
+      _s->wave_height * Raise (CDeep * cos (AngleDeep) /
+                               (C * 2.0 * n * cos (Angle)), .5);
+    DEBUG_PRINT (DEBUG_6, " WvHeight : %2.3f\n", WvHeight);
+
+    if (WvHeight > Depth * KBreak)
+      Broken = 1;
+    else if (Depth == RefractStep)
+    {
+      Broken = 1;
+      Depth -= RefractStep;
+    }
+    else
+      Depth -= RefractStep;
   }
+
+  *BreakAngle = Angle;
+  *BreakHeight = WvHeight;
+
+  /* SedTrans can call this from more than one thread */
+  PROFILE_COUNT_SHARED (_s, DELTAS_EVENT_REFRACT_STEPS, Steps);
+}
+
+/**
+Builds the table of breaking wave angle and height over deep-water angle
+used by SedTrans, if the offshore wave height or period have changed since
+it was last built
+
+Angles run from 0 to the 0.995*pi/2 cut-off of SedTrans; waves coming in
+at negative angles break at the negative of the angle, same height.
+*/
+void
+BuildBreakingTable (State * _s)
+{
+  const double dAngle = 0.995 * M_PI / 2.0 / REFRACT_TABLE_LEN;
+
+  int k;
+
+  if (_s->RefractHeight == _s->wave_height
+      && _s->RefractPeriod == _s->wave_period)
+    return;
+
+  for (k = 0; k <= REFRACT_TABLE_LEN; k++)
+    RefractWave (_s, k * dAngle, &_s->BreakAngle[k], &_s->BreakHeight[k]);
+
+  RefractWave (_s, 42.0 / radtodeg, &_s->BreakAngleMaxT,
+               &_s->BreakHeightMaxT);
+
+  _s->RefractHeight = _s->wave_height;
+  _s->RefractPeriod = _s->wave_period;
+}
+
+/**
+Interpolates the angle and height waves coming in at AngleDeep break at
+from the table built by BuildBreakingTable
+*/
+void
+LookUpBreaking (State * _s, double AngleDeep, double *BreakAngle,
+                double *BreakHeight)
+{
+  const double dAngle = 0.995 * M_PI / 2.0 / REFRACT_TABLE_LEN;
+
+  const double t = fabs (AngleDeep) / dAngle;
+
+  int k = (int)t;
+
+  double f;
+
+  if (k > REFRACT_TABLE_LEN - 1)
+    k = REFRACT_TABLE_LEN - 1;
+  f = t - k;
+
+  *BreakAngle = (1 - f) * _s->BreakAngle[k] + f * _s->BreakAngle[k + 1];
+  *BreakHeight = (1 - f) * _s->BreakHeight[k] + f * _s->BreakHeight[k + 1];
+
+  if (AngleDeep < 0)
+    *BreakAngle = -*BreakAngle;
 }
 
 /**  Sweep through cells to place transported sediment
@@ -2224,13 +2924,14 @@ produce unwanted artifacts (e.g. make sure symmetrical
 void
 TransportSedimentSweep (State * _s)
 {
+  const double t0 = PROFILE_START (_s);
 
   int i,
     ii;
 
   int sweepsign;
 
-  if (RandZeroToOne () * 2 > 1)
+  if (RandZeroToOne (_s) * 2 > 1)
   {
     sweepsign = 1;
     DEBUG_PRINT (DEBUG_7A, "L  ");
@@ -2269,6 +2970,7 @@ TransportSedimentSweep (State * _s)
     }
   }
 
+  PROFILE_STOP (_s, DELTAS_PHASE_TRANSPORT_SWEEP, t0);
 }
 
 /**  Complete mass balance for incoming and ougoing sediment
@@ -2302,9 +3004,7 @@ AdjustShore (State * _s, int i)
     Yintdouble;                  /* doubleers for shoreface cell */
 
   /* variables for loop */
-  double slope;                  /* slope of zero goes staight back */
-
-  int ysign;                    /* holder for going left or right alongshore */
+  Ray ray;                      /* line back toward shore - slope of zero goes staight back */
 
   double x = -9999,
     y = -9999;  /* holders for 'real' location of x and y */
@@ -2312,15 +3012,6 @@ AdjustShore (State * _s, int i)
   int xtest,
     ytest;                      /* cell looking at */
 
-  int NextXInt,
-    NextYInt;                   /* holder vairables for cell to check */
-
-  double Ydown,
-    DistanceDown;               /* when going to next x cell, what other values */
-
-  double Xside,
-    DistanceSide;               /* when gpoing to next y cell,other values */
-
   int ShorefaceFlag;            /* flag to see if started intersecting shoreface cells */
 
   if (_s->VolumeIn[i] <= _s->VolumeOut[i])
@@ -2337,8 +3028,10 @@ AdjustShore (State * _s, int i)
     Distance = _s->shoreface_depth / _s->cell_width / _s->shoreface_slope;
     Xintdouble = _s->X[i] + 0.5 + Distance * cos (_s->SurroundingAngle[i]);
     Xintint = floor (Xintdouble);
-    Yintdouble = _s->Y[i] + 0.5 - Distance * sin (_s->SurroundingAngle[i]);
-    Yintint = floor (Yintdouble);
+    /* measured as a Ray's y is */
+    Yintdouble = _s->Y[i] - LINE_YLO (_s) + 0.5
+      - Distance * sin (_s->SurroundingAngle[i]);
+    Yintint = floor (Yintdouble) + LINE_YLO (_s);
 
     DEBUG_PRINT (DEBUG_7A,
                  "xs: %d  ys: %d  Xint: %f Xint:%d Yint: %f Yint: %d  Dint: %f SAng: %f Sin = %f\n",
@@ -2347,16 +3040,18 @@ AdjustShore (State * _s, int i)
                  _s->SurroundingAngle[i] * radtodeg,
                  sin (_s->SurroundingAngle[i]));
 
-    if ((Yintint < 0) || (Yintint > 2 * _s->ny))
+    if ((Yintint < 0) || (Yintint >= _s->ny_grid))
     {
       Depth = _s->shoreface_depth;
-      if ((Yintint > _s->ny / 2) && (Yintint < 3 / 2 * _s->ny))
+      /* Only the wrap regions should look off the grid - a cell of the */
+      /* domain doing so means the wrap regions are too narrow          */
+      if ((_s->Y[i] >= _s->ny_lo) && (_s->Y[i] < _s->ny_lo + _s->ny))
       {
         printf ("Periodic Boundary conditions and Depth Out of Bounds");
         PauseRun (_s, _s->X[i], _s->Y[i], i);
       }
     }
-    else if ((Xintint < 0) || (Xintint > _s->nx))
+    else if ((Xintint < 0) || (Xintint >= _s->nx))
     {
       Depth = _s->shoreface_depth;
       printf ("-- Warning - depth location off of x array: X %d Y %d",
@@ -2386,27 +3081,9 @@ AdjustShore (State * _s, int i)
       /* probably due to accretion from previous moving forward */
       /* reuse some of the overwash checking code here */
 
-      if (_s->SurroundingAngle[i] == 0)
-      {
-        /* unlikely, but make sure no div by zero */
-        slope = 0.00001;
-      }
-      else if (fabs (_s->SurroundingAngle[i]) == 90.0)
-      {
-        slope = 9999.9;
-      }
-      else
-      {
-        slope = fabs (tan (_s->SurroundingAngle[i]));
-      }
-
-      if (_s->SurroundingAngle[i] > 0)
-        ysign = 1;
-      else
-        ysign = -1;
-
-      x = Xintdouble;
-      y = Yintdouble;
+      RayStart (&ray, Xintdouble, Yintdouble, LINE_YLO (_s),
+                _s->SurroundingAngle[i], -1,
+                (_s->SurroundingAngle[i] > 0) ? 1 : -1, TRUE);
       xtest = Xintint;
       ytest = Yintint;
       ShorefaceFlag = 0;
@@ -2414,40 +3091,11 @@ AdjustShore (State * _s, int i)
       while ((_s->CellDepth[xtest][ytest] > _s->shoreface_depth)
              && !(ShorefaceFlag))
       {
-        NextXInt = ceil (x) - 1;
-        if (ysign > 0)
-          NextYInt = floor (y) + 1;
-        else
-          NextYInt = ceil (y - 1);
-
-        /* moving to next whole 'x' position, what is y position? */
-        Ydown = y + (x - NextXInt) * slope * ysign;
-        DistanceDown =
-          Raise (((Ydown - y) * (Ydown - y) +
-                  (NextXInt - x) * (NextXInt - x)), .5);
-
-        /* moving to next whole 'y' position, what is x position? */
-        Xside = x - fabs (NextYInt - y) / slope;
-        DistanceSide =
-          Raise (((NextYInt - y) * (NextYInt - y) +
-                  (Xside - x) * (Xside - x)), .5);
-
-        if (DistanceDown < DistanceSide)
-          /* next cell is the down cell */
-        {
-          x = NextXInt;
-          y = Ydown;
-          xtest = NextXInt - 1;
-          ytest = floor (y);
-        }
-        else
-          /* next cell is the side cell */
-        {
-          x = Xside;
-          y = NextYInt;
-          xtest = floor (x);
-          ytest = y + (ysign - 1) / 2;
-        }
+        RayStep (&ray);
+        x = ray.x;
+        y = ray.y;
+        xtest = ray.xtest;
+        ytest = ray.ytest;
 
         if (_s->CellDepth[xtest][ytest] > _s->shoreface_depth)
           /* Deep hole - fill 'er in - mass came from previous maths */
@@ -2459,6 +3107,7 @@ AdjustShore (State * _s, int i)
                        _s->CellDepth[Xintint][Yintint], xtest, ytest,
                        _s->CellDepth[xtest][ytest]);
           _s->CellDepth[xtest][ytest] = _s->shoreface_depth;
+          MarkFixCell (_s, xtest, ytest);
 
           /*PauseRun(xtest,ytest,i); */
 
@@ -2494,8 +3143,9 @@ AdjustShore (State * _s, int i)
 
   DeltaArea = (_s->VolumeIn[i] - _s->VolumeOut[i]) / Depth;
 
-  _s->PercentFull[_s->X[i]][_s->Y[i]] +=
-    DeltaArea / (_s->cell_width * _s->cell_width);
+  AddPercentFull (_s, _s->X[i], _s->Y[i],
+                  DeltaArea / (_s->cell_width * _s->cell_width));
+  MarkFixCell (_s, _s->X[i], _s->Y[i]);
 
   PercentIn = _s->VolumeIn[i] / (_s->cell_width * _s->cell_width * Depth);
   PercentOut = _s->VolumeOut[i] / (_s->cell_width * _s->cell_width * Depth);
@@ -2514,7 +3164,7 @@ Function completly changed 5/21/02 sandrevt.c
 New Approach - steal from all neighboring AllBeach cells
 Backup plan - steal from all neighboring percent full > 0
 Function adjusts primary data arrays:
-   _s->AllBeach[][] and _s->PercentFull[][]
+   _s->BeachBits and _s->PercentFull[][]
 */
 void
 OopsImEmpty (State * _s, int x, int y)
@@ -2533,42 +3183,42 @@ OopsImEmpty (State * _s, int x, int y)
 
   /* find out how many AllBeaches to take from */
 
-  if (_s->AllBeach[x - 1][y] == 'y')
+  if (IS_BEACH (_s, x - 1, y))
     emptycells += 1;
-  if (_s->AllBeach[x + 1][y] == 'y')
+  if (IS_BEACH (_s, x + 1, y))
     emptycells += 1;
-  if (_s->AllBeach[x][y - 1] == 'y')
+  if (IS_BEACH (_s, x, y - 1))
     emptycells += 1;
-  if (_s->AllBeach[x][y + 1] == 'y')
+  if (IS_BEACH (_s, x, y + 1))
     emptycells += 1;
 
   if (emptycells > 0)
   {
     /* Now Move Sediment */
 
-    if (_s->AllBeach[x - 1][y] == 'y')
+    if (IS_BEACH (_s, x - 1, y))
     {
-      _s->PercentFull[x - 1][y] += (_s->PercentFull[x][y]) / emptycells;
-      _s->AllBeach[x - 1][y] = 'n';
+      AddPercentFull (_s, x - 1, y, _s->PercentFull[x][y] / emptycells);
+      SetAllBeach (_s, x - 1, y, 'n');
       DEBUG_PRINT (DEBUG_8, "  MOVEDBACK");
     }
-    if (_s->AllBeach[x + 1][y] == 'y')
+    if (IS_BEACH (_s, x + 1, y))
     {
-      _s->PercentFull[x + 1][y] += (_s->PercentFull[x][y]) / emptycells;
-      _s->AllBeach[x + 1][y] = 'n';
+      AddPercentFull (_s, x + 1, y, _s->PercentFull[x][y] / emptycells);
+      SetAllBeach (_s, x + 1, y, 'n');
       DEBUG_PRINT (DEBUG_8, "  MOVEDUP");
     }
-    if (_s->AllBeach[x][y - 1] == 'y')
+    if (IS_BEACH (_s, x, y - 1))
     {
-      _s->PercentFull[x][y - 1] += (_s->PercentFull[x][y]) / emptycells;
-      _s->AllBeach[x][y - 1] = 'n';
+      AddPercentFull (_s, x, y - 1, _s->PercentFull[x][y] / emptycells);
+      SetAllBeach (_s, x, y - 1, 'n');
       DEBUG_PRINT (DEBUG_8, "  MOVEDLEFT");
       /*if (DEBUG_8) PauseRun(x,y,-1); */
     }
-    if (_s->AllBeach[x][y + 1] == 'y')
+    if (IS_BEACH (_s, x, y + 1))
     {
-      _s->PercentFull[x][y + 1] += (_s->PercentFull[x][y]) / emptycells;
-      _s->AllBeach[x][y + 1] = 'n';
+      AddPercentFull (_s, x, y + 1, _s->PercentFull[x][y] / emptycells);
+      SetAllBeach (_s, x, y + 1, 'n');
       DEBUG_PRINT (DEBUG_8, "  MOVEDRIGHT");
       /*if (DEBUG_8) PauseRun(x,y,-1); */
     }
@@ -2591,23 +3241,23 @@ OopsImEmpty (State * _s, int x, int y)
 
       if (_s->PercentFull[x - 1][y] > 0)
       {
-        _s->PercentFull[x - 1][y] += (_s->PercentFull[x][y]) / emptycells2;
+        AddPercentFull (_s, x - 1, y, _s->PercentFull[x][y] / emptycells2);
         DEBUG_PRINT (DEBUG_8, "  NOTFULL MOVEDBACK");
       }
       if (_s->PercentFull[x + 1][y] > 0)
       {
-        _s->PercentFull[x + 1][y] += (_s->PercentFull[x][y]) / emptycells2;
+        AddPercentFull (_s, x + 1, y, _s->PercentFull[x][y] / emptycells2);
         DEBUG_PRINT (DEBUG_8, "  NOTFULL MOVEDUP");
       }
       if (_s->PercentFull[x][y - 1] > 0)
       {
-        _s->PercentFull[x][y - 1] += (_s->PercentFull[x][y]) / emptycells2;
+        AddPercentFull (_s, x, y - 1, _s->PercentFull[x][y] / emptycells2);
         DEBUG_PRINT (DEBUG_8, "  NOTFULL MOVEDLEFT");
         /*if (DEBUG_8) PauseRun(x,y,-1); */
       }
       if (_s->PercentFull[x][y + 1] > 0)
       {
-        _s->PercentFull[x][y + 1] += (_s->PercentFull[x][y]) / emptycells2;
+        AddPercentFull (_s, x, y + 1, _s->PercentFull[x][y] / emptycells2);
         DEBUG_PRINT (DEBUG_8, "  NOTFULL MOVEDRIGHT");
         /*if (DEBUG_8) PauseRun(x,y,-1); */
       }
@@ -2621,12 +3271,19 @@ OopsImEmpty (State * _s, int x, int y)
 
   }
 
-  _s->AllBeach[x][y] = 'n';
-  _s->PercentFull[x][y] = 0.0;
+  SetAllBeach (_s, x, y, 'n');
+  SetPercentFull (_s, x, y, 0.0);
   _s->CellDepth[x][y] = _s->shoreface_depth;
 
+  MarkFixCell (_s, x, y);
+  MarkFixCell (_s, x - 1, y);
+  MarkFixCell (_s, x + 1, y);
+  MarkFixCell (_s, x, y - 1);
+  MarkFixCell (_s, x, y + 1);
+
   DEBUG_PRINT (DEBUG_8, "\n");
 
+  PROFILE_COUNT (_s, DELTAS_EVENT_OOPS_EMPTY, 1);
 }
 
 /** If a cell is overfull, push beach out in new direction
@@ -2636,7 +3293,7 @@ New approach: 	put sand wherever 0% full in adjacent cells
 if not 0% full, then fill all non-allbeach
 
 Function adjusts primary data arrays:
-   _s->AllBeach[][] and _s->PercentFull[][]
+   _s->BeachBits and _s->PercentFull[][]
 */
 void
 OopsImFull (State * _s, int x, int y)
@@ -2671,26 +3328,26 @@ OopsImFull (State * _s, int x, int y)
 
     if (_s->PercentFull[x - 1][y] == 0.0)
     {
-      _s->PercentFull[x - 1][y] += (_s->PercentFull[x][y] - 1) / fillcells;
+      AddPercentFull (_s, x - 1, y, (_s->PercentFull[x][y] - 1) / fillcells);
       _s->CellDepth[x - 1][y] = -LandHeight;
       DEBUG_PRINT (DEBUG_8, "  MOVEDBACK");
     }
     if (_s->PercentFull[x + 1][y] == 0.0)
     {
-      _s->PercentFull[x + 1][y] += (_s->PercentFull[x][y] - 1) / fillcells;
+      AddPercentFull (_s, x + 1, y, (_s->PercentFull[x][y] - 1) / fillcells);
       _s->CellDepth[x + 1][y] = -LandHeight;
       DEBUG_PRINT (DEBUG_8, "  MOVEDUP");
     }
     if (_s->PercentFull[x][y - 1] == 0.0)
     {
-      _s->PercentFull[x][y - 1] += (_s->PercentFull[x][y] - 1) / fillcells;
+      AddPercentFull (_s, x, y - 1, (_s->PercentFull[x][y] - 1) / fillcells);
       _s->CellDepth[x][y - 1] = -LandHeight;
       DEBUG_PRINT (DEBUG_8, "  MOVEDLEFT");
       /*if (DEBUG_8) PauseRun(x,y,-1); */
     }
     if (_s->PercentFull[x][y + 1] == 0.0)
     {
-      _s->PercentFull[x][y + 1] += (_s->PercentFull[x][y] - 1) / fillcells;
+      AddPercentFull (_s, x, y + 1, (_s->PercentFull[x][y] - 1) / fillcells);
       _s->CellDepth[x][y + 1] = -LandHeight;
       DEBUG_PRINT (DEBUG_8, "  MOVEDRIGHT");
       /*if (DEBUG_8) PauseRun(x,y,-1); */
@@ -2714,22 +3371,26 @@ OopsImFull (State * _s, int x, int y)
 
       if (_s->PercentFull[x - 1][y] < 1)
       {
-        _s->PercentFull[x - 1][y] += (_s->PercentFull[x][y] - 1) / fillcells2;
+        AddPercentFull (_s, x - 1, y,
+                        (_s->PercentFull[x][y] - 1) / fillcells2);
         DEBUG_PRINT (DEBUG_8, "  MOVEDBACK");
       }
       if (_s->PercentFull[x + 1][y] < 1)
       {
-        _s->PercentFull[x + 1][y] += (_s->PercentFull[x][y] - 1) / fillcells2;
+        AddPercentFull (_s, x + 1, y,
+                        (_s->PercentFull[x][y] - 1) / fillcells2);
         DEBUG_PRINT (DEBUG_8, "  MOVEDUP");
       }
       if (_s->PercentFull[x][y - 1] < 1)
       {
-        _s->PercentFull[x][y - 1] += (_s->PercentFull[x][y] - 1) / fillcells2;
+        AddPercentFull (_s, x, y - 1,
+                        (_s->PercentFull[x][y] - 1) / fillcells2);
         DEBUG_PRINT (DEBUG_8, "  MOVEDLEFT");
       }
       if (_s->PercentFull[x][y + 1] < 1)
       {
-        _s->PercentFull[x][y + 1] += (_s->PercentFull[x][y] - 1) / fillcells2;
+        AddPercentFull (_s, x, y + 1,
+                        (_s->PercentFull[x][y] - 1) / fillcells2);
         DEBUG_PRINT (DEBUG_8, "  MOVEDRIGHT");
       }
     }
@@ -2742,12 +3403,19 @@ OopsImFull (State * _s, int x, int y)
 
   }
 
-  _s->AllBeach[x][y] = 'y';
-  _s->PercentFull[x][y] = 1.0;
+  SetAllBeach (_s, x, y, 'y');
+  SetPercentFull (_s, x, y, 1.0);
   _s->CellDepth[x][y] = -LandHeight;
 
+  MarkFixCell (_s, x, y);
+  MarkFixCell (_s, x - 1, y);
+  MarkFixCell (_s, x + 1, y);
+  MarkFixCell (_s, x, y - 1);
+  MarkFixCell (_s, x, y + 1);
+
   DEBUG_PRINT (DEBUG_8, "\n");
 
+  PROFILE_COUNT (_s, DELTAS_EVENT_OOPS_FULL, 1);
 }
 
 /**
@@ -2761,12 +3429,13 @@ Revised 5/21/02 to move sand to all adjacent neighbors sandrevt.c
 Changes global variable
    _s->PercentFull[][]
 Uses but does not change
-   _s->AllBeach[][]
+   _s->BeachBits
 sandrevx.c - added sweepsign to reduce chances of asymmetrical artifacts
 */
 void
 FixBeach (State * _s)
 {
+  const double t0 = PROFILE_START (_s);
   int i,
     x,
     y,
@@ -2774,11 +3443,6 @@ FixBeach (State * _s)
 
   int FixXMax;
 
-  int fillcells3 = 0;
-
-  int y_left,
-    y_right;
-
   DEBUG_PRINT (DEBUG_ERIC, "*** In FixBeach\n");
 #if 0
   {
@@ -2786,12 +3450,12 @@ FixBeach (State * _s)
 
     fprintf (stderr, "***\n");
     for (i = 0; i < _s->nx; i++)
-      fprintf (stderr, "[%d][250] = %c\n", i, _s->AllBeach[i][250]);
+      fprintf (stderr, "[%d][250] = %c\n", i, IS_BEACH (_s, i, 250) ? 'y' : 'n');
   }
 #endif
   /*DEBUG_PRINT( DEBUG_9, "\n\nFIXBEACH      %d     %f\n", _s->CurrentTimeStep, _s->WaveAngle*radtodeg); */
 
-  if (RandZeroToOne () * 2 > 1)
+  if (RandZeroToOne (_s) * 2 > 1)
   {
     sweepsign = 1;
     DEBUG_PRINT (DEBUG_9, "fixL  ");
@@ -2807,210 +3471,448 @@ FixBeach (State * _s)
   if (FixXMax > _s->nx)
     FixXMax = _s->nx;
 
-  for (x = FixXMax - 1; x >= 0; x--)
+  if (_s->FixAll)
   {
-    for (i = 0; i < 2 * _s->ny; i++)
-    {
-      if (sweepsign == 1)
-        y = i;
-      else
-        y = 2 * _s->ny - i - 1;
+    /* Nothing is known about the grid - look at every cell */
 
-      /* ye olde depth fix */
-      if ((_s->PercentFull[x][y] <= 0)
-          && (_s->CellDepth[x][y] > _s->shoreface_depth)
-          && (x <= 0 || _s->CellDepth[x - 1][y] == _s->shoreface_depth))
-      {
-        y_left = (y == 0) ? _s->ny - 1 : y - 1;
-        y_right = (y == _s->ny - 1) ? 0 : y + 1;
+    _s->NumFix = 0;
+    memset (_s->FixBits, 0, sizeof (uint64_t) * ((_s->max_beach_len + 63) / 64));
 
-        if ((x >= _s->nx - 1 || _s->CellDepth[x + 1][y] == _s->shoreface_depth)
-            && (_s->CellDepth[x][y_left] == _s->shoreface_depth)
-            && (_s->CellDepth[x][y_right] == _s->shoreface_depth))
-        {
-          /* Fill Hole */
-          _s->CellDepth[x][y] = _s->shoreface_depth;
-        }
-      }
-      if (_s->PercentFull[x][y] > 100)
+    for (x = FixXMax - 1; x >= 0; x--)
+    {
+      for (i = 0; i < _s->ny_grid; i++)
       {
-        printf ("too full");
-        _s->PercentFull[x][y] = 0;
-        PauseRun (_s, x, y, -1);
+        if (sweepsign == 1)
+          y = i;
+        else
+          y = _s->ny_grid - i - 1;
+
+        FixBeachCell (_s, x, y);
       }
+    }
+
+    _s->FixAll = FALSE;
+    if (FixXMax > _s->FixScannedXMax)
+      _s->FixScannedXMax = FixXMax;
+  }
+  else
+    FixBeachWorklist (_s, FixXMax, sweepsign);
+
+#if 0
+  {
+    fprintf (stderr, "***\n");
+    int i;
+
+    for (i = 0; i < _s->nx; i++)
+      fprintf (stderr, "[%d][250] = %c\n", i, IS_BEACH (_s, i, 250) ? 'y' : 'n');
+  }
+#endif
+  DEBUG_PRINT (DEBUG_ERIC, "*** Out FixBeach\n");
+
+  PROFILE_STOP (_s, DELTAS_PHASE_FIX_BEACH, t0);
+}
+
+/**
+Fixes up cell (x, y) for FixBeach - fills deep holes, empties or fills
+cells that are under or over full, and moves loose bits of sand back to
+the shore
+
+Its neighbors along the row wrap at column ny, as they always have, or at
+the ends of the row with a halo, where column ny is part of the domain.
+*/
+void
+FixBeachCell (State * _s, int x, int y)
+{
+  const int wrap = HAS_HALO (_s) ? _s->ny_grid : _s->ny;
+
+  int fillcells3 = 0;
+
+  int y_left,
+    y_right;
+
+  /* ye olde depth fix */
+  if ((_s->PercentFull[x][y] <= 0)
+      && (_s->CellDepth[x][y] > _s->shoreface_depth)
+      && (x <= 0 || _s->CellDepth[x - 1][y] == _s->shoreface_depth))
+  {
+    y_left = (y == 0) ? wrap - 1 : y - 1;
+    y_right = (y == wrap - 1) ? 0 : y + 1;
+
+    if ((x >= _s->nx - 1 || _s->CellDepth[x + 1][y] == _s->shoreface_depth)
+        && (_s->CellDepth[x][y_left] == _s->shoreface_depth)
+        && (_s->CellDepth[x][y_right] == _s->shoreface_depth))
+    {
+      /* Fill Hole */
+      _s->CellDepth[x][y] = _s->shoreface_depth;
+      MarkFixCell (_s, x, y);
+    }
+  }
+  if (_s->PercentFull[x][y] > 100)
+  {
+    printf ("too full");
+    SetPercentFull (_s, x, y, 0);
+    MarkFixCell (_s, x, y);
+    PauseRun (_s, x, y, -1);
+  }
+
+  /* Take care of situations that shouldn't exist */
+
+  if (_s->PercentFull[x][y] < 0)
+  {
+    SetAllBeach (_s, x, y, 'n');
+    DEBUG_PRINT (DEBUG_9
+                 && y != 0,
+                 "\nUnder 0 Percent X: %d  Y: %d Percent: %f\n", x, y,
+                 _s->PercentFull[x][y]);
+    OopsImEmpty (_s, x, y);
+    printf ("Underzerofill");
+    /*PauseRun(x,y,-1); */
+  }
 
-      /* Take care of situations that shouldn't exist */
+  if (_s->PercentFull[x][y] > 1)
+  {
+    SetAllBeach (_s, x, y, 'y');
+    _s->CellDepth[x][y] = -LandHeight;
+    MarkFixCell (_s, x, y);
+    DEBUG_PRINT (DEBUG_9
+                 && y != 0, "\nOver 100 Percent X: %d  Y: %d Per: %f\n",
+                 x, y, _s->PercentFull[x][y]);
+    OopsImFull (_s, x, y);
+  }
+
+  if (((_s->PercentFull[x][y] >= 0) && (_s->PercentFull[x][y] < 1))
+      && (IS_BEACH (_s, x, y)))
+  {
+    SetAllBeach (_s, x, y, 'n');
+    _s->CellDepth[x][y] = -LandHeight;
+    MarkFixCell (_s, x, y);
+    DEBUG_PRINT (DEBUG_9 && y != 0, "\nALLBeachProb X: %d  Y: %d\n", x, y);
+  }
+
+  /* Take care of 'loose' bits of sand */
+
+  fillcells3 = 0;
+
+  y_left = (y == 0) ? wrap - 1 : y - 1;
+  y_right = (y == wrap - 1) ? 0 : y + 1;
 
-      if (_s->PercentFull[x][y] < 0)
+  /* If we're on the x-boundary, assume things are OK */
+  if ((x > 0 && x < _s->nx - 1)
+      && (_s->PercentFull[x][y] != 0)
+      && (_s->PercentFull[x - 1][y] < 1)
+      && (_s->PercentFull[x + 1][y] < 1)
+      && (_s->PercentFull[x][y_right] < 1)
+      && (_s->PercentFull[x][y_left] < 1) && (!IS_BEACH (_s, x, y)))
+    /* Beach in cell, but bottom, top, right, and left neighbors not all full */
+  {
+    DEBUG_PRINT (DEBUG_9
+                 && y != 0,
+                 "\nFB Moved loose bit of sand,  X: %d  Y: %d  Per: %f  ",
+                 x, y, _s->PercentFull[x][y]);
+
+    /* distribute to partially full neighbors */
+
+    if ((x <= 0 || _s->PercentFull[x - 1][y] < 1)
+        && (_s->PercentFull[x - 1][y] > 0))
+      fillcells3 += 1;
+    if ((_s->PercentFull[x + 1][y] < 1) && (_s->PercentFull[x + 1][y] > 0))
+      fillcells3 += 1;
+    if ((_s->PercentFull[x][y_left] < 1)
+        && (_s->PercentFull[x][y_left] > 0))
+      fillcells3 += 1;
+    if ((_s->PercentFull[x][y_right] < 1)
+        && (_s->PercentFull[x][y_right] > 0))
+      fillcells3 += 1;
+
+    if ((fillcells3 > 0))
+    {
+
+      if ((_s->PercentFull[x - 1][y] < 1)
+          && (_s->PercentFull[x - 1][y] > 0))
       {
-        _s->AllBeach[x][y] = 'n';
-        DEBUG_PRINT (DEBUG_9
-                     && y != 0,
-                     "\nUnder 0 Percent X: %d  Y: %d Percent: %f\n", x, y,
-                     _s->PercentFull[x][y]);
-        OopsImEmpty (_s, x, y);
-        printf ("Underzerofill");
-        /*PauseRun(x,y,-1); */
+        AddPercentFull (_s, x - 1, y, _s->PercentFull[x][y] / fillcells3);
+        DEBUG_PRINT (DEBUG_9, "  MOVEDBACK");
       }
-
-      if (_s->PercentFull[x][y] > 1)
+      if ((_s->PercentFull[x + 1][y] < 1)
+          && (_s->PercentFull[x + 1][y] > 0))
       {
-        _s->AllBeach[x][y] = 'y';
-        _s->CellDepth[x][y] = -LandHeight;
-        DEBUG_PRINT (DEBUG_9
-                     && y != 0, "\nOver 100 Percent X: %d  Y: %d Per: %f\n",
-                     x, y, _s->PercentFull[x][y]);
-        OopsImFull (_s, x, y);
+        AddPercentFull (_s, x + 1, y, _s->PercentFull[x][y] / fillcells3);
+        DEBUG_PRINT (DEBUG_9, "  MOVEDUP");
       }
-
-      if (((_s->PercentFull[x][y] >= 0) && (_s->PercentFull[x][y] < 1))
-          && (_s->AllBeach[x][y] == 'y'))
+      if ((_s->PercentFull[x][y_left] < 1)
+          && (_s->PercentFull[x][y_left] > 0))
+      {
+        AddPercentFull (_s, x, y_left, _s->PercentFull[x][y] / fillcells3);
+        DEBUG_PRINT (DEBUG_9, "  MOVEDLEFT");
+        /*if (DEBUG_9) PauseRun(x,y,-1); */
+      }
+      if ((_s->PercentFull[x][y_right] < 1)
+          && (_s->PercentFull[x][y_right] > 0))
       {
-        _s->AllBeach[x][y] = 'n';
-        _s->CellDepth[x][y] = -LandHeight;
-        DEBUG_PRINT (DEBUG_9 && y != 0, "\nALLBeachProb X: %d  Y: %d\n", x, y);
+        AddPercentFull (_s, x, y_right, _s->PercentFull[x][y] / fillcells3);
+        DEBUG_PRINT (DEBUG_9, "  MOVEDRIGHT");
+        /*if (DEBUG_9) PauseRun(x,y,-1); */
       }
+    }
+    else
+    {
+      printf
+        ("Loner fixbeach breakdown - mass disintegrated x: %d  y: %d\n",
+         x, y);
+      if (DEBUG_9)
+        PauseRun (_s, x, y, -1);
+    }
 
-      /* Take care of 'loose' bits of sand */
+    SetPercentFull (_s, x, y, 0);
+    SetAllBeach (_s, x, y, 'n');
+    _s->CellDepth[x][y] = _s->shoreface_depth;
+    MarkFixCell (_s, x, y);
+    MarkFixCell (_s, x - 1, y);
+    MarkFixCell (_s, x + 1, y);
+    MarkFixCell (_s, x, y_left);
+    MarkFixCell (_s, x, y_right);
 
-      fillcells3 = 0;
+    DEBUG_PRINT (DEBUG_9, "\n");
 
-      y_left = (y == 0) ? _s->ny - 1 : y - 1;
-      y_right = (y == _s->ny - 1) ? 0 : y + 1;
+    /* If we have overfilled any of the cells in this loop, need to OopsImFull() */
 
-      /* If we're on the x-boundary, assume things are OK */
-      if ((x > 0 && x < _s->nx - 1)
-          && (_s->PercentFull[x][y] != 0)
-          && (_s->PercentFull[x - 1][y] < 1)
-          && (_s->PercentFull[x + 1][y] < 1)
-          && (_s->PercentFull[x][y_right] < 1)
-          && (_s->PercentFull[x][y_left] < 1) && (_s->AllBeach[x][y] == 'n'))
-        /* Beach in cell, but bottom, top, right, and left neighbors not all full */
-      {
-        DEBUG_PRINT (DEBUG_9
-                     && y != 0,
-                     "\nFB Moved loose bit of sand,  X: %d  Y: %d  Per: %f  ",
-                     x, y, _s->PercentFull[x][y]);
-
-        /* distribute to partially full neighbors */
-
-        if ((x <= 0 || _s->PercentFull[x - 1][y] < 1)
-            && (_s->PercentFull[x - 1][y] > 0))
-          fillcells3 += 1;
-        if ((_s->PercentFull[x + 1][y] < 1) && (_s->PercentFull[x + 1][y] > 0))
-          fillcells3 += 1;
-        if ((_s->PercentFull[x][y_left] < 1)
-            && (_s->PercentFull[x][y_left] > 0))
-          fillcells3 += 1;
-        if ((_s->PercentFull[x][y_right] < 1)
-            && (_s->PercentFull[x][y_right] > 0))
-          fillcells3 += 1;
-
-        if ((fillcells3 > 0))
-        {
+    if (_s->PercentFull[x - 1][y] > 1)
+    {
+      OopsImFull (_s, x - 1, y);
+      DEBUG_PRINT (DEBUG_9, "	Below Overfilled\n");
+    }
+    if (_s->PercentFull[x][y_left] > 1)
+    {
+      OopsImFull (_s, x, y_left);
+      DEBUG_PRINT (DEBUG_9, "	Left Side Overfilled\n");
+    }
+    if (_s->PercentFull[x][y_right] > 1)
+    {
+      OopsImFull (_s, x, y_right);
+      DEBUG_PRINT (DEBUG_9, "	Right Side Overfilled\n");
+    }
+    if (_s->PercentFull[x + 1][y_right] > 1)
+    {
+      OopsImFull (_s, x + 1, y_right);
+      DEBUG_PRINT (DEBUG_9, "	Top Overfilled\n");
+    }
 
-          if ((_s->PercentFull[x - 1][y] < 1)
-              && (_s->PercentFull[x - 1][y] > 0))
-          {
-            _s->PercentFull[x - 1][y] += (_s->PercentFull[x][y]) / fillcells3;
-            DEBUG_PRINT (DEBUG_9, "  MOVEDBACK");
-          }
-          if ((_s->PercentFull[x + 1][y] < 1)
-              && (_s->PercentFull[x + 1][y] > 0))
-          {
-            _s->PercentFull[x + 1][y] += (_s->PercentFull[x][y]) / fillcells3;
-            DEBUG_PRINT (DEBUG_9, "  MOVEDUP");
-          }
-          if ((_s->PercentFull[x][y_left] < 1)
-              && (_s->PercentFull[x][y_left] > 0))
-          {
-            _s->PercentFull[x][y_left] += (_s->PercentFull[x][y]) / fillcells3;
-            DEBUG_PRINT (DEBUG_9, "  MOVEDLEFT");
-            /*if (DEBUG_9) PauseRun(x,y,-1); */
-          }
-          if ((_s->PercentFull[x][y_right] < 1)
-              && (_s->PercentFull[x][y_right] > 0))
-          {
-            _s->PercentFull[x][y_right] += (_s->PercentFull[x][y]) / fillcells3;
-            DEBUG_PRINT (DEBUG_9, "  MOVEDRIGHT");
-            /*if (DEBUG_9) PauseRun(x,y,-1); */
-          }
-        }
-        else
-        {
-          printf
-            ("Loner fixbeach breakdown - mass disintegrated x: %d  y: %d\n",
-             x, y);
-          if (DEBUG_9)
-            PauseRun (_s, x, y, -1);
-        }
+  }
 
-        _s->PercentFull[x][y] = 0;
-        _s->AllBeach[x][y] = 'n';
-        _s->CellDepth[x][y] = _s->shoreface_depth;
+  /*if ((IS_BEACH (_s, x, y)) && (_s->PercentFull[x-1][y] < 1) && (_s->PercentFull[x+1][y] < 1)
+     && (_s->PercentFull[x][y-1] < 1) && (_s->PercentFull[x][y+1] < 1)
+     && (!IS_BEACH (_s, x-1, y-1)) && (!IS_BEACH (_s, x-1, y+1)) &&
+     (!IS_BEACH (_s, x+1, y+1)) && (!IS_BEACH (_s, x+1, y-1)) )
 
-        DEBUG_PRINT (DEBUG_9, "\n");
+     {
+     printf("%% Booger !! x: %d  y: %d", x,y);
+     PauseRun(x,y,-1);
+     } */
+}
 
-        /* If we have overfilled any of the cells in this loop, need to OopsImFull() */
+/**
+FixBeach for when only some cells can need fixing
 
-        if (_s->PercentFull[x - 1][y] > 1)
-        {
-          OopsImFull (_s, x - 1, y);
-          DEBUG_PRINT (DEBUG_9, "	Below Overfilled\n");
-        }
-        if (_s->PercentFull[x][y_left] > 1)
-        {
-          OopsImFull (_s, x, y_left);
-          DEBUG_PRINT (DEBUG_9, "	Left Side Overfilled\n");
-        }
-        if (_s->PercentFull[x][y_right] > 1)
-        {
-          OopsImFull (_s, x, y_right);
-          DEBUG_PRINT (DEBUG_9, "	Right Side Overfilled\n");
-        }
-        if (_s->PercentFull[x + 1][y_right] > 1)
-        {
-          OopsImFull (_s, x + 1, y_right);
-          DEBUG_PRINT (DEBUG_9, "	Top Overfilled\n");
-        }
+Only cells next to ones changed since the last FixBeach (_s->FixList[]),
+and rows that have never been looked at, can need fixing.  They are taken
+in the order the full sweep would reach them, and as fixing a cell changes
+others, their neighbors still ahead in the sweep are added - so the
+results are the same as looking at every cell.
+*/
+void
+FixBeachWorklist (State * _s, int FixXMax, int sweepsign)
+{
+  const int w = _s->ny_grid;
+  int *heap;
+  int n,
+    k,
+    kept,
+    drained;
+  int x,
+    y;
 
-      }
+  /* Queue the neighbors of everything changed since last time.  Cells */
+  /* next to rows beyond FixXMax stay on the list for a later FixBeach */
+
+  for (k = 0, kept = 0; k < _s->NumFix; k++)
+  {
+    const int c = _s->FixList[k];
+
+    x = c / w;
+    y = c % w;
+
+    QueueFixNeighbors (_s, c, FixXMax, sweepsign, -1);
+
+    if (x + 1 >= FixXMax)
+      _s->FixList[kept++] = c;
+    else
+      _s->FixBits[c / 64] &= ~((uint64_t) 1 << (c % 64));
+  }
+  _s->NumFix = kept;
+
+  for (x = _s->FixScannedXMax; x < FixXMax; x++)
+    for (y = 0; y < w; y++)
+      QueueFixCell (_s, CELL_INDEX (_s, x, y), FixXMax, sweepsign, -1);
+  if (FixXMax > _s->FixScannedXMax)
+    _s->FixScannedXMax = FixXMax;
+
+  drained = _s->NumFix;
 
-      /*if ((_s->AllBeach[x][y] =='y') && (_s->PercentFull[x-1][y] < 1) && (_s->PercentFull[x+1][y] < 1)
-         && (_s->PercentFull[x][y-1] < 1) && (_s->PercentFull[x][y+1] < 1)
-         && (_s->AllBeach[x-1][y-1] == 'n') && (_s->AllBeach[x-1][y+1] == 'n') &&
-         (_s->AllBeach[x+1][y+1] == 'n') && (_s->AllBeach[x+1][y-1] == 'n') )
+  while (_s->NumFixQueued > 0)
+  {
+    int key,
+      i,
+      child;
+
+    /* Pop the cell the sweep comes to first */
+
+    heap = _s->FixQueue;
+    key = heap[0];
+    n = --_s->NumFixQueued;
+    for (i = 0; (child = 2 * i + 1) < n; i = child)
+    {
+      if (child + 1 < n && heap[child + 1] < heap[child])
+        child++;
+      if (heap[n] <= heap[child])
+        break;
+      heap[i] = heap[child];
+    }
+    heap[i] = heap[n];
+
+    x = FixXMax - 1 - key / w;
+    y = (sweepsign == 1) ? key % w : w - 1 - key % w;
+    k = CELL_INDEX (_s, x, y);
+    _s->FixQueued[k / 64] &= ~((uint64_t) 1 << (k % 64));
 
-         {
-         printf("%% Booger !! x: %d  y: %d", x,y);
-         PauseRun(x,y,-1);
-         } */
+    FixBeachCell (_s, x, y);
 
+    /* Anything that just changed may need its neighbors fixed further on */
+
+    for (; drained < _s->NumFix; drained++)
+    {
+      QueueFixNeighbors (_s, _s->FixList[drained], FixXMax, sweepsign, key);
     }
   }
-#if 0
+}
+
+/** Queues for FixBeachWorklist the cells that look at cell c when they
+are fixed - its neighbors along the row and in the rows either side
+
+OopsImFull and OopsImEmpty step off the end of a row into the next one, so
+neighbors are found by CELL_INDEX rather than by wrapping y.  FixBeachCell
+itself wraps y (at ny, or at the ends of the row with a halo), which adds
+a neighbor at either end of the wrap.
+*/
+void
+QueueFixNeighbors (State * _s, int c, int FixXMax, int sweepsign, int after)
+{
+  const int w = _s->ny_grid;
+  const int y = c % w;
+  const int wrap = HAS_HALO (_s) ? w : _s->ny;
+
+  QueueFixCell (_s, c, FixXMax, sweepsign, after);
+  QueueFixCell (_s, c - 1, FixXMax, sweepsign, after);
+  QueueFixCell (_s, c + 1, FixXMax, sweepsign, after);
+  QueueFixCell (_s, c - w, FixXMax, sweepsign, after);
+  QueueFixCell (_s, c + w, FixXMax, sweepsign, after);
+  if (y == wrap - 1)
+    QueueFixCell (_s, c - y, FixXMax, sweepsign, after);
+  if (y == 0)
+    QueueFixCell (_s, c + wrap - 1, FixXMax, sweepsign, after);
+}
+
+/** Queues cell c for FixBeachWorklist, if it is below FixXMax, not
+already queued, and comes after the key after in the sweep
+*/
+void
+QueueFixCell (State * _s, int c, int FixXMax, int sweepsign, int after)
+{
+  const int w = _s->ny_grid;
+  int key,
+    x,
+    y,
+    i;
+
+  if (c < 0 || c >= FixXMax * w)
+    return;
+
+  x = c / w;
+  y = c % w;
+  key = (FixXMax - 1 - x) * w + ((sweepsign == 1) ? y : w - 1 - y);
+  if (key <= after || (_s->FixQueued[c / 64] & ((uint64_t) 1 << (c % 64))))
+    return;
+
+  if (_s->NumFixQueued == _s->FixQueueCap)
   {
-    fprintf (stderr, "***\n");
-    int i;
+    const int cap = (_s->FixQueueCap > 0) ? 2 * _s->FixQueueCap : 1024;
+    int *queue = (int *)realloc (_s->FixQueue, sizeof (int) * cap);
 
-    for (i = 0; i < _s->nx; i++)
-      fprintf (stderr, "[%d][250] = %c\n", i, _s->AllBeach[i][250]);
+    /* No room - the next FixBeach looks at every cell instead */
+    if (!queue)
+    {
+      _s->FixAll = TRUE;
+      return;
+    }
+    _s->FixQueue = queue;
+    _s->FixQueueCap = cap;
   }
-#endif
-  DEBUG_PRINT (DEBUG_ERIC, "*** Out FixBeach\n");
+
+  _s->FixQueued[c / 64] |= (uint64_t) 1 << (c % 64);
+
+  for (i = _s->NumFixQueued++; i > 0 && _s->FixQueue[(i - 1) / 2] > key;
+       i = (i - 1) / 2)
+    _s->FixQueue[i] = _s->FixQueue[(i - 1) / 2];
+  _s->FixQueue[i] = key;
 }
 
+/** Notes that cell (x, y) has changed, so that it and its neighbors are
+looked at by the next FixBeach
+*/
+void
+MarkFixCell (State * _s, int x, int y)
+{
+  const int c = CELL_INDEX (_s, x, y);
+
+  /* Cells off the end of a row are the start of the next (see */
+  /* QueueFixNeighbors) */
+  if (c < 0 || c >= _s->nx * _s->ny_grid)
+    return;
+
+  if (_s->FixBits[c / 64] & ((uint64_t) 1 << (c % 64)))
+    return;
+
+  if (_s->NumFix == _s->FixListCap)
+  {
+    const int cap = (_s->FixListCap > 0) ? 2 * _s->FixListCap : 1024;
+    int *list = (int *)realloc (_s->FixList, sizeof (int) * cap);
+
+    /* No room - the next FixBeach looks at every cell instead */
+    if (!list)
+    {
+      _s->FixAll = TRUE;
+      return;
+    }
+    _s->FixList = list;
+    _s->FixListCap = cap;
+  }
+
+  _s->FixBits[c / 64] |= (uint64_t) 1 << (c % 64);
+  _s->FixList[_s->NumFix++] = c;
+}
+
+
 /** Counts the total volume occupied by beach cells
 
 Uses same algorhythm as AdjustShore
 returns a double of the total sum
 Uses
-   _s->AllBeach[][] and _s->PercentFull[][]
+   _s->BeachBits and _s->PercentFull[][]
 and InitialDepth, _s->cell_width, ShelfSlope
 */
 double
 MassCount (State * _s)
 {
+  const double t0 = PROFILE_START (_s);
 
   int x,
     y;
@@ -3024,7 +3926,7 @@ MassCount (State * _s)
 
   for (x = 0; x < _s->nx; x++)
   {
-    for (y = _s->ny / 2; y < 3 * _s->ny / 2; y++)
+    for (y = _s->ny_lo; y < _s->ny_lo + _s->ny; y++)
     {
       /*if ((_s->PercentFull[x][y] > 0) && (_s->PercentFull[x][y] < 1.0))
          MassHere = _s->PercentFull[x][y] * (refdepth - _s->CellDepth[x][y]) +
@@ -3036,8 +3938,73 @@ MassCount (State * _s)
     }
   }
 
+  PROFILE_STOP (_s, DELTAS_PHASE_MASS_COUNT, t0);
   return Mass;
+}
+
+/** Adds amount to the running total of PercentFull (_s->MassCurrent)
+
+A compensated (Neumaier) sum, so that the millions of small changes made
+over a run don't lose precision.  The low order bits that don't fit in
+_s->MassCurrent are kept in _s->MassError.
+*/
+void
+AddMass (State * _s, double amount)
+{
+  const double Sum = _s->MassCurrent + amount;
 
+  if (fabs (_s->MassCurrent) >= fabs (amount))
+    _s->MassError += (_s->MassCurrent - Sum) + amount;
+  else
+    _s->MassError += (amount - Sum) + _s->MassCurrent;
+
+  _s->MassCurrent = Sum;
+}
+
+/** Adds amount to PercentFull of cell (x, y), keeping count of the mass
+
+A cell that was empty is stamped with the time step in _s->Age (if age is
+being kept).
+
+Only cells within the domain, columns [ny_lo, ny_lo + ny), are counted -
+as in MassCount.  Cells off the end of a row (y < 0 or y >= ny_grid) lie
+in the wrap regions of the neighboring rows, so aren't counted either.
+*/
+void
+AddPercentFull (State * _s, int x, int y, double amount)
+{
+  const int WasEmpty = (_s->PercentFull[x][y] == 0);
+
+  LogOverwashWrite (_s, x, y);
+
+  _s->PercentFull[x][y] += amount;
+
+  if (y >= _s->ny_lo && y < _s->ny_lo + _s->ny)
+  {
+    AddMass (_s, amount);
+    if (WasEmpty && _s->Age)
+      _s->Age[x][y] = _s->CurrentTimeStep % AGE_MAX;
+  }
+}
+
+/** Sets PercentFull of cell (x, y) to value, keeping count of the mass
+*/
+void
+SetPercentFull (State * _s, int x, int y, double value)
+{
+  const double Change = value - _s->PercentFull[x][y];
+  const int WasEmpty = (_s->PercentFull[x][y] == 0);
+
+  LogOverwashWrite (_s, x, y);
+
+  _s->PercentFull[x][y] = value;
+
+  if (y >= _s->ny_lo && y < _s->ny_lo + _s->ny)
+  {
+    AddMass (_s, Change);
+    if (WasEmpty && _s->Age)
+      _s->Age[x][y] = _s->CurrentTimeStep % AGE_MAX;
+  }
 }
 
 /** calulates b to the e power
@@ -3053,14 +4020,135 @@ Raise (double b, double e)
     return -powf (fabs (b), e);
 }
 
+/** Starts r at x, y, to be stepped along angle
+
+y is measured from column ylo of the grid.  The slope is clamped away from
+zero and infinity as each of the old stepping loops did.  If
+float_distances, steps compare their distances through Raise, as the
+loops toward land did.
+*/
+void
+RayStart (Ray * r, double x, double y, int ylo, double angle, int xsign,
+          int ysign, int float_distances)
+{
+  if (angle == 0.0)
+  {
+    /* unlikely, but make sure no div by zero */
+    r->slope = 0.00001;
+  }
+  else if (fabs (angle) == 90.0)
+  {
+    r->slope = 9999.9;
+  }
+  else
+  {
+    r->slope = fabs (tan (angle));
+  }
+
+  r->x = x;
+  r->y = y;
+  r->ylo = ylo;
+  r->xsign = xsign;
+  r->ysign = ysign;
+  r->float_distances = float_distances;
+  r->xtest = INT_MIN;
+  r->ytest = INT_MIN;
+}
+
+/** Steps r into the next cell along its line
+
+Whichever of the next whole x and whole y the line crosses first is
+where it goes.  The distances to the two crossings are found and compared
+just as the stepping loops each caller used to have did, so that a line
+passing within rounding of a corner goes the same way theirs did.
+*/
+void
+RayStep (Ray * r)
+{
+  const int NextXInt = (r->xsign > 0) ? floor (r->x) + 1 : ceil (r->x) - 1;
+  const int NextYInt = (r->ysign > 0) ? floor (r->y) + 1 : ceil (r->y - 1);
+
+  /* moving to next whole 'x' position, what is y position? */
+  const double Ynext = r->y + fabs (NextXInt - r->x) * r->slope * r->ysign;
+
+  /* moving to next whole 'y' position, what is x position? */
+  const double Xside = r->x + fabs (NextYInt - r->y) / r->slope * r->xsign;
+
+  double DistanceNext = ((Ynext - r->y) * (Ynext - r->y)
+                         + (NextXInt - r->x) * (NextXInt - r->x));
+  double DistanceSide = ((NextYInt - r->y) * (NextYInt - r->y)
+                         + (Xside - r->x) * (Xside - r->x));
+
+  if (r->float_distances)
+  {
+    DistanceNext = Raise (DistanceNext, .5);
+    DistanceSide = Raise (DistanceSide, .5);
+  }
+
+  if (DistanceNext < DistanceSide)
+  {
+    r->x = NextXInt;
+    r->y = Ynext;
+    r->xtest = (r->xsign > 0) ? NextXInt : NextXInt - 1;
+    r->ytest = floor (r->y) + r->ylo;
+  }
+  else
+  {
+    r->x = Xside;
+    r->y = NextYInt;
+    r->xtest = floor (r->x);
+    r->ytest = NextYInt + (r->ysign - 1) / 2 + r->ylo;
+  }
+}
+
+/** Is the rest of r's line, down to xend, all beach?
+
+TRUE if, from the cell r has just stepped into, the line reaches xend
+without leaving that cell's column, and every cell of the column down to
+the one holding xend (and one more, for slack) is all beach.  Anything
+else, FALSE, including when the line would cross into another column.
+*/
+int
+RayInBeach (State * _s, const Ray * r, double xend)
+{
+  const double yend = r->y + (r->x - xend) * r->slope * r->ysign;
+  const int ycell = r->ytest - r->ylo;  /* measured as y is */
+  int bottom = floor (xend) - 1;
+
+  if (r->ysign > 0 ? yend > ycell + 1 - RAY_SLACK
+      : yend < ycell + RAY_SLACK)
+    return FALSE;
+
+  if (bottom < 0)
+    bottom = 0;
+
+  return _s->BarrierWidth[CELL_INDEX (_s, r->xtest, r->ytest)]
+    >= r->xtest - bottom + 1;
+}
+
+/** Grows ow's box to hold cell (x, y) and its neighbors */
+static inline void
+WidenOverwash (Overwash * ow, int x, int y)
+{
+  if (x - 1 < ow->xlo)
+    ow->xlo = x - 1;
+  if (x + 1 > ow->xhi)
+    ow->xhi = x + 1;
+  if (y - 1 < ow->ylo)
+    ow->ylo = y - 1;
+  if (y + 1 > ow->yhi)
+    ow->yhi = y + 1;
+}
+
 /** return a random number equally distributed between zero and one
 
-currently this function has no seed
+Numbers come from the generator owned by _s, seeded from _s->seed when the
+model is initialized.
 */
 double
-RandZeroToOne (void)
+RandZeroToOne (State * _s)
 {
-  return random () / (Raise (2, 31) - 1);
+  return cem_rng_uniform (&_s->rng);
 }
 
 /** Creates initial beach conditions
@@ -3077,11 +4165,26 @@ InitConds (State * _s)
   printf ("Condition Initial \n");
   DEBUG_PRINT (DEBUG_ERIC, "*** In InitConds\n");
 
-  if (InitCType == 0)
+  if (!_s->init_barrier)
     /* 'Regular Initial cons - beach backed by sandy land */
   {
+    /* The loop comes to the beach row once per column, in column order, */
+    /* so its fullness can be drawn all at once.  It is drawn as for wrap */
+    /* regions half a domain wide, so a thin halo starts from the same    */
+    /* beach                                                              */
+    if (!InitialSmooth && InitBeach < _s->nx)
+    {
+      const int skip = _s->ny / 2 - _s->ny_lo;
+
+      for (y = 0; y < skip; y++)
+        RandZeroToOne (_s);
+      cem_rng_fill_uniform (&_s->rng, _s->PercentFull[InitBeach],
+                            _s->ny_grid);
+      for (y = skip + _s->ny_grid; y < 2 * _s->ny; y++)
+        RandZeroToOne (_s);
+    }
 
-    for (y = 0; y < 2 * _s->ny; y++)
+    for (y = 0; y < _s->ny_grid; y++)
       for (x = 0; x < _s->nx; x++)
       {
         _s->CellDepth[x][y] =
@@ -3090,7 +4193,7 @@ InitConds (State * _s)
         if (x < InitBeach)
         {
           _s->PercentFull[x][y] = 1;
-          _s->AllBeach[x][y] = 'y';
+          SetAllBeach (_s, x, y, 'y');
           _s->CellDepth[x][y] = -LandHeight;
         }
         else if (x == InitBeach)
@@ -3099,18 +4202,14 @@ InitConds (State * _s)
           {
             _s->PercentFull[x][y] = .5;
           }
-          else
-          {
-            _s->PercentFull[x][y] = RandZeroToOne ();
-            //printf("x: %d  Y: %d  Per: %f\n",x,y,_s->PercentFull[x][y]);
-          }
-          _s->AllBeach[x][y] = 'n';
+          /* otherwise drawn before the loop */
+          SetAllBeach (_s, x, y, 'n');
           _s->CellDepth[x][y] = -LandHeight;
         }
         else if (x > InitBeach)
         {
           _s->PercentFull[x][y] = 0;
-          _s->AllBeach[x][y] = 'n';
+          SetAllBeach (_s, x, y, 'n');
           if (_s->CellDepth[x][y] < _s->shoreface_depth)
           {
             _s->CellDepth[x][y] = _s->shoreface_depth;
@@ -3121,16 +4220,26 @@ InitConds (State * _s)
           printf ("WTF! x: %d  Y: %d  Per: %f\n", x, y, _s->PercentFull[x][y]);
           PauseRun (_s, x, y, -1);
         }
-
-        _s->Age[x][y] = 0;
       }
   }
 
-  else if (InitCType == 1)
+  else
     /* 'Simple Barrier' type initial condition - island backed by lagoon at slope of shelf */
   {
-
-    for (y = 0; y <= 2 * _s->ny; y++)
+    /* The beach and the back of the barrier are drawn column by column, */
+    /* as for wrap regions half a domain wide, as above                   */
+    const int skip = _s->ny / 2 - _s->ny_lo;
+    int draws = 0;
+
+    for (x = 0; x < _s->nx && !InitialSmooth; x++)
+      if ((InitialDepth + ((x - InitBeach) * _s->cell_width *
+                           _s->shelf_slope) > 0)
+          && (x == InitBeach || x == InitBeach - InitBWidth - 1))
+        draws++;
+    for (y = 0; y < draws * skip; y++)
+      RandZeroToOne (_s);
+
+    for (y = 0; y < _s->ny_grid; y++)
     {
       for (x = 0; x < _s->nx; x++)
       {
@@ -3142,14 +4251,14 @@ InitConds (State * _s)
           /* This must be land due to continental shelf intersection */
         {
           _s->PercentFull[x][y] = 1.0;
-          _s->AllBeach[x][y] = 'y';
+          SetAllBeach (_s, x, y, 'y');
           _s->CellDepth[x][y] = -LandHeight;
         }
         else if (x > InitBeach)
           /* Shoreward of beach - enforce ShorefaceDepth if necessary */
         {
           _s->PercentFull[x][y] = 0;
-          _s->AllBeach[x][y] = 'n';
+          SetAllBeach (_s, x, y, 'n');
           if (_s->CellDepth[x][y] < _s->shoreface_depth)
           {
             _s->CellDepth[x][y] = _s->shoreface_depth;
@@ -3164,17 +4273,17 @@ InitConds (State * _s)
           }
           else
           {
-            _s->PercentFull[x][y] = RandZeroToOne ();
+            _s->PercentFull[x][y] = RandZeroToOne (_s);
             /*printf("x: %d  Y: %d  Per: %f\n",x,y,_s->PercentFull[x][y]); */
           }
-          _s->AllBeach[x][y] = 'n';
+          SetAllBeach (_s, x, y, 'n');
           _s->CellDepth[x][y] = -LandHeight;
         }
         else if ((x < InitBeach) && (x > InitBeach - InitBWidth - 1))
           /* Island */
         {
           _s->PercentFull[x][y] = 1.0;
-          _s->AllBeach[x][y] = 'y';
+          SetAllBeach (_s, x, y, 'y');
           _s->CellDepth[x][y] = -LandHeight;
         }
         else if (x == InitBeach - InitBWidth - 1)
@@ -3186,26 +4295,29 @@ InitConds (State * _s)
           }
           else
           {
-            _s->PercentFull[x][y] = RandZeroToOne ();
+            _s->PercentFull[x][y] = RandZeroToOne (_s);
             printf ("x: %d  Y: %d  Per: %f\n", x, y, _s->PercentFull[x][y]);
           }
-          _s->AllBeach[x][y] = 'n';
+          SetAllBeach (_s, x, y, 'n');
           _s->CellDepth[x][y] = -LandHeight;
         }
         else if (x < InitBeach - InitBWidth - 1)
           /* Lagoon at depth of shelf slope  */
         {
           _s->PercentFull[x][y] = 0;
-          _s->AllBeach[x][y] = 'n';
+          SetAllBeach (_s, x, y, 'n');
         }
         if (_s->PercentFull[x][y] > 1)
         {
           printf ("x: %d  Y: %d  Per: %f\n", x, y, _s->PercentFull[x][y]);
           PauseRun (_s, x, y, -1);
         }
-        _s->Age[x][y] = 0;
       }
     }
+
+    for (y = skip + _s->ny_grid; y < 2 * _s->ny; y++)
+      for (x = 0; x < draws; x++)
+        RandZeroToOne (_s);
   }
 
   /* Save initial depths */
@@ -3215,7 +4327,7 @@ InitConds (State * _s)
 
     const int i_len = _s->nx;
 
-    const int j_len = 2 * _s->ny;
+    const int j_len = _s->ny_grid;
 
     for (i = 0; i < i_len; i++)
       for (j = 0; j < j_len; j++)
@@ -3251,23 +4363,22 @@ InitPert (State * _s)
       for (y = PYstart; y <= PYstart + PWidth; y++)
       {
         _s->PercentFull[x][y] = 1.0;
-        _s->AllBeach[x][y] = 'y';
+        SetAllBeach (_s, x, y, 'y');
       }
     }
 
     /* PercentFull Top */
 
-    for (y = PYstart - 1; y <= PYstart + PWidth + 1; y++)
-    {
-      _s->PercentFull[InitBeach + PHeight + 1][y] = RandZeroToOne ();
-    }
+    cem_rng_fill_uniform (&_s->rng,
+                          _s->PercentFull[InitBeach + PHeight + 1] +
+                          PYstart - 1, PWidth + 3);
 
     /* PercentFull Sides */
 
     for (x = InitBeach; x <= InitBeach + PHeight; x++)
     {
-      _s->PercentFull[x][PYstart - 1] = RandZeroToOne ();
-      _s->PercentFull[x][PYstart + PWidth + 1] = RandZeroToOne ();
+      _s->PercentFull[x][PYstart - 1] = RandZeroToOne (_s);
+      _s->PercentFull[x][PYstart + PWidth + 1] = RandZeroToOne (_s);
     }
   }
 
@@ -3279,21 +4390,21 @@ InitPert (State * _s)
 
     _s->PercentFull[x][17] = 0.8;
     _s->PercentFull[x][18] = 1.0;
-    _s->AllBeach[x][18] = 'y';
+    SetAllBeach (_s, x, 18, 'y');
     _s->PercentFull[x][19] = 0.8;
 
     x = InitBeach + 1;
 
     _s->PercentFull[x][17] = 0.6;
     _s->PercentFull[x][18] = 1.0;
-    _s->AllBeach[x][18] = 'y';
+    SetAllBeach (_s, x, 18, 'y');
     _s->PercentFull[x][19] = 0.6;
 
     x = InitBeach + 2;
 
     _s->PercentFull[x][17] = 0.2;
     _s->PercentFull[x][18] = 1.0;
-    _s->AllBeach[x][18] = 'y';
+    SetAllBeach (_s, x, 18, 'y');
     _s->PercentFull[x][19] = 0.2;
 
     x = InitBeach + 3;
@@ -3306,60 +4417,87 @@ InitPert (State * _s)
 
 /** Simulates periodic boundary conditions by copying middle section to front
 and end of arrays
+
+Each row is copied as two contiguous blocks per array.  AllBeach goes
+through SetAllBeach, which only does anything where a cell differs, so
+the shoreline is only retraced around cells that actually changed.
+
+By default the wrap regions are half a domain wide each, so the grids
+are nx by 2ny.  deltas_set_halo_width narrows them to a halo a few cells
+wider than the longest line run out from a beach cell
+(deltas_halo_min_width), so less is kept, traced and copied.  A halo
+wraps FixBeachCell's neighbors at the ends of the row and cuts the search
+for the back of a barrier short (BackBarrierReach), so a run with one
+follows the default run closely rather than bit for bit.  The domain
+comes out the same whatever the width of the halo.
 */
 void
 PeriodicBoundaryCopy (State * _s)
 {
+  const double t0 = PROFILE_START (_s);
+  const int front = _s->ny_lo;  /* columns copied to the front */
+  const int back = _s->ny_grid - _s->ny - _s->ny_lo;  /* and to the end */
   int x,
     y;
 
   DEBUG_PRINT (DEBUG_ERIC, "*** In PeriodicBoundaryCopy\n");
 
-#if 0
+  for (x = 0; x < _s->nx; x++)
   {
-    int i;
-
-    fprintf (stderr, "***\n");
-    for (i = 0; i < _s->nx; i++)
-      fprintf (stderr, "[%d][250] = %c\n", i, _s->AllBeach[i][250]);
+    /*  [ny, ny + front) goes to [0, front), and [ny_lo, ny_lo + back) */
+    /*  to [ny_lo + ny, ny_grid)                                       */
+
+    for (y = 0; y < front; y++)
+      SetAllBeach (_s, x, y, IS_BEACH (_s, x, y + _s->ny) ? 'y' : 'n');
+    for (y = _s->ny_lo; y < _s->ny_lo + back; y++)
+      SetAllBeach (_s, x, y + _s->ny, IS_BEACH (_s, x, y) ? 'y' : 'n');
+
+    MarkCopiedCells (_s, _s->PercentFull, x, _s->ny, 0, front);
+    MarkCopiedCells (_s, _s->PercentFull, x, _s->ny_lo, _s->ny_lo + _s->ny,
+                     back);
+    MarkCopiedCells (_s, _s->CellDepth, x, _s->ny, 0, front);
+    MarkCopiedCells (_s, _s->CellDepth, x, _s->ny_lo, _s->ny_lo + _s->ny,
+                     back);
+
+    memcpy (_s->PercentFull[x], _s->PercentFull[x] + _s->ny,
+            front * sizeof (double));
+    memcpy (_s->PercentFull[x] + _s->ny_lo + _s->ny,
+            _s->PercentFull[x] + _s->ny_lo, back * sizeof (double));
+
+    memcpy (_s->CellDepth[x], _s->CellDepth[x] + _s->ny,
+            front * sizeof (double));
+    memcpy (_s->CellDepth[x] + _s->ny_lo + _s->ny,
+            _s->CellDepth[x] + _s->ny_lo, back * sizeof (double));
   }
 
-  fprintf (stderr, "AllBeach[31][250] = %c\n", _s->AllBeach[31][250]);
-#endif
-  for (y = _s->ny; y < 3 * _s->ny / 2; y++)
-    for (x = 0; x < _s->nx; x++)
-    {
-      _s->AllBeach[x][y - _s->ny] = _s->AllBeach[x][y];
-      _s->PercentFull[x][y - _s->ny] = _s->PercentFull[x][y];
-      _s->Age[x][y - _s->ny] = _s->Age[x][y];
-      _s->CellDepth[x][y - _s->ny] = _s->CellDepth[x][y];
-    }
+  DEBUG_PRINT (DEBUG_ERIC, "*** Out PeriodicBoundaryCopy\n");
 
-//fprintf (stderr, "AllBeach[31][250] = %c\n", _s->AllBeach[31][250]);
-  for (y = _s->ny / 2; y < _s->ny; y++)
-    for (x = 0; x < _s->nx; x++)
-    {
-      _s->AllBeach[x][y + _s->ny] = _s->AllBeach[x][y];
-      _s->PercentFull[x][y + _s->ny] = _s->PercentFull[x][y];
-      _s->Age[x][y + _s->ny] = _s->Age[x][y];
-      _s->CellDepth[x][y + _s->ny] = _s->CellDepth[x][y];
-    }
-#if 0
-  fprintf (stderr, "AllBeach[31][250] = %c\n", _s->AllBeach[31][250]);
-  {
-    int i;
+  PROFILE_STOP (_s, DELTAS_PHASE_PERIODIC_COPY, t0);
+}
 
-    fprintf (stderr, "***\n");
-    for (i = 0; i < _s->nx; i++)
-      fprintf (stderr, "[%d][250] = %c\n", i, _s->AllBeach[i][250]);
-  }
-  fprintf (stderr, "*** Out PeriodicBoundaryCopy\n");
-  exit (0);
-#endif
-  DEBUG_PRINT (DEBUG_ERIC, "*** Out PeriodicBoundaryCopy\n");
+/** Marks the cells of row x that PeriodicBoundaryCopy is about to change
+by copying n cells of grid from column from to column to (see MarkFixCell)
+*/
+void
+MarkCopiedCells (State * _s, double **grid, int x, int from, int to, int n)
+{
+  const double *src = grid[x] + from;
+  const double *dest = grid[x] + to;
+  int y;
+
+  if (memcmp (src, dest, n * sizeof (double)) == 0)
+    return;
+
+  for (y = 0; y < n; y++)
+    if (src[y] != dest[y])
+      MarkFixCell (_s, x, to + y);
 }
 
 /** Resets all arrays recalculated at each time step to 'zero' conditions
+
+The shoreline itself (_s->X[], _s->Y[]) is kept up to date by FindShoreline.
+Nothing is written past the cells traced since the last full trace, so
+only those need resetting.
 */
 void
 ZeroVars (State * _s)
@@ -3367,10 +4505,8 @@ ZeroVars (State * _s)
 
   int z;
 
-  for (z = 0; z < _s->max_beach_len; z++)
+  for (z = 0; z < _s->ShoreTraced; z++)
   {
-    _s->X[z] = -1;
-    _s->Y[z] = -1;
     _s->InShadow[z] = '?';
     _s->ShorelineAngle[z] = -999;
     _s->SurroundingAngle[z] = -998;
@@ -3381,181 +4517,392 @@ ZeroVars (State * _s)
 }
 
 /**  Reads saved output file,
-   _s->AllBeach[][] & _s->PercentFull[][]
+   _s->BeachBits & _s->PercentFull[][]
+
+The file is PercentFull then CellDepth and, if it was saved with them,
+cell ages, as SaveSandToFile writes it.  Returns FALSE, leaving the grid
+part read, if the file can't be read or doesn't hold a grid of this
+shape.
 */
-void
+int
 ReadSandFromFile (State * _s)
 {
+  const size_t n = (size_t) _s->nx * _s->ny;
+  cem_text t;
+  size_t n_values;
+  int ok = TRUE;
   int x,
     y;
 
-  FILE *ReadSandFile;
-
-  ReadSandFile = fopen (_s->readfilename, "r");
+  if (!_s->readfilename || !cem_text_open (&t, _s->readfilename))
+  {
+    fprintf (stderr, "*** Unable to open %s\n",
+             _s->readfilename ? _s->readfilename : "(no read file)");
+    return FALSE;
+  }
   printf ("CHECK READ \n");
 
-  for (y = _s->ny / 2; y < 3 * _s->ny / 2; y++)
+  n_values = cem_text_count (&t);
+  if (n_values != 2 * n && n_values != 3 * n)
+  {
+    fprintf (stderr,
+             "*** %s has %lu values; a %d by %d grid needs %lu, or %lu with "
+             "cell ages\n", _s->readfilename, (unsigned long)n_values,
+             _s->nx, _s->ny, (unsigned long)(2 * n),
+             (unsigned long)(3 * n));
+    cem_text_close (&t);
+    return FALSE;
+  }
+
+  for (y = _s->ny_lo; ok && y < _s->ny_lo + _s->ny; y++)
+    for (x = 0; ok && x < _s->nx; x++)
+    {
+      ok = cem_text_double (&t, &_s->PercentFull[x][y]);
+
+      if (_s->PercentFull[x][y] >= 1.0)
+        SetAllBeach (_s, x, y, 'y');
+      else
+        SetAllBeach (_s, x, y, 'n');
+    }
+
+  for (y = _s->ny_lo; ok && y < _s->ny_lo + _s->ny; y++)
+    for (x = 0; ok && x < _s->nx; x++)
+      ok = cem_text_double (&t, &_s->CellDepth[x][y]);
+
+  if (n_values == 3 * n)
+    for (y = _s->ny_lo; ok && y < _s->ny_lo + _s->ny; y++)
+      for (x = 0; ok && x < _s->nx; x++)
+      {
+        int Age;
+
+        ok = cem_text_int (&t, &Age);
+        if (_s->Age)
+          _s->Age[x][y] = Age;
+      }
+
+  if (!ok)
+    fprintf (stderr, "*** %s, line %d: expected a number\n",
+             _s->readfilename, t.line);
+
+  /*PrintLocalConds(5,5,-1); */
+  cem_text_close (&t);
+  if (ok)
+    printf ("file read!");
+
+  PeriodicBoundaryCopy (_s);
+
+  return ok;
+}
+
+/**
+Saves current
+   _s->BeachBits and _s->PercentFull[][]
+data arrays to file
+
+Save file name will add extension '.' and the _s->CurrentTimeStep.  The
+grids are copied and written out by _s->writer while the run carries on
+(see WriteSand).		*/
+void
+SaveSandToFile (State * _s)
+{
+  const double t0 = PROFILE_START (_s);
+  const int n = _s->nx * _s->ny;
+  char name[OUTPUT_NAME_MAX];
+  cem_output *out;
+  int x,
+    y;
+
+  if (!_s->writer)
+    _s->writer = cem_writer_new (OUTPUT_BUFFERS);
+  if (!_s->writer)
+  {
+    fprintf (stderr, "*** Unable to start the output writer\n");
+    PROFILE_STOP (_s, DELTAS_PHASE_OUTPUT, t0);
+    return;
+  }
+
+  if (_s->archivename && !_s->archive)
+  {
+    if (OutputName (_s, name, _s->archivename))
+      _s->archive = cem_archive_open (name, _s->nx, _s->ny, 2);
+    if (!_s->archive)
+    {
+      free (_s->archivename);
+      _s->archivename = NULL;
+    }
+  }
+
+  if (_s->archive)
+    OutputName (_s, name, _s->archivename);
+  else
+  {
+    char base[OUTPUT_NAME_MAX];
+
+    if (!OutputName (_s, base, _s->savefilename)
+        || snprintf (name, OUTPUT_NAME_MAX, "%s.%d", base,
+                     _s->CurrentTimeStep) >= OUTPUT_NAME_MAX)
+    {
+      fprintf (stderr, "*** Save file name is too long; not saving time "
+               "step %d\n", _s->CurrentTimeStep);
+      PROFILE_STOP (_s, DELTAS_PHASE_OUTPUT, t0);
+      return;
+    }
+  }
+
+  out = cem_writer_get (_s->writer, 2 * n, SaveAge ? n : 0);
+  if (!out)
+  {
+    fprintf (stderr, "*** Unable to allocate output for time step %d\n",
+             _s->CurrentTimeStep);
+    PROFILE_STOP (_s, DELTAS_PHASE_OUTPUT, t0);
+    return;
+  }
+  out->time_step = _s->CurrentTimeStep;
+  out->nx = _s->nx;
+  out->ny = _s->ny;
+  strcpy (out->name, name);
+
+  if (_s->archive)
+  {
+    printf ("Saving to: %s \n", out->name);
+    out->write = ArchiveSand;
+    out->data = _s->archive;
+  }
+  else
+  {
+    printf ("Saving as: %s \n", out->name);
+    out->format = WriteSand;
+  }
+
+  for (x = 0; x < _s->nx; x++)
   {
+    memcpy (out->values + x * _s->ny, _s->PercentFull[x] + _s->ny_lo,
+            sizeof (double) * _s->ny);
+    memcpy (out->values + n + x * _s->ny, _s->CellDepth[x] + _s->ny_lo,
+            sizeof (double) * _s->ny);
+  }
 
+  if (SaveAge && !_s->archive)
     for (x = 0; x < _s->nx; x++)
-    {
-      fscanf (ReadSandFile, " %lf", &_s->PercentFull[x][y]);
+      for (y = 0; y < _s->ny; y++)
+        out->ints[x * _s->ny + y] =
+          _s->Age ? deltas_cell_age (_s, x, y + _s->ny_lo) : 0;
 
-      if (_s->PercentFull[x][y] >= 1.0)
-        _s->AllBeach[x][y] = 'y';
-      else
-        _s->AllBeach[x][y] = 'n';
-    }
-  }
+  cem_writer_submit (_s->writer, out);
 
-  for (y = _s->ny / 2; y < 3 * _s->ny / 2; y++)
-    for (x = 0; x < _s->nx; x++)
-      fscanf (ReadSandFile, " %lf", &_s->CellDepth[x][y]);
+  PROFILE_STOP (_s, DELTAS_PHASE_OUTPUT, t0);
+}
 
-  if (SaveAge)
+/** Puts the name of one of _s's output files in buffer (of
+OUTPUT_NAME_MAX)
 
-    for (y = _s->ny / 2; y < 3 * _s->ny / 2; y++)
-    {
-      for (x = 0; x < _s->nx; x++)
-      {
-        fscanf (ReadSandFile, " %d", &_s->Age[x][y]);
-      }
-    }
+Members of an ensemble run side by side, so each adds ".member<n>" to
+keep to files of its own (see deltas_run_ensemble).
 
-  /*PrintLocalConds(5,5,-1); */
-  fclose (ReadSandFile);
-  printf ("file read!");
+Returns FALSE, with a message, if the name doesn't fit.  A cut name could
+be the same as another member's, so it mustn't be used.
+*/
+int
+OutputName (State * _s, char *buffer, const char *name)
+{
+  int len;
 
-  PeriodicBoundaryCopy (_s);
+  if (_s->member >= 0)
+    len = snprintf (buffer, OUTPUT_NAME_MAX, "%s.member%d", name,
+                    _s->member);
+  else
+    len = snprintf (buffer, OUTPUT_NAME_MAX, "%s", name);
 
+  if (len < 0 || len >= OUTPUT_NAME_MAX)
+  {
+    fprintf (stderr, "*** Output name %s is too long\n", name);
+    return FALSE;
+  }
+  return TRUE;
 }
 
-/**
-Saves current
-   _s->AllBeach[][] and _s->PercentFull[][]
-data arrays to file
-
-Save file name will add extension '.' and the _s->CurrentTimeStep		*/
+/** Writes a snapshot taken by SaveSandToFile, in the order
+ReadSandFromFile reads it back
+*/
 void
-SaveSandToFile (State * _s)
+WriteSand (FILE * fp, const cem_output * out)
 {
+  const int n = out->nx * out->ny;
   int x,
     y;
 
-  char savename[40];
+  for (y = 0; y < out->ny; y++)
+    for (x = 0; x < out->nx; x++)
+      fprintf (fp, " %f", out->values[x * out->ny + y]);
 
-  FILE *SaveSandFile;
-
-  printf ("\n saving \n ");
-
-  sprintf (savename, "%s.%d", _s->savefilename, _s->CurrentTimeStep);
-  printf ("Saving as: %s 		", savename);
-
-  SaveSandFile = fopen (savename, "w");
-  if (!SaveSandFile)
-  {
-    printf ("problem opening output file\n");
-    exit (1);
-  }
-
-  for (y = _s->ny / 2; y < 3 * _s->ny / 2; y++)
-    for (x = 0; x < _s->nx; x++)
-      fprintf (SaveSandFile, " %f", _s->PercentFull[x][y]);
-
-  for (y = _s->ny / 2; y < 3 * _s->ny / 2; y++)
-    for (x = 0; x < _s->nx; x++)
-      fprintf (SaveSandFile, " %f", _s->CellDepth[x][y]);
+  for (y = 0; y < out->ny; y++)
+    for (x = 0; x < out->nx; x++)
+      fprintf (fp, " %f", out->values[n + x * out->ny + y]);
 
   if (SaveAge)
-    for (y = _s->ny / 2; y < 3 * _s->ny / 2; y++)
-      for (x = 0; x < _s->nx; x++)
-        fprintf (SaveSandFile, " %d", _s->Age[x][y]);
+    for (y = 0; y < out->ny; y++)
+      for (x = 0; x < out->nx; x++)
+        fprintf (fp, " %d", out->ints[x * out->ny + y]);
+}
 
-  fclose (SaveSandFile);
-  printf ("--- regular file saved! ----\n\n");
+/** Appends the shoreline to the shoreline stream
 
-}
+The stream is _s->shorelinename if it's set, otherwise SAVE_LINE_NAME.
+Positions come from the shoreline FindShoreline last traced, so there is
+no need to search the grid for it.  As a row of columns, each y has the
+position of its most seaward beach cell plus the fill of the cells
+behind it down to full beach, as the lineout files had; as a polyline,
+each traced cell is a point (see deltas_shoreline.h).
 
-/**  Saves data line of shoreline position rather than entire array
+The frame is copied out and appended by _s->writer, after any snapshots
+already queued (see AppendLine).
 
-Main concern is to have only one data point at each alongshore location
-Save file name will add extension '.' and the _s->CurrentTimeStep		*/
+If the stream can't be opened, that is said once and no more shorelines
+are saved, until deltas_set_shoreline_file names another stream.
+*/
 void
 SaveLineToFile (State * _s)
 {
-
-  int y,
+  const double t0 = PROFILE_START (_s);
+  const char *stream = _s->shorelinename ? _s->shorelinename : SAVE_LINE_NAME;
+  cem_output *out;
+  double *line;
+  int n = 0;
+  int i,
     x,
-    xtop,
-    i;
-
-  double xsave;
-
-  char savename[40];
-
-  char savelinename[24] = SAVE_LINE_NAME;
+    y;
 
-  FILE *SaveSandFile;
+  if (_s->shoreline_failed)
+  {
+    PROFILE_STOP (_s, DELTAS_PHASE_OUTPUT, t0);
+    return;
+  }
 
-  printf ("\n saving \n ");
+  if (!_s->writer)
+    _s->writer = cem_writer_new (OUTPUT_BUFFERS);
+  if (!_s->writer)
+  {
+    fprintf (stderr, "*** Unable to start the output writer\n");
+    PROFILE_STOP (_s, DELTAS_PHASE_OUTPUT, t0);
+    return;
+  }
 
-  sprintf (savename, "%s%d", savelinename, _s->CurrentTimeStep);
-  printf ("Saving as: %s                 ", savename);
+  if (!_s->shoreline)
+  {
+    char name[OUTPUT_NAME_MAX];
+
+    if (OutputName (_s, name, stream))
+      _s->shoreline =
+        cem_shoreline_open (name, _s->nx, _s->ny,
+                            _s->shoreline_polyline ? SHORELINE_POLYLINE :
+                            SHORELINE_COLUMNS);
+    if (!_s->shoreline)
+    {
+      fprintf (stderr, "*** No more shorelines are saved to %s\n", name);
+      _s->shoreline_failed = TRUE;
+      PROFILE_STOP (_s, DELTAS_PHASE_OUTPUT, t0);
+      return;
+    }
+  }
 
-  SaveSandFile = fopen (savename, "w");
-  if (!SaveSandFile)
+  out = cem_writer_get (_s->writer, _s->shoreline_polyline ?
+                        2 * _s->TotalBeachCells : _s->ny, 0);
+  if (!out)
   {
-    printf ("problem opening output file\n");
-    exit (1);
+    fprintf (stderr, "*** Unable to allocate output for time step %d\n",
+             _s->CurrentTimeStep);
+    PROFILE_STOP (_s, DELTAS_PHASE_OUTPUT, t0);
+    return;
   }
+  OutputName (_s, out->name, stream);
+  out->write = AppendLine;
+  out->data = _s->shoreline;
+  out->time_step = _s->CurrentTimeStep;
+  line = out->values;
 
-  for (y = _s->ny / 2; y < 3 * _s->ny / 2; y++)
+  if (_s->shoreline_polyline)
   {
+    for (i = 0; i < _s->TotalBeachCells; i++)
+    {
+      x = _s->X[i];
+      y = _s->Y[i];
+      if (x < 0 || y < _s->ny_lo || y >= _s->ny_lo + _s->ny)
+        continue;
 
-    x = _s->nx - 1;
-    xtop = _s->nx;
+      line[n++] = x + _s->PercentFull[x][y] - InitBeach - 0.5;
+      line[n++] = y - _s->ny_lo;
+    }
+  }
+  else
+  {
+    n = _s->ny;
 
-    /* step back to where we encounter allbeach */
-    while (_s->AllBeach[x][y] == 'n')
+    /* Most seaward traced cell of each column */
+    for (y = 0; y < _s->ny; y++)
+      line[y] = -1;
+    for (i = 0; i < _s->TotalBeachCells; i++)
     {
-      x -= 1;
+      y = _s->Y[i] - _s->ny_lo;
+      if (_s->X[i] >= 0 && y >= 0 && y < _s->ny && _s->X[i] > line[y])
+        line[y] = _s->X[i];
     }
 
-    /* if on side of shape, need to average */
-    if (_s->PercentFull[x + 2][y] > 0)
+    for (y = 0; y < _s->ny; y++)
     {
-      xtop = x + 1;
-      while (_s->PercentFull[xtop][y] > 0)
+      double xsave = 0.;
+
+      if (line[y] < 0)
       {
-        xtop += 1;
+        line[y] = NAN;
+        continue;
       }
 
-      xsave = x;
-
-      for (i = x + 1; i < xtop; i++)
-        xsave += _s->PercentFull[i][y];
+      for (x = (int) line[y];
+           x > 0 && !IS_BEACH (_s, x, y + _s->ny_lo); x--)
+        xsave += _s->PercentFull[x][y + _s->ny_lo];
 
+      /* note this assumes average of beach locations should be 0.5 percentfull */
+      line[y] = x + xsave - InitBeach + 0.5;
     }
-    /* otherwise Regular Beach Condition */
-    else
-    {
-      xsave = x + _s->PercentFull[x + 1][y];
-    }
+  }
 
-    /* note this assumes average of beach locations should be 0.5 percentfull */
-    fprintf (SaveSandFile, " %f", xsave - InitBeach + 0.5);
+  out->nx = n;
+  out->ny = 1;
+  cem_writer_submit (_s->writer, out);
 
-    /*printf("y %d , xtop = %d xsave = %f \n",y,xtop,xsave);
-       if (xtop != _s->nx)
-       PauseRun(x+1,y,-1);                  */
+  PROFILE_STOP (_s, DELTAS_PHASE_OUTPUT, t0);
+}
 
-  }
+/** Adds a snapshot taken by SaveSandToFile to the archive as a frame of
+PercentFull then CellDepth; cell ages aren't archived
+*/
+int
+ArchiveSand (const cem_output * out)
+{
+  return cem_archive_append ((cem_archive *) out->data, out->time_step,
+                             out->values);
+}
+
+/** Appends a frame taken by SaveLineToFile (out->nx positions) to the
+shoreline stream
+*/
+int
+AppendLine (const cem_output * out)
+{
+  cem_shoreline *l = (cem_shoreline *) out->data;
+  float *frame = cem_shoreline_frame (l, out->nx);
+  int i;
+
+  if (!frame)
+    return FALSE;
 
-  fclose (SaveSandFile);
-  printf ("line file saved!\n\n");
+  for (i = 0; i < out->nx; i++)
+    frame[i] = out->values[i];
 
+  return cem_shoreline_append (l, out->time_step, out->nx);
 }
 
+
 /** Prints Local Array Conditions aound x,y
 */
 void
@@ -3612,7 +4959,7 @@ PrintLocalConds (State * _s, int x, int y, int in)
   {
     for (j = y - 2; j < y + 3; j++)
     {
-      printf ("	%c", _s->AllBeach[i][j]);
+      printf ("	%c", IS_BEACH (_s, i, j) ? 'y' : 'n');
     }
     printf ("\n");
   }
@@ -3763,23 +5110,22 @@ ButtonEnter (State * _s)
 
 }
 
-/** Age Cells
+/** Age of cell (x, y) - the time step it was last empty
+
+Cells are stamped by AddPercentFull and SetPercentFull as they fill, so an
+empty cell is as young as the current time step.  Cells in the periodic
+copies of the domain share the stamp of the cell they copy.
 */
-void
-AgeCells (State * _s)
+int
+deltas_cell_age (State * _s, int x, int y)
 {
-  int x,
-    y;
-
-  int AgeMax = AGE_MAX;
-
-  for (y = 0; y < 2 * _s->ny; y++)
-    for (x = 0; x < _s->nx; x++)
-      if (_s->PercentFull[x][y] == 0)
-      {
-        _s->Age[x][y] = _s->CurrentTimeStep % AgeMax;
-      }
+  const int AgeMax = AGE_MAX;
+  const int yd = _s->ny_lo + ((y - _s->ny_lo) % _s->ny + _s->ny) % _s->ny;
 
+  if (_s->PercentFull[x][yd] == 0)
+    return _s->CurrentTimeStep % AgeMax;
+  else
+    return _s->Age[x][yd];
 }
 
 /** Input Wave Distribution
@@ -3908,7 +5254,7 @@ PutPixel (State * _s, double x, double y, double R, double G, double B)
   /* translate x and y integer components to the openGL grid */
 
   xstart = (x - _s->nx / 2.0) / (_s->nx / 2.0);
-  ystart = (y - _s->ny / 2.0) / (_s->ny / 2.0);
+  ystart = (y - _s->ny_lo) / (_s->ny / 2.0);
 
   glColor3f (R, G, B);
   glBegin (GL_POLYGON);
@@ -3944,6 +5290,8 @@ GraphCells (State * _s)
 
   int AgeShadeSpacing = AGE_SHADE_SPACING;      /* For graphics - how many time steps means back to original shade */
 
+  int Age;
+
   DepthFactorX = XPlotExtent;
   for (y = _s->yplotoff; y <= YPlotExtent + _s->yplotoff; y++)
 
@@ -3957,16 +5305,16 @@ GraphCells (State * _s)
       DepthBlue = floor ((.8 - (double)x / (XPlotExtent * 3)) * 255) / 255.0;
       /*  PutPixel( CELL_PIXEL_SIZE*(y-yplotoff), CELL_PIXEL_SIZE*x,0,0, DepthBlue); */
 
-      AgeFactorRed =
-        (double)((_s->Age[x][y]) % AgeShadeSpacing) / AgeShadeSpacing;
+      Age = _s->Age ? deltas_cell_age (_s, x, y) : 0;
+      AgeFactorRed = (double)(Age % AgeShadeSpacing) / AgeShadeSpacing;
       AgeFactorGreen =
-        (double)((_s->Age[x][y] +
+        (double)((Age +
                  AgeShadeSpacing / 3) % AgeShadeSpacing) / AgeShadeSpacing;
       AgeFactorBlue =
-        (double)((_s->Age[x][y] +
+        (double)((Age +
                  2 * AgeShadeSpacing / 3) % AgeShadeSpacing) / AgeShadeSpacing;
 
-      if ((_s->PercentFull[x][y] > 0) && (_s->AllBeach[x][y] == 'n'))
+      if ((_s->PercentFull[x][y] > 0) && (!IS_BEACH (_s, x, y)))
       {
         Red =
           ((((235 - 100 * (AgeFactorRed)) -
@@ -3979,7 +5327,7 @@ GraphCells (State * _s)
              backBlue) * _s->PercentFull[x][y]) + backBlue) / 255.0;
 
       }
-      else if (_s->AllBeach[x][y] == 'y')
+      else if (IS_BEACH (_s, x, y))
       {
         Red =
           ((((235 - 100 * (AgeFactorRed)) -
@@ -4005,9 +5353,9 @@ GraphCells (State * _s)
   x = 0;
 
   //y = _s->stream_spot;
-  y = _s->ny;
+  y = _s->ny_grid / 2;
 
-  while (_s->AllBeach[x][y] == 'y')
+  while (IS_BEACH (_s, x, y))
   {
     PutPixel (_s, x - _s->xplotoff, y - _s->yplotoff, 1, 0, 0);
     x += 1;
@@ -4045,29 +5393,34 @@ At certain alongshore location, add certain amount of sed to the coast
 void
 DeliverSediment (State * _s)
 {
+  const double t0 = PROFILE_START (_s);
 
   int x,
     y;
 
   x = 0;
   //y = _s->stream_spot;
-  y = _s->ny;
+  y = _s->ny_grid / 2;
 
-  while (_s->AllBeach[x][y] == 'y')
+  while (IS_BEACH (_s, x, y))
   {
     x += 1;
   }
 
   fprintf (stderr, "Delivering sediment at x = %d\n", x);
 
-  _s->PercentFull[x][y] += _s->SedRate;
+  AddPercentFull (_s, x, y, _s->SedRate);
+  MarkFixCell (_s, x, y);
 
   fprintf (stderr, "Percent full at %d, %d = %f\n", x, y, _s->PercentFull[x][y]);
+
+  PROFILE_STOP (_s, DELTAS_PHASE_RIVERS, t0);
 }
 
 void
 DeliverRivers (State * _s)
 {
+  const double t0 = PROFILE_START (_s);
   int i;
 
   for (i = 0; i < _s->n_rivers; i++)
@@ -4075,6 +5428,8 @@ DeliverRivers (State * _s)
 //fprintf (stderr, "  river flux [%d] = %f\n", i, _s->river_flux[i]);
     AddRiverFlux (_s, _s->river_x_ind[i], _s->river_y_ind[i], _s->river_flux[i]);
   }
+
+  PROFILE_STOP (_s, DELTAS_PHASE_RIVERS, t0);
 }
 
 double
@@ -4103,8 +5458,10 @@ FindFluvialShorefaceDepth (State * _s, int i)
   Distance = _s->shoreface_depth / _s->cell_width / _s->shoreface_slope;
   Xintdouble = _s->X[i] + 0.5 + Distance * cos (_s->SurroundingAngle[i]);
   Xintint = floor (Xintdouble);
-  Yintdouble = _s->Y[i] + 0.5 - Distance * sin (_s->SurroundingAngle[i]);
-  Yintint = floor (Yintdouble);
+  /* measured as AdjustShore does */
+  Yintdouble = _s->Y[i] - LINE_YLO (_s) + 0.5
+    - Distance * sin (_s->SurroundingAngle[i]);
+  Yintint = floor (Yintdouble) + LINE_YLO (_s);
 
   DEBUG_PRINT (DEBUG_7A,
                "xs: %d  ys: %d  Xint: %f Xint:%d Yint: %f Yint: %d  Dint: %f SAng: %f Sin = %f\n",
@@ -4113,16 +5470,18 @@ FindFluvialShorefaceDepth (State * _s, int i)
                _s->SurroundingAngle[i] * radtodeg,
                sin (_s->SurroundingAngle[i]));
 
-  if ((Yintint < 0) || (Yintint > 2 * _s->ny))
+  if ((Yintint < 0) || (Yintint >= _s->ny_grid))
   {
     Depth = _s->shoreface_depth;
-    if ((Yintint > _s->ny / 2) && (Yintint < 3 / 2 * _s->ny))
+    /* Only the wrap regions should look off the grid - a cell of the */
+    /* domain doing so means the wrap regions are too narrow          */
+    if ((_s->Y[i] >= _s->ny_lo) && (_s->Y[i] < _s->ny_lo + _s->ny))
     {
       printf ("Periodic Boundary conditions and Depth Out of Bounds");
       PauseRun (_s, _s->X[i], _s->Y[i], i);
     }
   }
-  else if ((Xintint < 0) || (Xintint > _s->nx))
+  else if ((Xintint < 0) || (Xintint >= _s->nx))
   {
     Depth = _s->shoreface_depth;
     printf ("-- Warning - depth location off of x array: X %d Y %d", Xintint,
@@ -4178,7 +5537,9 @@ fprintf (stderr, "  (x,y) = %d, %d\n", xin, yin);
 }
 */
 
-  _s->PercentFull[xin][yin] += DeltaArea / (_s->cell_width * _s->cell_width);
+  AddPercentFull (_s, xin, yin,
+                  DeltaArea / (_s->cell_width * _s->cell_width));
+  MarkFixCell (_s, xin, yin);
 }
 
 void
@@ -4247,16 +5608,16 @@ AddRiverFlux (State * _s, int xin, int yin, double sedin)
     int x;
 
     fprintf (stderr, "  [%d][%d] is not on the coast!\n", xin, yin);
-    if (_s->AllBeach[xin][yin] == 'y')
+    if (IS_BEACH (_s, xin, yin))
     {
       fprintf (stderr, "  Looking seaward\n");
-      for (x = xin; x < _s->nx && _s->AllBeach[x][yin] == 'y'; x++);
+      for (x = xin; x < _s->nx && IS_BEACH (_s, x, yin); x++);
       fprintf (stderr, "  Found [%d][%d]\n", x, yin);
     }
     else
     {
       fprintf (stderr, "  Looking landward\n");
-      for (x = xin; x >= 0 && _s->AllBeach[x][yin] != 'y'; x--);
+      for (x = xin; x >= 0 && !IS_BEACH (_s, x, yin); x--);
       x += 1;
       fprintf (stderr, "  Found [%d][%d]\n", x, yin);
     }
@@ -4298,9 +5659,9 @@ DeliverSedimentFlux (State * _s)
 
   x = 0;
   //y = _s->stream_spot;
-  y = _s->ny;
+  y = _s->ny_grid / 2;
 
-  while (_s->AllBeach[x][y] == 'y')
+  while (IS_BEACH (_s, x, y))
   {
     x += 1;
   }
@@ -4335,7 +5696,8 @@ DeliverSedimentFlux (State * _s)
 
     //fprintf (stderr, "fraction is %f\n", fraction);
     //fprintf (stderr, "percent full is %f\n", _s->PercentFull[x][y]);
-    _s->PercentFull[x][y] += fraction;
+    AddPercentFull (_s, x, y, fraction);
+    MarkFixCell (_s, x, y);
     //_s->PercentFull[x][y] += SED_RATE;
     //if (_s->PercentFull[x][y] > 1)
     //  fprintf (stderr, "percent full is %f\n", _s->PercentFull[x][y]);
@@ -4348,18 +5710,27 @@ DeliverSedimentFlux (State * _s)
 /** Just a loop to call overwash check founction CheckOverwash
 
 Nothing done here, but can be down when CheckOVerwash is called
+
+With a pool, every cell's overwash is looked for at once (FindOverwash
+only reads the grid), and the sweep then applies them in its own order.
+A cell is looked at again, in turn, if an overwash earlier in the sweep
+wrote to any cell it looked at - so the result is the serial sweep's,
+whatever the number of threads.  If there isn't memory to keep track of
+the cells written, the rest of the sweep is done serially.
 */
 void
 CheckOverwashSweep (State * _s)
 {
-  double OverwashLimit = OVERWASH_LIMIT;
+  const double t0 = PROFILE_START (_s);
+  int parallel = _s->pool
+    && _s->TotalBeachCells - 2 >= 2 * BORDERS_PER_TASK;
 
   int i,
     ii;                         /* local loop variable */
 
   int sweepsign;
 
-  if (RandZeroToOne () * 2 > 1)
+  if (RandZeroToOne (_s) * 2 > 1)
   {
     sweepsign = 1;
     DEBUG_PRINT (DEBUG_10A, "L  ");
@@ -4370,6 +5741,19 @@ CheckOverwashSweep (State * _s)
     DEBUG_PRINT (DEBUG_10A, "R  ");
   }
 
+  if (parallel && !_s->OverwashBits)
+  {
+    _s->OverwashBits = (uint64_t *)
+      calloc ((_s->nx * _s->ny_grid + 63) / 64, sizeof (uint64_t));
+    parallel = (_s->OverwashBits != NULL);
+  }
+
+  if (parallel)
+  {
+    cem_pool_run (_s->pool, BorderTasks (_s), FindOverwashTask, _s);
+    _s->NumOverwashLog = 0;
+  }
+
   OWflag = 0;
   for (i = 1; i < _s->TotalBeachCells - 1; i++)
   {
@@ -4381,34 +5765,172 @@ CheckOverwashSweep (State * _s)
     /* To do test shoreline should be facing seaward                                        */
     /* don't worry about shadow here, as overwash is not set to a time scale with AST       */
 
-    if ((fabs (_s->SurroundingAngle[ii]) < (OverwashLimit / radtodeg))
-        && (_s->InShadow[ii] == 'n'))
+    if (CanOverwash (_s, ii))
     {
-      CheckOverwash (_s, ii);
+      if (_s->NumOverwashLog >= 0)
+        ApplyOverwash (_s, ii);
+      else
+        CheckOverwash (_s, ii);
     }
 
   }
 
+  StopOverwashLog (_s);
+
   /*if (OWflag) PauseRun(1,1,-1); */
+
+  PROFILE_STOP (_s, DELTAS_PHASE_OVERWASH, t0);
+}
+
+/** Is beach cell i facing the waves closely enough to be checked for
+overwash?
+*/
+int
+CanOverwash (State * _s, int i)
+{
+  double OverwashLimit = OVERWASH_LIMIT;
+
+  return (fabs (_s->SurroundingAngle[i]) < (OverwashLimit / radtodeg))
+    && (_s->InShadow[i] == 'n');
+}
+
+/**
+Runs FindOverwash, into _s->Overwashes[], over the cells of the task'th
+of the BorderTasks blocks of beach cells that CanOverwash
+*/
+void
+FindOverwashTask (void *data, int task)
+{
+  State *_s = (State *) data;
+  int n_tasks = BorderTasks (_s);
+  long n_cells = _s->TotalBeachCells - 2;
+  int i;
+
+  for (i = 1 + n_cells * task / n_tasks;
+       i < 1 + n_cells * (task + 1) / n_tasks; i++)
+    if (CanOverwash (_s, i))
+      _s->Overwashes[i].found = FindOverwash (_s, i, _s->Overwashes + i);
+}
+
+/** Does the overwash FindOverwashTask found for beach cell icheck
+
+If a cell it looked at has been written since, it is looked for again.
+*/
+void
+ApplyOverwash (State * _s, int icheck)
+{
+  const Overwash *ow = _s->Overwashes + icheck;
+
+  if (OverwashLogged (_s, ow))
+    CheckOverwash (_s, icheck);
+  else if (ow->found)
+  {
+    DoOverwash (_s, _s->X[icheck], _s->Y[icheck], ow->xto, ow->yto,
+                ow->xint, ow->yint, ow->width, icheck);
+    OWflag = 1;
+  }
+}
+
+/** Adds cell (x, y) to the cells written during the overwash sweep, if
+they are being logged
+*/
+void
+LogOverwashWrite (State * _s, int x, int y)
+{
+  const int c = CELL_INDEX (_s, x, y);
+
+  if (_s->NumOverwashLog < 0 || c < 0 || c >= _s->nx * _s->ny_grid
+      || (_s->OverwashBits[c / 64] & ((uint64_t) 1 << (c % 64))))
+    return;
+
+  if (_s->NumOverwashLog == _s->OverwashLogCap)
+  {
+    const int cap = (_s->OverwashLogCap > 0) ?
+      2 * _s->OverwashLogCap : OVERWASH_LOG_MIN;
+    int *log = (int *)realloc (_s->OverwashLog, sizeof (int) * cap);
+
+    /* The write can't be kept track of, so CheckOverwashSweep does the */
+    /* rest of the sweep serially                                       */
+    if (!log)
+    {
+      StopOverwashLog (_s);
+      return;
+    }
+    _s->OverwashLog = log;
+    _s->OverwashLogCap = cap;
+  }
+
+  _s->OverwashBits[c / 64] |= (uint64_t) 1 << (c % 64);
+  _s->OverwashLog[_s->NumOverwashLog++] = c;
+}
+
+/** Stops logging the cells written during the overwash sweep, and forgets
+those already logged
+*/
+void
+StopOverwashLog (State * _s)
+{
+  int i;
+
+  /* Every bit set is in a logged cell's word, so clearing those words */
+  /* clears them all                                                    */
+  for (i = 0; i < _s->NumOverwashLog; i++)
+    _s->OverwashBits[_s->OverwashLog[i] / 64] = 0;
+  _s->NumOverwashLog = -1;
+}
+
+/** Has any cell in ow's box been written since the sweep began?
+
+Cells off the end of a row are the start of the next (see MarkFixCell),
+so a box that runs off a row is always taken to have been written.
+*/
+int
+OverwashLogged (State * _s, const Overwash * ow)
+{
+  const int xlo = (ow->xlo > 0) ? ow->xlo : 0;
+  const int xhi = (ow->xhi < _s->nx - 1) ? ow->xhi : _s->nx - 1;
+  int x,
+    y;
+
+  if (ow->ylo < 0 || ow->yhi >= _s->ny_grid)
+    return TRUE;
+
+  if (_s->NumOverwashLog == 0)
+    return FALSE;
+
+  for (x = xlo; x <= xhi; x++)
+    for (y = ow->ylo; y <= ow->yhi; y++)
+    {
+      const int c = CELL_INDEX (_s, x, y);
+
+      if (_s->OverwashBits[c / 64] & ((uint64_t) 1 << (c % 64)))
+        return TRUE;
+    }
+
+  return FALSE;
 }
 
 /**
 New 1/04 ADA - Step back pixelwise in direction of Surrounding Angle to
 check needage
 
-If too short, calls DoOverwash, which will move some sediment
+If too short, returns TRUE, with where DoOverwash should move some
+sediment to in ow.  Only reads the grid, so any number of cells can be
+looked at at once; ow's box is set to hold every cell read.
 
 Uses
-   _s->AllBeach[][] and _s->PercentFull[][]
+   _s->BeachBits, _s->PercentFull[][] and _s->BarrierWidth[]
 (can be changed when DoOVerwash is called)
 
 Need to change sweepsign because filling cells should affect neighbors
 'x' and 'y' hold real-space values, will be mapped onto ineger array
 */
-void
-CheckOverwash (State * _s, int icheck)
+int
+FindOverwash (State * _s, int icheck, Overwash * ow)
 {
 
+  Ray ray;                      /* checking line back across the barrier */
+
   double slope;                  /* slope of zero goes staight back */
 
   int ysign;                    /* holder for going left or right alongshore */
@@ -4422,19 +5944,18 @@ CheckOverwash (State * _s, int icheck)
   int xtest,
     ytest;                      /* cell looking at */
 
+  int ycell;                    /* ytest, measured as yin is */
+
+  const int ylo = LINE_YLO (_s);
+
   double xint,
     yint;                       /* intercepts of overwash line in overwashable cell */
 
-  int NextXInt,
-    NextYInt;                   /* holder vairables for cell to check */
-
-  double Ydown,
-    DistanceDown;               /* when going to next x cell, what other values */
+  double checkdistance;          /* distance of checking line (cells, squared) - minimum, not actual width, ends loop */
 
-  double Xside,
-    DistanceSide;               /* when gpoing to next y cell,other values */
+  const double CritBCells = CritBWidth / _s->cell_width;
 
-  double checkdistance;          /* distance of checking line- minimum, not actual width, ends loop */
+  double xend;                   /* the line can't step into a cell below this */
 
   double measwidth;              /* actual barrier width between cells */
 
@@ -4448,140 +5969,114 @@ CheckOverwash (State * _s, int icheck)
      else
      DEBUG_10A = 0; */
 
-  if (_s->SurroundingAngle[icheck] == 0.0)
-  {
-    /* unlikely, but make sure no div by zero */
-    slope = 0.00001;
-  }
-  else if (fabs (_s->SurroundingAngle[icheck]) == 90.0)
-  {
-    slope = 9999.9;
-  }
-  else
-  {
-    slope = fabs (tan (_s->SurroundingAngle[icheck]));
-  }
-
   if (_s->SurroundingAngle[icheck] > 0)
     ysign = 1;
   else
     ysign = -1;
 
-  DEBUG_PRINT (DEBUG_10A,
-               "\nI: %d------------- Surr: %f  %f Slope: %f sign: %d \n",
-               icheck, _s->SurroundingAngle[icheck],
-               _s->SurroundingAngle[icheck] * radtodeg, slope, ysign);
+  ow->xlo = _s->X[icheck] - 1;
+  ow->xhi = _s->X[icheck] + 1;
+  ow->ylo = _s->Y[icheck] - 1;
+  ow->yhi = _s->Y[icheck] + 1;
 
-  if (_s->AllBeach[_s->X[icheck] - 1][_s->Y[icheck]] == 'y'
-      || ((_s->AllBeach[_s->X[icheck]][_s->Y[icheck] - 1] == 'y')
-          && (_s->AllBeach[_s->X[icheck]][_s->Y[icheck] + 1] == 'y')))
+  if (IS_BEACH (_s, _s->X[icheck] - 1, _s->Y[icheck])
+      || ((IS_BEACH (_s, _s->X[icheck], _s->Y[icheck] - 1))
+          && (IS_BEACH (_s, _s->X[icheck], _s->Y[icheck] + 1))))
     /* 'regular condition' */
     /* plus 'stuck in the middle' situation (unlikely scenario) */
   {
     xin = _s->X[icheck] + _s->PercentFull[_s->X[icheck]][_s->Y[icheck]];
-    yin = _s->Y[icheck] + 0.5;
+    yin = _s->Y[icheck] - ylo + 0.5;
   }
-  else if (_s->AllBeach[_s->X[icheck]][_s->Y[icheck] - 1] == 'y')
+  else if (IS_BEACH (_s, _s->X[icheck], _s->Y[icheck] - 1))
     /* on right side */
   {
     xin = _s->X[icheck] + 0.5;
-    yin = _s->Y[icheck] + _s->PercentFull[_s->X[icheck]][_s->Y[icheck]];
+    yin = _s->Y[icheck] - ylo
+      + _s->PercentFull[_s->X[icheck]][_s->Y[icheck]];
     DEBUG_PRINT (DEBUG_10A, "-- Right xin: %f  yin: %f\n", xin, yin);
   }
-  else if (_s->AllBeach[_s->X[icheck]][_s->Y[icheck] + 1] == 'y')
+  else if (IS_BEACH (_s, _s->X[icheck], _s->Y[icheck] + 1))
     /* on left side */
   {
     xin = _s->X[icheck] + 0.5;
-    yin = _s->Y[icheck] + 1.0 - _s->PercentFull[_s->X[icheck]][_s->Y[icheck]];
+    yin = _s->Y[icheck] - ylo + 1.0
+      - _s->PercentFull[_s->X[icheck]][_s->Y[icheck]];
     DEBUG_PRINT (DEBUG_10A, "-- Left xin: %f  yin: %f\n", xin, yin);
   }
   else
     /* underneath, no overwash */
   {
-    return;
+    return FALSE;
   }
 
+  RayStart (&ray, xin, yin, ylo, _s->SurroundingAngle[icheck], -1, ysign,
+            TRUE);
+  slope = ray.slope;
+
+  DEBUG_PRINT (DEBUG_10A,
+               "\nI: %d------------- Surr: %f  %f Slope: %f sign: %d \n",
+               icheck, _s->SurroundingAngle[icheck],
+               _s->SurroundingAngle[icheck] * radtodeg, slope, ysign);
+
+  /* The length is checked before each step, and a step is at most root 2 */
+  xend = xin - (CritBCells + 2) / sqrt (1 + slope * slope);
+
   x = xin;
   y = yin;
   checkdistance = 0;
   AllBeachFlag = 0;
 
-  while ((checkdistance < CritBWidth) && (y > 0) && (y < 2 * _s->ny) && (x > 1))
+  while ((checkdistance < CritBCells * CritBCells) && (y > -ylo)
+         && (y < _s->ny_grid - ylo) && (x > 1))
   {
-    NextXInt = ceil (x) - 1;
-    if (ysign > 0)
-      NextYInt = floor (y) + 1;
-    else
-      NextYInt = ceil (y - 1);
-
-    /* moving to next whole 'x' position, what is y position? */
-    Ydown = y + (x - NextXInt) * slope * ysign;
-    DistanceDown =
-      Raise (((Ydown - y) * (Ydown - y) + (NextXInt - x) * (NextXInt - x)), .5);
-
-    /* moving to next whole 'y' position, what is x position? */
-    Xside = x - fabs (NextYInt - y) / slope;
-    DistanceSide =
-      Raise (((NextYInt - y) * (NextYInt - y) + (Xside - x) * (Xside - x)), .5);
-
-    DEBUG_PRINT (DEBUG_10A,
-                 "x: %f  y: %f  X:%d  Y: %d  Yd: %f  DistD: %f Xs: %f DistS: %f\n",
-                 x, y, NextXInt, NextYInt, Ydown, DistanceDown, Xside,
-                 DistanceSide);
-
-    if (DistanceDown < DistanceSide)
-      /* next cell is the down cell */
-    {
-      x = NextXInt;
-      y = Ydown;
-      xtest = NextXInt - 1;
-      ytest = floor (y);
-      /*DEBUG_PRINT( DEBUG_10A, " down "); */
-    }
-    else
-      /* next cell is the side cell */
-    {
-      x = Xside;
-      y = NextYInt;
-      xtest = floor (x);
-      ytest = y + (ysign - 1) / 2;
-      /*DEBUG_PRINT( DEBUG_10A, " side "); */
-    }
+    RayStep (&ray);
+    x = ray.x;
+    y = ray.y;
+    xtest = ray.xtest;
+    ytest = ray.ytest;
+    ycell = ytest - ylo;
+    WidenOverwash (ow, xtest, ytest);
 
     /*if ((DEBUG_10A) && (DoGraphics == 'y'))PutPixel(ytest*CELL_PIXEL_SIZE,xtest*CELL_PIXEL_SIZE,0,0,200); */
 
-    checkdistance =
-      Raise (((x - xin) * (x - xin) + (y - yin) * (y - yin)),
-             .5) * _s->cell_width;
-    if (_s->AllBeach[xtest][ytest] == 'y')
+    checkdistance = (x - xin) * (x - xin) + (y - yin) * (y - yin);
+    if (IS_BEACH (_s, xtest, ytest))
+    {
       AllBeachFlag = 1;
 
+      /* Land from here to the end of the line - too wide to wash over */
+      WidenOverwash (ow, floor (xend), ytest);
+      if (!_s->exact_overwash && RayInBeach (_s, &ray, xend))
+        return FALSE;
+    }
+
     DEBUG_PRINT (DEBUG_10A,
                  "	x: %f  y: %f  xtest: %d ytest: %d check: %f\n\n", x, y,
                  xtest, ytest, checkdistance);
 
-    if ((_s->AllBeach[xtest][ytest] == 'n') && (AllBeachFlag)
+    if ((!IS_BEACH (_s, xtest, ytest)) && (AllBeachFlag)
         && !(((_s->X[icheck] - xtest) > 1)
              || (abs (ytest - _s->Y[icheck]) > 1)))
       /* if passed through an allbeach and a neighboring partial cell, jump out, only bad things follow */
     {
-      return;
+      return FALSE;
     }
 
-    if ((_s->AllBeach[xtest][ytest] == 'n') && (AllBeachFlag)
+    if ((!IS_BEACH (_s, xtest, ytest)) && (AllBeachFlag)
         && (xtest < _s->X[icheck]) && (((_s->X[icheck] - xtest) > 1)
                                        || (abs (ytest - _s->Y[icheck]) > 1)))
       /* Looking for shore cells, but don't want immediate neighbors, and go backwards */
       /* Also mush pass though an allbeach cell along the way */
     {
 
-      if (_s->AllBeach[xtest + 1][ytest] == 'y')
+      if (IS_BEACH (_s, xtest + 1, ytest))
         /* 'regular condition' - UNDERNEATH, here */
       {
         xint = (xtest + 1 - _s->PercentFull[xtest][ytest]);
         yint = yin + (xin - xint) * ysign * slope;
 
-        if ((yint > ytest + 1.0) || (yint < ytest))
+        if ((yint > ycell + 1.0) || (yint < ycell))
           /* This cell isn't actually an overwash cell */
         {
           measwidth = CritBWidth;
@@ -4600,10 +6095,10 @@ CheckOverwash (State * _s, int icheck)
                        xin, yin, xtest, ytest, xint, yint, slope, measwidth);
         }
       }
-      else if (_s->AllBeach[xtest][ytest - 1] == 'y')
+      else if (IS_BEACH (_s, xtest, ytest - 1))
         /* on right side */
       {
-        yint = (ytest + _s->PercentFull[xtest][ytest]);
+        yint = (ycell + _s->PercentFull[xtest][ytest]);
         xint = xin - fabs (yin - yint) / slope;
 
         if (xint < xtest)
@@ -4626,10 +6121,10 @@ CheckOverwash (State * _s, int icheck)
                        xin, yin, xtest, ytest, xint, yint, slope, measwidth);
         }
       }
-      else if (_s->AllBeach[xtest][ytest + 1] == 'y')
+      else if (IS_BEACH (_s, xtest, ytest + 1))
         /* on left side */
       {
-        yint = (ytest + 1 - _s->PercentFull[xtest][ytest]);
+        yint = (ycell + 1 - _s->PercentFull[xtest][ytest]);
         xint = xin - fabs (yin - yint) / slope;
 
         if (xint < xtest)
@@ -4652,14 +6147,14 @@ CheckOverwash (State * _s, int icheck)
                        xin, yin, xtest, ytest, xint, yint, slope, measwidth);
         }
       }
-      else if (_s->AllBeach[xtest - 1][ytest] == 'y')
+      else if (IS_BEACH (_s, xtest - 1, ytest))
         /* 'regular condition' */
         /* plus 'stuck in the middle' situation */
       {
         xint = (xtest + _s->PercentFull[xtest][ytest]);
         yint = yin + (xin - xint) * ysign * slope;
 
-        if ((yint > ytest + 1.0) || (yint < ytest))
+        if ((yint > ycell + 1.0) || (yint < ycell))
           /* This cell isn't actually an overwash cell */
         {
           measwidth = CritBWidth;
@@ -4712,15 +6207,17 @@ CheckOverwash (State * _s, int icheck)
         /*PauseRun(xtest,ytest,icheck); */
       }
 
-      checkdistance = measwidth;
+      checkdistance =
+        (measwidth / _s->cell_width) * (measwidth / _s->cell_width);
 
       if (measwidth < CritBWidth)
       {
-        DoOverwash (_s, _s->X[icheck], _s->Y[icheck], xtest, ytest, xint,
-                    yint, measwidth, icheck);
-        /* jump out of loop */
-        OWflag = 1;
-        return;
+        ow->xto = xtest;
+        ow->yto = ytest;
+        ow->xint = xint;
+        ow->yint = yint;
+        ow->width = measwidth;
+        return TRUE;
       }
 
     }
@@ -4728,6 +6225,22 @@ CheckOverwash (State * _s, int icheck)
   }
 /*	while(!getbutton(GKEY)){}*/
 
+  return FALSE;
+}
+
+/** Checks beach cell icheck for overwash, and does it if it's needed */
+void
+CheckOverwash (State * _s, int icheck)
+{
+  Overwash ow;
+
+  if (FindOverwash (_s, icheck, &ow))
+  {
+    DoOverwash (_s, _s->X[icheck], _s->Y[icheck], ow.xto, ow.yto, ow.xint,
+                ow.yint, ow.width, icheck);
+    /* jump out of loop */
+    OWflag = 1;
+  }
 }
 
 /**  given a cell where overwash is needed, move sediment back
@@ -4735,7 +6248,7 @@ CheckOverwash (State * _s, int icheck)
 *** ADA 09/03, rev 01/04
 for 'true' overwash based on shoreline angles
 will change and use
-   _s->PercentFull[][] and AllBeach [][]
+   _s->PercentFull[][] and _s->BeachBits
 */
 void
 DoOverwash (State * _s, int xfrom, int yfrom, int xto, int yto, double xintto,
@@ -4813,8 +6326,10 @@ DoOverwash (State * _s, int xfrom, int yfrom, int xto, int yto, double xintto,
 #endif
 #endif
 
-  _s->PercentFull[xto][yto] += delBB;
-  _s->PercentFull[xfrom][yfrom] -= delShore;
+  AddPercentFull (_s, xto, yto, delBB);
+  AddPercentFull (_s, xfrom, yfrom, -delShore);
+  MarkFixCell (_s, xto, yto);
+  MarkFixCell (_s, xfrom, yfrom);
 
   if (_s->PercentFull[xto][yto] > 1)
   {
@@ -4830,6 +6345,7 @@ DoOverwash (State * _s, int xfrom, int yfrom, int xto, int yto, double xintto,
     PauseRun (_s, xto, yto, -1);
 #endif
 
+  PROFILE_COUNT (_s, DELTAS_EVENT_OVERWASH, 1);
 }
 
 /** Rountine finds corresponding overwash depths
@@ -4837,6 +6353,9 @@ DoOverwash (State * _s, int xfrom, int yfrom, int xto, int yto, double xintto,
 OWType = 0 take the depth at neightbor to the backing cell
 OWType = 1 geometric rule based upon distance from back to shoreline
 AA 5/04
+
+xinfl, yinfl is where the overwash line crossed into the cell, with yinfl
+measured from LINE_YLO (see FindOverwash).
 */
 double
 GetOverwashDepth (State * _s, int xin, int yin, double xinfl, double yinfl,
@@ -4846,27 +6365,13 @@ GetOverwashDepth (State * _s, int xin, int yin, double xinfl, double yinfl,
 
   double Depth;
 
-  double BBDistance;             /* Distance from backshore to next shore */
-
-  double slope;                  /* slope of zero goes staight back */
-
-  int ysign;                    /* holder for going left or right alongshore */
+  double BBDistance = 0.;       /* Distance from backshore to next shore */
 
-  double x,
-    y;                          /* holders for 'real' location of x and y */
+  Ray ray;                      /* line to the back barrier - slope of zero goes staight back */
 
   int xtest = INT_MIN,
     ytest = INT_MIN;    /* cell looking at */
 
-  int NextXInt,
-    NextYInt;                   /* holder vairables for cell to check */
-
-  double Ydown,
-    DistanceDown;               /* when going to next x cell, what other values */
-
-  double Xside,
-    DistanceSide;               /* when gpoing to next y cell,other values */
-
   int BackFlag;                 /* Flag to indicate if hit backbarrier */
 
   int Backi = -1;               /* i for backbarrier intersection */
@@ -4879,6 +6384,8 @@ GetOverwashDepth (State * _s, int xin, int yin, double xinfl, double yinfl,
   double AngleSin,
     AngleUsed;
 
+  const int ylo = LINE_YLO (_s);
+
   if (OWType == 0)
     /* Use Cell Depths for overwash depths */
   {
@@ -4905,70 +6412,23 @@ GetOverwashDepth (State * _s, int xin, int yin, double xinfl, double yinfl,
     /* Geometric relation to determine depth through intersection of shorefaces     */
     /* look in line determined by shoreline slope - reuse stepping function (again) */
   {
-    x = xinfl;
-    y = yinfl;
+    /* A halo stops the search at BackBarrierReach, which it is wide enough for */
+    const double reach = HAS_HALO (_s) ? BackBarrierReach (_s) : HUGE_VAL;
 
-    if (_s->SurroundingAngle[ishore] == 0.0)
-    {
-      /* unlikely, but make sure no div by zero */
-      slope = 0.00001;
-    }
-    else if (fabs (_s->SurroundingAngle[ishore]) == 90.0)
-    {
-      slope = 9999.9;
-    }
-    else
-    {
-      slope = fabs (tan (_s->SurroundingAngle[ishore]));
-    }
+    RayStart (&ray, xinfl, yinfl, ylo, _s->SurroundingAngle[ishore], -1,
+              (_s->SurroundingAngle[ishore] > 0) ? 1 : -1, TRUE);
 
     BackFlag = 0;
-    if (_s->SurroundingAngle[ishore] > 0)
-      ysign = 1;
-    else
-      ysign = -1;
 
-    while ((!BackFlag) && (y > 0) && (y < 2 * _s->ny) && (x > 1))
+    while ((!BackFlag) && (ray.y > -ylo) && (ray.y < _s->ny_grid - ylo)
+           && (ray.x > 1) && (fabs (ray.y - yinfl) < reach))
     {
-      NextXInt = ceil (x) - 1;
-      if (ysign > 0)
-        NextYInt = floor (y) + 1;
-      else
-        NextYInt = ceil (y - 1);
-
-      /* moving to next whole 'x' position, what is y position? */
-      Ydown = y + (x - NextXInt) * slope * ysign;
-      DistanceDown =
-        Raise (((Ydown - y) * (Ydown - y) + (NextXInt - x) * (NextXInt - x)),
-               .5);
+      RayStep (&ray);
+      xtest = ray.xtest;
+      ytest = ray.ytest;
 
-      /* moving to next whole 'y' position, what is x position? */
-      Xside = x - fabs (NextYInt - y) / slope;
-      DistanceSide =
-        Raise (((NextYInt - y) * (NextYInt - y) + (Xside - x) * (Xside - x)),
-               .5);
-
-      DEBUG_PRINT (DEBUG_10B,
-                   "x: %f  y: %f  X:%d  Y: %d  Yd: %f  DistD: %f Xs: %f DistS: %f\n",
-                   x, y, NextXInt, NextYInt, Ydown, DistanceDown, Xside,
-                   DistanceSide);
-
-      if (DistanceDown < DistanceSide)
-        /* next cell is the down cell */
-      {
-        x = NextXInt;
-        y = Ydown;
-        xtest = NextXInt - 1;
-        ytest = floor (y);
-      }
-      else
-        /* next cell is the side cell */
-      {
-        x = Xside;
-        y = NextYInt;
-        xtest = floor (x);
-        ytest = y + (ysign - 1) / 2;
-      }
+      DEBUG_PRINT (DEBUG_10B, "x: %f  y: %f  xtest: %d  ytest: %d\n",
+                   ray.x, ray.y, xtest, ytest);
 
       if (_s->PercentFull[xtest][ytest] > 0)
         BackFlag = 1;
@@ -4994,7 +6454,7 @@ GetOverwashDepth (State * _s, int xin, int yin, double xinfl, double yinfl,
     }
 
     if (!BackFlag)
-      /* The search for the backbarrier went out of bounds - not good, assume big = depthshoreface    */
+      /* The search for the backbarrier went out of bounds or out of reach - assume big = depthshoreface */
       /* Periodic B.C.'s should make this not so important                                            */
     {
       Depth = _s->shoreface_depth;
@@ -5008,7 +6468,8 @@ GetOverwashDepth (State * _s, int xin, int yin, double xinfl, double yinfl,
     {
       BBDistance = Raise (((xinfl - xtest - _s->PercentFull[xtest][ytest]) *
                            (xinfl - xtest - _s->PercentFull[xtest][ytest])) +
-                          ((yinfl - ytest - 0.5) * (yinfl - ytest - 0.5)), .5);
+                          ((yinfl - (ytest - ylo) - 0.5) *
+                           (yinfl - (ytest - ylo) - 0.5)), .5);
 
       if (!FoundFlag)
         /* The backbarrier intersection isn't on the shoreline */